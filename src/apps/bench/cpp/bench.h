@@ -0,0 +1,74 @@
+
+#pragma once
+
+#include <chrono>
+
+#include "libzru.h"
+
+namespace bench
+{
+    typedef std::chrono::steady_clock t_clock;
+
+    /// Returns the seconds elapsed since t
+    inline double elapsed(const t_clock::time_point &t)
+    {   return std::chrono::duration<double>(t_clock::now() - t).count();
+    }
+
+    /// Calls f() n times and returns the seconds elapsed
+    template<typename F>
+        double time_it(long n, F f)
+        {
+            auto t = t_clock::now();
+            for (long i = 0; i < n; i++)
+                f();
+            return elapsed(t);
+        }
+
+    /// Shows a result line, ops/sec and optionally bytes/sec
+    inline void report(const zru::t_str &sName, double n, double secs, double bytes = 0)
+    {
+        std::stringstream ss;
+        ss << std::left << std::setw(40) << sName
+           << std::right << std::fixed << std::setprecision(3)
+           << std::setw(10) << (secs * 1000) << " ms"
+           << std::setw(14) << std::setprecision(0) << (secs ? n / secs : 0) << " ops/s";
+        if (0 < bytes)
+            ss << std::setw(10) << std::setprecision(1) << (secs ? bytes / secs / (1024 * 1024) : 0) << " MB/s";
+        ZruShow(ss.str());
+    }
+
+    /// Returns the number of heap allocations made so far
+    long allocs();
+
+    /// Runs f() n times, shows the time and the heap allocations per call
+    template<typename F>
+        void alloc_it(const zru::t_str &sName, long n, F f)
+        {
+            long a = allocs();
+            double t = time_it(n, f);
+            a = allocs() - a;
+            report(sName, n, t);
+            std::stringstream ss;
+            ss << "    " << std::fixed << std::setprecision(2) << (double)a / n << " allocs/op";
+            ZruShow(ss.str());
+        }
+
+    // Benchmarks
+    int Bench_Json(const zru::property_bag &pbCl);
+    int Bench_Str(const zru::property_bag &pbCl);
+    int Bench_Any(const zru::property_bag &pbCl);
+    int Bench_Map(const zru::property_bag &pbCl);
+    int Bench_Queue(const zru::property_bag &pbCl);
+    int Bench_Shards(const zru::property_bag &pbCl);
+    int Bench_View(const zru::property_bag &pbCl);
+    int Bench_Path(const zru::property_bag &pbCl);
+    int Bench_Waits(const zru::property_bag &pbCl);
+    int Bench_Signal(const zru::property_bag &pbCl);
+    int Bench_Pool(const zru::property_bag &pbCl);
+    int Bench_Timer(const zru::property_bag &pbCl);
+    int Bench_Coro(const zru::property_bag &pbCl);
+    int Bench_Ring(const zru::property_bag &pbCl);
+    int Bench_Shm(const zru::property_bag &pbCl);
+    int Bench_Arena(const zru::property_bag &pbCl);
+    int Bench_ShmMap(const zru::property_bag &pbCl);
+}
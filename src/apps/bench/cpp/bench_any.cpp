@@ -0,0 +1,56 @@
+
+#include "bench.h"
+
+namespace bench
+{
+
+int Bench_Any(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long reps = 20000 * scale;
+
+    // A typical record, strings too long for small string storage
+    zru::property_bag pbRec;
+    pbRec["name"] = "a record name that is long enough to live on the heap";
+    pbRec["path"] = "/some/rather/long/path/to/a/file/on/the/disk.txt";
+    pbRec["size"] = 123456;
+    pbRec["tags"]["a"] = "first tag string, also long enough for the heap";
+    pbRec["tags"]["b"] = "second tag string, also long enough for the heap";
+
+    const zru::t_str sLong(64, 'x');
+
+    zru::property_bag pbList;
+    alloc_it("property_bag push (copy)", reps, [&]()
+    {   zru::property_bag r(pbRec);
+        pbList.push(r);
+    });
+
+    pbList.clear();
+    alloc_it("property_bag push (move)", reps, [&]()
+    {   zru::property_bag r(pbRec);
+        pbList.push(std::move(r));
+    });
+
+    alloc_it("property_bag pop", reps, [&]() { pbList.pop(); });
+
+    std::vector<zru::any> v;
+    v.reserve(reps);
+    alloc_it("vector<any> insert (copy)", reps, [&]()
+    {   zru::any a(sLong);
+        v.push_back(a);
+    });
+
+    v.clear();
+    alloc_it("vector<any> insert (move)", reps, [&]()
+    {   zru::any a(sLong);
+        v.push_back(std::move(a));
+    });
+
+    alloc_it("str::join", reps, [&]()
+    {   zru::str::join(zru::t_str(","), sLong, 42, 3.5, sLong);
+    });
+
+    return 0;
+}
+
+}
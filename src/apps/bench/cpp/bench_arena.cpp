@@ -0,0 +1,83 @@
+
+#include <thread>
+#include <cstdlib>
+
+#include "bench.h"
+
+namespace bench
+{
+
+/// nThreads each allocating and freeing reps blocks of mixed sizes, kept nLive at a time
+template<typename A, typename F>
+    void run_alloc(const zru::t_str &sName, int nThreads, long reps, A alloc, F release)
+    {
+        const long nLive = 64;
+        auto t = t_clock::now();
+
+        std::vector<std::thread> th;
+        for (int i = 0; i < nThreads; i++)
+            th.emplace_back([&]()
+            {
+                std::vector<void*> v(nLive, (void*)0);
+                for (long n = 0; n < reps; n++)
+                {   void *&p = v[n % nLive];
+                    release(p);
+                    p = alloc(16 + (n * 37) % 500);
+                }
+                for (auto p : v)
+                    release(p);
+            });
+
+        for (auto &x : th)
+            x.join();
+
+        std::stringstream ss;
+        ss << sName << " x" << nThreads;
+        report(ss.str(), reps * nThreads, elapsed(t));
+    }
+
+int Bench_Arena(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long reps = 1000000 * scale;
+
+    zru::shm_arena a;
+    if (!a.open("/zru-bench-arena", 64 << 20))
+    {   ZruError("Can't open arena");
+        return -1;
+    }
+
+    for (int nThreads : { 1, 4 })
+    {
+        run_alloc("malloc/free", nThreads, reps,
+                  [](std::size_t n) { return ::malloc(n); },
+                  [](void *p) { ::free(p); });
+
+        run_alloc("shm_arena alloc/free", nThreads, reps,
+                  [&](std::size_t n) { return a.alloc(n); },
+                  [&](void *p) { a.free(p); });
+    }
+
+    // Walking a list through offset pointers, against plain ones
+    struct node { long v; zru::shm_ptr<node> next; node *raw; };
+    node *pHead = 0;
+    for (long i = 0; i < 100000; i++)
+        if (node *x = a.create<node>())
+        {   x->v = i;
+            x->next = pHead;
+            x->raw = pHead;
+            pHead = x;
+        }
+
+    long nSum = 0;
+    double t = time_it(100, [&]() { for (node *x = pHead; x; x = x->raw) nSum += x->v; });
+    report("walk node*", 100000 * 100, t);
+    t = time_it(100, [&]() { for (node *x = pHead; x; x = x->next.get()) nSum += x->v; });
+    report("walk shm_ptr", 100000 * 100, t);
+
+    ZruShow("    ", a.used() / 1024, " KB used", nSum ? "" : " ");
+
+    return 0;
+}
+
+}
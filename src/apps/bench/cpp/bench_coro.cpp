@@ -0,0 +1,73 @@
+
+#include <thread>
+#include <atomic>
+
+#include "bench.h"
+
+namespace bench
+{
+
+#if defined(ZRU_COROUTINES)
+
+/// Pops one value, counts down when done
+static zru::co_task co_consumer(zru::thread_pool &tp, std::atomic<long> &nLeft, zru::signal &done)
+{
+    co_await zru::co_schedule(tp);
+    zru::property_bag p;
+    co_await zru::co_pop(zru::pb, p, ".", "bench.co", 60000);
+    if (!--nLeft)
+        done.signal_all();
+}
+
+#endif
+
+int Bench_Coro(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long nWaiters = 500 * scale;
+
+    // A thread per waiter, blocked in pop()
+    {
+        std::atomic<long> nLeft(nWaiters);
+        auto t = t_clock::now();
+        std::vector<std::thread> th;
+        for (long i = 0; i < nWaiters; i++)
+            th.emplace_back([&]()
+            {   zru::property_bag p;
+                zru::pb.pop(p, ".", "bench.th", 60000);
+                nLeft--;
+            });
+        for (long i = 0; i < nWaiters; i++)
+            zru::pb.push(".", "bench.th", i, false);
+        for (auto &x : th)
+            x.join();
+        report("thread per waiter", nWaiters, elapsed(t));
+    }
+
+#if defined(ZRU_COROUTINES)
+
+    // Coroutines on two threads
+    {
+        zru::thread_pool tp(2);
+        std::atomic<long> nLeft(nWaiters);
+        zru::signal done;
+        auto t = t_clock::now();
+        for (long i = 0; i < nWaiters; i++)
+            co_consumer(tp, nLeft, done);
+        for (long i = 0; i < nWaiters; i++)
+            zru::pb.push(".", "bench.co", i, false);
+        while (!done.wait_ms(1000))
+            ;
+        report("coroutine per waiter, 2 threads", nWaiters, elapsed(t));
+    }
+
+#else
+
+    ZruShow("coroutines need a C++20 build, -DCpp20=ON");
+
+#endif
+
+    return 0;
+}
+
+}
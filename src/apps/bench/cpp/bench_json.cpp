@@ -0,0 +1,88 @@
+
+#include "bench.h"
+
+namespace bench
+{
+
+/// Builds a document of n small records
+static zru::t_str make_json(long n)
+{
+    zru::t_str s = "{\"records\":[";
+    for (long i = 0; i < n; i++)
+    {
+        if (i)
+            s += ",";
+
+        // Whole prices need a digit after the point to be JSON
+        zru::t_str price = zru::any(i * 0.25).toString();
+        if ('.' == price.back())
+            price += '0';
+
+        s += zru::str::join<zru::t_str>("",
+                "{\"id\":", i, ",\"name\":\"item ", i, "\",\"price\":", price,
+                ",\"tags\":[\"a\",\"b\",\"c\"],\"ok\":true}");
+    }
+    s += "]}";
+    return s;
+}
+
+/// Splits the records array into one record per line
+static void split_lines(const zru::t_str &sJson, zru::t_str &sLines)
+{
+    sLines = sJson.substr(12, sJson.length() - 14);
+    for (zru::t_str::size_type p = 0; zru::t_str::npos != (p = sLines.find("},{\"id", p)); p += 2)
+        sLines[p + 1] = '\n';
+}
+
+/// Sums the price fields without materializing the tree
+struct price_sum : zru::parsers::json_sax_handler<>
+{
+    double sum = 0;
+    bool price = false;
+    bool key(const zru::t_str &k) { price = (k == "price"); return true; }
+    bool value(const zru::t_any &v) { if (price) sum += v.toDouble(); return true; }
+};
+
+int Bench_Json(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    zru::t_str sJson = make_json(10000 * scale);
+    double bytes = sJson.length();
+
+    double sum = 0;
+    double t = time_it(1, [&]()
+    {
+        zru::property_bag pb = zru::parsers::json_parse(sJson);
+        for (auto it = pb["records"].begin(); pb["records"].end() != it; it++)
+            sum += it->second["price"].val().toDouble();
+    });
+    report("json_parse + walk", 1, t, bytes);
+
+    price_sum h;
+    t = time_it(1, [&]()
+    {
+        zru::parsers::json_sax(sJson, h);
+    });
+    report("json_sax", 1, t, bytes);
+
+    if (sum != h.sum)
+    {   ZruError("Results differ : ", sum, " != ", h.sum);
+        return -1;
+    }
+
+    // Same records, newline delimited, fed in 64k chunks
+    zru::t_str sLines;
+    split_lines(sJson, sLines);
+    long nRecords = 0;
+    zru::parsers::json_stream<> js([&](zru::property_bag &)->bool { nRecords++; return true; });
+    t = time_it(1, [&]()
+    {
+        for (zru::t_str::size_type i = 0; i < sLines.length(); i += 65536)
+            js.write(sLines.data() + i, std::min<zru::t_str::size_type>(65536, sLines.length() - i));
+    });
+    report("json_stream (64k chunks)", nRecords, t, sLines.length());
+
+    return 0;
+}
+
+}
@@ -0,0 +1,126 @@
+
+#include "bench.h"
+
+namespace bench
+{
+
+#if defined(ZRU_PROPERTY_BAG_FLAT)
+static const char *g_sStorage = "flat_map";
+#else
+static const char *g_sStorage = "std::map";
+#endif
+
+/// A list of small records, typical of config and json data
+static void build_tree(zru::property_bag &pb, long nRecs, const std::vector<zru::t_str> &vIds)
+{
+    for (long i = 0; i < nRecs; i++)
+    {
+        auto &r = pb[vIds[i]];
+        r["id"] = i;
+        r["name"] = "record name";
+        r["type"] = "file";
+        r["enabled"] = true;
+        r["path"] = "/some/path/to/the/file.txt";
+        r["size"] = i * 100;
+        r["tags"]["a"] = 1;
+        r["tags"]["b"] = 2;
+    }
+}
+
+static long lookup_tree(const zru::property_bag &pb, const std::vector<zru::t_str> &vIds)
+{
+    static const zru::t_str keys[] = { "id", "size", "path", "missing" };
+    long n = 0;
+    for (auto &id : vIds)
+    {
+        auto it = pb.find(id);
+        if (pb.end() == it)
+            continue;
+        for (auto &k : keys)
+            if (it->second.end() != it->second.find(k))
+                n++;
+    }
+    return n;
+}
+
+static long walk_tree(const zru::property_bag &pb)
+{
+    long n = pb.val().isVoid() ? 0 : 1;
+    for (auto it = pb.begin(); pb.end() != it; it++)
+        n += walk_tree(it->second);
+    return n;
+}
+
+/// Erases every other record by key, then the rest from the front
+static void erase_tree(zru::property_bag &pb, const std::vector<zru::t_str> &vIds)
+{
+    for (std::size_t i = 1; i < vIds.size(); i += 2)
+        pb.erase(vIds[i]);
+    while (pb.size())
+        pb.erase(pb.begin());
+}
+
+int Bench_Map(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long reps = 20 * scale;
+
+    // Build with -DPropertyBagFlat=ON to compare the storage
+    for (long nRecs : { 10, 10000 })
+    {
+        ZruShow("property_bag over ", g_sStorage, ", ", nRecs, " records");
+
+        std::vector<zru::t_str> vIds;
+        for (long i = 0; i < nRecs; i++)
+            vIds.push_back(zru::t_str("rec_") + zru::any(i).toString());
+
+        double t = time_it(reps, [&]() { zru::property_bag pb; build_tree(pb, nRecs, vIds); });
+        report("build", nRecs * reps, t);
+
+        zru::property_bag pb;
+        build_tree(pb, nRecs, vIds);
+
+        long n = 0;
+        t = time_it(reps, [&]() { n += lookup_tree(pb, vIds); });
+        report("lookup", nRecs * 4 * reps, t);
+
+        long w = 0;
+        t = time_it(reps, [&]() { w += walk_tree(pb); });
+        report("iterate", w, t);
+
+        t = 0;
+        for (long r = 0; r < reps; r++)
+        {
+            zru::property_bag pbE;
+            build_tree(pbE, nRecs, vIds);
+            t += time_it(1, [&]() { erase_tree(pbE, vIds); });
+        }
+        report("erase", nRecs * reps, t);
+
+        if (n != nRecs * 3 * reps || w != nRecs * 8 * reps)
+        {   ZruError("Unexpected results : ", n, ", ", w);
+            return -1;
+        }
+    }
+
+    // Queue use, a bag that already has a key keeps string keyed pushes
+    const long nQ = 100000 * scale;
+    for (int bArray = 0; bArray < 2; bArray++)
+    {
+        zru::property_bag pbQ;
+        if (!bArray)
+            pbQ["_"] = 0;
+
+        long a = allocs();
+        double t = time_it(nQ, [&]() { pbQ.push(42); });
+        t += time_it(nQ, [&]() { pbQ.pop(); });
+        a = allocs() - a;
+
+        report(bArray ? "array push/pop" : "map keyed push/pop", nQ * 2, t);
+        ZruShow("    ", a / nQ, " allocs/push");
+    }
+
+    return 0;
+}
+
+}
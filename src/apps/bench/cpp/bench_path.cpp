@@ -0,0 +1,39 @@
+
+#include "bench.h"
+
+namespace bench
+{
+
+int Bench_Path(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long reps = 200000 * scale;
+
+    // A few siblings at each level so the lookups aren't trivial
+    zru::property_bag pb;
+    for (int i = 0; i < 20; i++)
+        pb.at(".", "stats.rx.k" + std::to_string(i)) = i;
+    pb.at(".", "stats.rx.count") = 0;
+
+    const zru::t_str sKey = "stats.rx.count";
+    const zru::property_bag::path pKey(".", sKey);
+
+    alloc_it("at(sep, key)", reps, [&]() { pb.at(".", sKey) += 1; });
+    alloc_it("at(path)", reps, [&]() { pb.at(pKey) += 1; });
+    alloc_it("isset(sep, key)", reps, [&]() { pb.isset(".", sKey); });
+    alloc_it("isset(path)", reps, [&]() { pb.isset(pKey); });
+
+    zru::property_bag_ts pbs;
+    pbs.set(".", sKey, 0);
+    alloc_it("property_bag_ts inc(sep, key)", reps, [&]() { pbs.inc(".", sKey, 1); });
+    alloc_it("property_bag_ts inc(path)", reps, [&]() { pbs.inc(pKey, 1); });
+
+    if (pb.at(pKey).val().toLong() != 2 * reps || pbs.get(pKey).val().toLong() != 2 * reps)
+    {   ZruError("Bad count");
+        return -1;
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,123 @@
+
+#include <thread>
+#include <atomic>
+
+#include "bench.h"
+
+namespace bench
+{
+
+/// A short piece of work
+static long work(long n)
+{
+    long r = n;
+    for (int i = 0; i < 200; i++)
+        r = r * 31 + i;
+    return r;
+}
+
+int Bench_Pool(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long nTasks = 100000 * scale;
+
+    ZruShow("hardware threads : ", std::thread::hardware_concurrency());
+
+    // Cost of the run loop with its counters, against calling the function
+    {
+        const long nRuns = 1000000 * scale;
+        long n = 0;
+        zru::worker_thread::pfn_Worker f = [&n, nRuns]() { return ++n < nRuns ? 0 : -1; };
+
+        double t = time_it(nRuns, f);
+        report("std::function call", nRuns, t);
+
+        for (bool bStats : { true, false })
+        {
+            zru::worker_thread::options opt;
+            opt.stats = bStats;
+
+            n = 0;
+            zru::signal sDone;
+            auto t0 = t_clock::now();
+            zru::worker_thread w([&]() { int r = f(); if (0 > r) sDone.signal_all(); return r; }, opt);
+            sDone.wait_ms(60000);
+            report(bStats ? "worker_thread loop" : "worker_thread loop, no stats", nRuns, elapsed(t0));
+            w.join();
+        }
+    }
+
+    for (std::size_t nThreads : { 1, 2, 4, 8 })
+    {
+        zru::thread_pool tp(nThreads);
+
+        // From outside, one future each
+        auto t = t_clock::now();
+        std::vector< std::future<long> > vF;
+        vF.reserve(nTasks);
+        for (long i = 0; i < nTasks; i++)
+            vF.push_back(tp.submit(work, i));
+        long r = 0;
+        for (auto &f : vF)
+            r += f.get();
+        std::stringstream ss;
+        ss << "submit/get, " << nThreads << " threads";
+        report(ss.str(), nTasks, elapsed(t));
+
+        // Spawned by one task, the others have to steal them
+        std::atomic<long> nDone(0);
+        zru::signal sDone;
+        t = t_clock::now();
+        tp.post([&]()
+        {
+            for (long i = 0; i < nTasks; i++)
+                tp.post([&, i]()
+                {   work(i);
+                    if (nTasks == ++nDone)
+                        sDone.signal_all();
+                });
+        });
+        while (!sDone.wait_ms(1000))
+            ;
+        ss.str("");
+        ss << "fan out, " << nThreads << " threads";
+        report(ss.str(), nTasks, elapsed(t));
+
+        if (!r)
+            ZruShow("");
+    }
+
+    // Shutting down workers that are blocked on a property bag, abort() ends the pop
+    {
+        const int nWorkers = 200;
+        std::atomic<int> nBlocked(0);
+        std::vector< std::unique_ptr<zru::worker_thread> > v;
+        for (int i = 0; i < nWorkers; i++)
+            v.emplace_back(new zru::worker_thread([&]()
+            {   zru::property_bag p;
+                nBlocked++;
+                zru::pb.pop(p, ".", "bench.stop", 60000);
+                return -1;
+            }));
+
+        while (nWorkers > nBlocked)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        auto t = t_clock::now();
+        for (auto &w : v)
+            w->abort();
+        for (auto &w : v)
+            w->join();
+        double secs = elapsed(t);
+        report("stop blocked workers", nWorkers, secs);
+
+        std::stringstream ss;
+        ss << "    " << std::fixed << std::setprecision(1) << secs * 1000 << " ms for " << nWorkers << " workers";
+        ZruShow(ss.str());
+    }
+
+    return 0;
+}
+
+}
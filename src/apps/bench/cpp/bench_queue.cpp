@@ -0,0 +1,132 @@
+
+#include <thread>
+#include <atomic>
+
+#include "bench.h"
+
+namespace bench
+{
+
+static long long now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t_clock::now().time_since_epoch()).count();
+}
+
+/// Moves nItems from nProd producers to nCons consumers, shows throughput and mean latency
+template<typename P, typename C>
+    void run_queue(const zru::t_str &sName, int nProd, int nCons, long nItems, P push, C pop)
+    {
+        std::atomic<long> nLeft(nItems);
+        std::atomic<long long> nLat(0);
+        std::vector<std::thread> th;
+
+        auto t = t_clock::now();
+
+        for (int i = 0; i < nCons; i++)
+            th.emplace_back([&]()
+            {
+                long long lat = 0;
+                zru::property_bag p;
+                while (0 < nLeft.load())
+                    if (pop(p))
+                    {   lat += now_ns() - p.val().toLongLong();
+                        nLeft--;
+                    }
+                nLat += lat;
+            });
+
+        for (int i = 0; i < nProd; i++)
+            th.emplace_back([&, i]()
+            {
+                long n = nItems / nProd + (i < nItems % nProd ? 1 : 0);
+                while (0 < n--)
+                    while (!push(zru::any(now_ns())))
+                        std::this_thread::yield();
+            });
+
+        for (auto &x : th)
+            x.join();
+
+        double secs = elapsed(t);
+        std::stringstream ss;
+        ss << sName << " " << nProd << "x" << nCons;
+        report(ss.str(), nItems, secs);
+
+        ss.str("");
+        ss << "    " << std::fixed << std::setprecision(1) << (double)nLat / nItems / 1000 << " us mean latency";
+        ZruShow(ss.str());
+    }
+
+/// One producer and one consumer moving nItems in batches of nBatch
+template<typename P, typename C>
+    void run_batch(const zru::t_str &sName, long nItems, long nBatch, P push, C pop)
+    {
+        auto t = t_clock::now();
+
+        std::thread cons([&]()
+        {
+            std::vector<zru::property_bag> v;
+            for (long n = 0; n < nItems;)
+            {   v.clear();
+                n += pop(v, nBatch);
+            }
+        });
+
+        for (long n = 0; n < nItems; n += nBatch)
+        {   std::vector<zru::property_bag> v;
+            for (long i = 0; i < nBatch; i++)
+                v.emplace_back(zru::any(n + i));
+            push(v);
+        }
+
+        cons.join();
+
+        std::stringstream ss;
+        ss << sName << " x" << nBatch;
+        report(ss.str(), nItems, elapsed(t));
+    }
+
+int Bench_Queue(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long nItems = 100000 * scale;
+
+    const std::pair<int, int> shapes[] = { {1, 1}, {4, 4}, {8, 2} };
+    for (auto &s : shapes)
+    {
+        run_queue("pb.push/pop", s.first, s.second, nItems,
+                  [](const zru::any &v) { zru::pb.push(".", "bench.q", v, false); return true; },
+                  [](zru::property_bag &p) { return zru::pb.pop(p, ".", "bench.q", 10); });
+
+        auto q = zru::pb.get_queue("bench.nq", 4096);
+        run_queue("named queue", s.first, s.second, nItems,
+                  [q](const zru::any &v) { return q->push(v); },
+                  [q](zru::property_bag &p) { return q->pop(p, 10); });
+        zru::pb.remove_queue("bench.nq");
+    }
+
+    // The same items, one call each or one call per batch
+    for (long nBatch : { 16, 256 })
+    {
+        run_batch("push/pop per item", nItems, nBatch,
+                  [](std::vector<zru::property_bag> &v)
+                  {   for (auto &x : v)
+                          zru::pb.push(".", "bench.b", std::move(x), true);
+                  },
+                  [](std::vector<zru::property_bag> &v, long n)
+                  {   zru::property_bag p;
+                      long c = 0;
+                      while (c < n && zru::pb.pop(p, ".", "bench.b", c ? 0 : 10))
+                          v.push_back(std::move(p)), c++;
+                      return c;
+                  });
+
+        run_batch("push_batch/popv", nItems, nBatch,
+                  [](std::vector<zru::property_bag> &v) { zru::pb.push_batch(".", "bench.b", std::move(v)); },
+                  [](std::vector<zru::property_bag> &v, long n) { return zru::pb.popv(v, ".", "bench.b", n, 10); });
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,67 @@
+
+#include <thread>
+
+#include "bench.h"
+
+namespace bench
+{
+
+/// Moves nMsgs records of nBytes from nProd producer threads to one consumer
+static void run_ring(const zru::t_str &sName, int nProd, long nMsgs, std::size_t nBytes, int nFlags)
+{
+    zru::shm_ring r;
+    if (!r.open("/zru-bench-ring", 1 << 20, true, nFlags))
+    {   ZruError("Can't open ring");
+        return;
+    }
+
+    auto t = t_clock::now();
+
+    std::vector<std::thread> th;
+    for (int i = 0; i < nProd; i++)
+        th.emplace_back([&, i]()
+        {
+            // Each producer maps it for itself, like another process would
+            zru::shm_ring rp;
+            rp.open("/zru-bench-ring", 1 << 20, false);
+            long n = nMsgs / nProd + (i < nMsgs % nProd ? 1 : 0);
+            while (0 < n--)
+                if (void *p = rp.reserve(nBytes, 1000))
+                {   memset(p, (int)n, nBytes);
+                    rp.commit(p);
+                }
+        });
+
+    std::size_t n;
+    long nGot = 0;
+    while (nGot < nMsgs)
+        if (const void *p = r.peek(n, 1000))
+        {   r.release(p);
+            nGot++;
+        }
+        else
+            break;
+
+    for (auto &x : th)
+        x.join();
+
+    std::stringstream ss;
+    ss << sName << " " << nProd << "x1, " << nBytes << " bytes";
+    report(ss.str(), nGot, elapsed(t), (double)nGot * nBytes);
+}
+
+int Bench_Ring(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long nMsgs = 1000000 * scale;
+
+    for (std::size_t nBytes : { 16, 64, 1024 })
+        run_ring("shm_ring spsc", 1, nMsgs, nBytes, zru::shm_ring::eSingleProducer);
+
+    for (int nProd : { 1, 4 })
+        run_ring("shm_ring mpsc", nProd, nMsgs, 64, 0);
+
+    return 0;
+}
+
+}
@@ -0,0 +1,52 @@
+
+#include <thread>
+
+#include "bench.h"
+
+namespace bench
+{
+
+/// nThreads each update their own subtree of pb
+static double run_shards(zru::property_bag_ts &pb, int nThreads, long nOps)
+{
+    std::vector<std::thread> th;
+    auto t = t_clock::now();
+
+    for (int i = 0; i < nThreads; i++)
+        th.emplace_back([&pb, i, nThreads, nOps]()
+        {
+            zru::t_str sKey = "sub" + std::to_string(i) + ".count";
+            for (long n = nOps / nThreads; 0 < n; n--)
+            {   pb.inc(".", sKey, 1);
+                pb.get(".", sKey);
+            }
+        });
+
+    for (auto &x : th)
+        x.join();
+
+    return elapsed(t);
+}
+
+int Bench_Shards(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long nOps = 200000 * scale;
+
+    ZruShow("hardware threads : ", std::thread::hardware_concurrency());
+
+    for (int nThreads : { 1, 2, 4, 8, 16, 32, 64 })
+        for (std::size_t nShards : { 1, 16 })
+        {
+            zru::property_bag_ts pb(nShards);
+            double t = run_shards(pb, nThreads, nOps);
+
+            std::stringstream ss;
+            ss << nThreads << " threads, " << nShards << " shard" << (1 < nShards ? "s" : "");
+            report(ss.str(), nOps * 2, t);
+        }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,207 @@
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "bench.h"
+
+namespace bench
+{
+
+/// Opens, touches and randomly reads a share mapped with opt
+static void run_shm(const zru::t_str &sName, int64_t nBytes, long nReads, const zru::shrmem::options &opt)
+{
+    auto t = t_clock::now();
+    zru::shrmem m;
+    if (!m.open("/zru-bench-shm", nBytes, true, opt))
+    {   ZruShow(sName, " : not available here");
+        return;
+    }
+    double tOpen = elapsed(t);
+
+    // Write every page, faults them in if open() didn't
+    uint64_t *p = (uint64_t*)m.ptr();
+    const uint64_t n = (uint64_t)m.size() / sizeof(uint64_t);
+    t = t_clock::now();
+    for (uint64_t i = 0; i < n; i += 512)
+        p[i] = i;
+    double tTouch = elapsed(t);
+
+    // Dependent random reads, each one a likely TLB and cache miss
+    uint64_t x = 88172645463325252ull, sum = 0;
+    t = t_clock::now();
+    for (long i = 0; i < nReads; i++)
+    {   x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        sum += p[(x + sum) % n];
+    }
+    double tRead = elapsed(t);
+
+    std::stringstream ss;
+    ss << std::left << std::setw(24) << sName << std::right << std::fixed << std::setprecision(1)
+       << " open " << std::setw(8) << tOpen * 1000 << " ms"
+       << "   touch " << std::setw(8) << tTouch * 1000 << " ms"
+       << "   random read " << std::setw(6) << tRead * 1e9 / nReads << " ns"
+       << (sum ? "" : " ");
+    ZruShow(ss.str());
+}
+
+/// Sums a file of uint64_t, loaded by load(), shows time to first sum
+template<typename L>
+    void run_file(const zru::t_str &sName, int64_t nBytes, L load)
+    {
+        auto t = t_clock::now();
+        const uint64_t *p = 0;
+        uint64_t n = 0, sum = 0;
+        if (!load(p, n))
+        {   ZruShow(sName, " : failed");
+            return;
+        }
+        for (uint64_t i = 0; i < n; i++)
+            sum += p[i];
+        double secs = elapsed(t);
+
+        std::stringstream ss;
+        ss << std::left << std::setw(24) << sName << std::right << std::fixed << std::setprecision(1)
+           << " load + sum " << std::setw(8) << secs * 1000 << " ms   "
+           << std::setw(8) << nBytes / secs / (1024 * 1024) << " MB/s"
+           << (sum == (n - 1) * n / 2 ? "" : "   WRONG SUM");
+        ZruShow(ss.str());
+    }
+
+int Bench_Shm(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const int64_t nBytes = (int64_t)256 * 1024 * 1024 * scale;
+    const long nReads = 5000000 * scale;
+
+    ZruShow(nBytes / (1024 * 1024), " MB share");
+
+    zru::shrmem::options opt;
+    run_shm("default", nBytes, nReads, opt);
+
+    opt.populate = true;
+    run_shm("populate", nBytes, nReads, opt);
+
+    opt.lock = true;
+    run_shm("populate, lock", nBytes, nReads, opt);
+
+    opt = zru::shrmem::options();
+    opt.populate = true;
+    opt.node = 0;
+    run_shm("populate, node 0", nBytes, nReads, opt);
+
+    opt = zru::shrmem::options();
+    opt.populate = true;
+    opt.thp = true;
+    run_shm("populate, thp", nBytes, nReads, opt);
+
+    opt = zru::shrmem::options();
+    opt.populate = true;
+    opt.huge = true;
+    run_shm("populate, hugetlbfs", nBytes, nReads, opt);
+
+    // Doubling a full share from 1 MB, in place or by copying into a new one
+    {   opt = zru::shrmem::options();
+        opt.growable = true;
+        zru::shrmem g, a;
+        if (!g.open("/zru-bench-grow", 1 << 20, true, opt) || !a.open("/zru-bench-grow", 1 << 20, false, opt))
+        {   ZruShow("grow : not available here");
+            return 0;
+        }
+
+        long n = 0;
+        double tGrow = 0, tRemap = 0;
+        memset(g.ptr(), 1, g.size());
+        while (g.size() < nBytes)
+        {   auto t = t_clock::now();
+            g.grow(g.size() * 2);
+            tGrow += elapsed(t);
+            memset(g.str() + g.size() / 2, 1, g.size() / 2);
+
+            t = t_clock::now();
+            a.remap();
+            tRemap += elapsed(t);
+            n++;
+        }
+
+        double tCopy = 0;
+        std::unique_ptr<zru::shrmem> c(new zru::shrmem);
+        c->open("/zru-bench-copy-0", 1 << 20);
+        memset(c->ptr(), 1, c->size());
+        for (long i = 1; c->size() < nBytes; i++)
+        {   auto t = t_clock::now();
+            std::unique_ptr<zru::shrmem> c2(new zru::shrmem);
+            if (!c2->open(zru::t_str("/zru-bench-copy-") + zru::any(i).toString(), c->size() * 2))
+                break;
+            memcpy(c2->ptr(), c->ptr(), c->size());
+            c = std::move(c2);
+            tCopy += elapsed(t);
+            memset(c->str() + c->size() / 2, 1, c->size() / 2);
+        }
+
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(3) << "1 MB to " << nBytes / (1024 * 1024) << " MB in " << n << " steps"
+           << "   grow " << tGrow * 1000 << " ms   remap " << tRemap * 1000 << " ms"
+           << "   recreate and copy " << tCopy * 1000 << " ms";
+        ZruShow(ss.str());
+    }
+
+    // Loading a data file, the page cache is warm from writing it
+    const zru::t_str sFile = "/tmp/zru-bench-map.bin";
+    const int64_t nFile = nBytes / 4;
+    {   zru::shrmem m;
+        if (!m.open_file(sFile, nFile))
+        {   ZruShow(sFile, " : can't create");
+            return 0;
+        }
+        uint64_t *p = (uint64_t*)m.ptr();
+        for (uint64_t i = 0; i < (uint64_t)nFile / sizeof(uint64_t); i++)
+            p[i] = i;
+        m.flush();
+    }
+
+    ZruShow(nFile / (1024 * 1024), " MB file");
+
+    std::vector<uint64_t> v;
+    run_file("ifstream read", nFile, [&](const uint64_t *&p, uint64_t &n)
+    {   std::ifstream f(sFile, std::ios::binary);
+        v.resize(nFile / sizeof(uint64_t));
+        if (!f.read((char*)v.data(), nFile))
+            return false;
+        p = v.data(), n = v.size();
+        return true;
+    });
+    v = std::vector<uint64_t>();
+
+    zru::shrmem m;
+    run_file("map", nFile, [&](const uint64_t *&p, uint64_t &n)
+    {   if (!m.open_file(sFile, 0, zru::shrmem::eReadOnly))
+            return false;
+        p = (const uint64_t*)m.ptr(), n = m.size() / sizeof(uint64_t);
+        return true;
+    });
+
+    run_file("map, sequential", nFile, [&](const uint64_t *&p, uint64_t &n)
+    {   if (!m.open_file(sFile, 0, zru::shrmem::eReadOnly) || !m.advise(zru::shrmem::eAdviseSequential))
+            return false;
+        p = (const uint64_t*)m.ptr(), n = m.size() / sizeof(uint64_t);
+        return true;
+    });
+
+    opt = zru::shrmem::options();
+    opt.populate = true;
+    run_file("map, populate", nFile, [&](const uint64_t *&p, uint64_t &n)
+    {   if (!m.open_file(sFile, 0, zru::shrmem::eReadOnly, opt))
+            return false;
+        p = (const uint64_t*)m.ptr(), n = m.size() / sizeof(uint64_t);
+        return true;
+    });
+
+    m.close();
+    std::remove(sFile.c_str());
+
+    return 0;
+}
+
+}
@@ -0,0 +1,72 @@
+
+#include <thread>
+#include <atomic>
+
+#include "bench.h"
+
+namespace bench
+{
+
+int Bench_ShmMap(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long reps = 1000000 * scale;
+    const int nKeys = 1000;
+
+    zru::shm_map m;
+    if (!m.open("/zru-bench-shmmap", nKeys * 2))
+    {   ZruError("Can't open map");
+        return -1;
+    }
+
+    zru::property_bag_ts pb;
+    std::vector<zru::t_str> vKeys;
+    for (int i = 0; i < nKeys; i++)
+    {   vKeys.push_back("stats.counter" + std::to_string(i));
+        m.set(vKeys.back(), i);
+        pb.set(".", vKeys.back(), i);
+    }
+
+    // What another process sees, through its own mapping
+    zru::shm_map r;
+    r.open("/zru-bench-shmmap", nKeys * 2, false);
+
+    long n = 0, nSum = 0;
+    double t = time_it(reps, [&]() { nSum += pb.get(".", vKeys[n++ % nKeys]).val().toInt(); });
+    report("property_bag_ts get", reps, t);
+
+    zru::any v;
+    n = 0;
+    t = time_it(reps, [&]() { nSum += r.get(vKeys[n++ % nKeys], v); });
+    report("shm_map get", reps, t);
+
+    n = 0;
+    t = time_it(reps, [&]() { m.set(vKeys[n % nKeys], n); n++; });
+    report("shm_map set", reps, t);
+
+    // Reads while another thread keeps writing
+    std::atomic<bool> bRun(true);
+    std::thread tw([&]()
+    {   for (long i = 0; bRun; i++)
+            m.set(vKeys[i % nKeys], i);
+    });
+    n = 0;
+    t = time_it(reps, [&]() { nSum += r.get(vKeys[n++ % nKeys], v); });
+    bRun = false;
+    tw.join();
+    report("shm_map get, writer busy", reps, t);
+
+    // Mirroring the way it was done before, encode the bag and parse it again
+    const long nMirror = 100 * scale;
+    zru::property_bag pbAll = pb.get(".", "");
+    t = time_it(nMirror, [&]()
+    {   zru::property_bag p = zru::parsers::json_parse(zru::parsers::json_encode(pbAll));
+        nSum += p["stats"]["counter7"].val().toInt();
+    });
+    report("json mirror of all keys", nMirror, t);
+    ZruShow("    ", (long)(t * 1e9 / nMirror / nKeys), " ns per key", nSum ? "" : " ");
+
+    return 0;
+}
+
+}
@@ -0,0 +1,71 @@
+
+#include <thread>
+
+#include "bench.h"
+
+namespace bench
+{
+
+/// Sets the spin limit, the portable version doesn't spin
+inline void spin(zru::signal_cv &, int) {}
+
+#if defined(__linux__)
+inline void spin(zru::signal &s, int nSpin) { s.set_spin(nSpin); }
+#endif
+
+/// Two threads hand a token back and forth nRounds times
+template<typename S>
+    void run_pingpong(const zru::t_str &sName, long nRounds, int nSpin = -1)
+    {
+        S ping, pong;
+        spin(ping, nSpin);
+        spin(pong, nSpin);
+
+        auto t = t_clock::now();
+
+        std::thread th([&]()
+        {
+            for (long i = 0; i < nRounds; i++)
+            {   while (!ping.wait_ms(1000))
+                    ;
+                ping.reset();
+                pong.signal_one();
+            }
+        });
+
+        for (long i = 0; i < nRounds; i++)
+        {   ping.signal_one();
+            while (!pong.wait_ms(1000))
+                ;
+            pong.reset();
+        }
+
+        th.join();
+
+        double secs = elapsed(t);
+        report(sName, nRounds, secs);
+
+        std::stringstream ss;
+        ss << "    " << std::fixed << std::setprecision(2) << secs / nRounds * 1000000 << " us per round trip";
+        ZruShow(ss.str());
+    }
+
+int Bench_Signal(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long nRounds = 50000 * scale;
+
+    ZruShow("hardware threads : ", std::thread::hardware_concurrency());
+
+    run_pingpong<zru::signal_cv>("signal_cv ping-pong", nRounds);
+
+#if defined(__linux__)
+    run_pingpong<zru::signal>("signal ping-pong", nRounds);
+    run_pingpong<zru::signal>("signal ping-pong, no spin", nRounds, 0);
+    run_pingpong<zru::signal>("signal ping-pong, spin 4000", nRounds, 4000);
+#endif
+
+    return 0;
+}
+
+}
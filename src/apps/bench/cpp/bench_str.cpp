@@ -0,0 +1,61 @@
+
+#include "bench.h"
+
+namespace bench
+{
+
+int Bench_Str(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long reps = 200 * scale;
+
+    // Runs of white space and of digits, typical of padded data
+    zru::t_str sData;
+    for (int i = 0; i < 4096; i++)
+        sData += zru::t_str(i % 61, ' ') + "\t\r\n" + zru::t_str(i % 23, '7') + "x";
+    double bytes = (double)sData.length() * reps;
+
+    const zru::t_str sWhiteSpace = " \t\r\n";
+    const zru::t_str sNumber = "+-.0123456789";
+    const zru::str::char_class ccWhiteSpace(sWhiteSpace);
+    const zru::str::char_class ccNumber(sNumber);
+
+    // Alternately skips white space and numbers across the buffer
+    auto walk = [&](auto &ws, auto &num)
+    {
+        long n = 0;
+        for (long r = 0; r < reps; r++)
+        {
+            zru::t_str::size_type pos = 0;
+            while (zru::t_str::npos != zru::str::find_first_not_of(sData, ws, pos)
+                   && zru::t_str::npos != zru::str::find_first_not_of(sData, num, pos))
+                pos++, n++;
+        }
+        return n;
+    };
+
+    long n1 = 0, n2 = 0;
+    double t = time_it(1, [&]() { n1 = walk(sWhiteSpace, sNumber); });
+    report("find_first_not_of(t_str)", n1, t, bytes);
+
+    t = time_it(1, [&]() { n2 = walk(ccWhiteSpace, ccNumber); });
+    report("find_first_not_of(char_class)", n2, t, bytes);
+
+    if (n1 != n2)
+    {   ZruError("Results differ : ", n1, " != ", n2);
+        return -1;
+    }
+
+    // One long scan for a character that is not there
+    zru::t_str sLong(1024 * 1024, ' ');
+    zru::t_str::size_type pos = 0;
+    t = time_it(reps, [&]() { pos = 0; zru::str::find_first_not_of(sLong, sWhiteSpace, pos); });
+    report("long run (t_str)", reps, t, (double)sLong.length() * reps);
+
+    t = time_it(reps, [&]() { pos = 0; zru::str::find_first_not_of(sLong, ccWhiteSpace, pos); });
+    report("long run (char_class)", reps, t, (double)sLong.length() * reps);
+
+    return 0;
+}
+
+}
@@ -0,0 +1,97 @@
+
+#include <random>
+
+#include "bench.h"
+
+namespace bench
+{
+
+/// The usual alternative, timers ordered by due time
+class timer_map
+{
+public:
+
+    typedef std::multimap<uint64_t, zru::timer_wheel::pfn_Timer>::iterator t_id;
+
+    t_id add(zru::timer_wheel::pfn_Timer f, long lMs) { return m_m.emplace(m_now + lMs, std::move(f)); }
+
+    void remove(t_id id) { m_m.erase(id); }
+
+    std::size_t tick(long nMs)
+    {
+        std::size_t n = 0;
+        m_now += nMs;
+        while (m_m.size() && m_m.begin()->first <= m_now)
+        {   auto f = std::move(m_m.begin()->second);
+            m_m.erase(m_m.begin());
+            n++;
+            int r = f();
+            if (0 <= r)
+                m_m.emplace(m_now + r, std::move(f));
+        }
+        return n;
+    }
+
+private:
+
+    std::multimap<uint64_t, zru::timer_wheel::pfn_Timer>    m_m;
+    uint64_t                                                m_now = 0;
+};
+
+template<typename T>
+    void run_timers(const zru::t_str &sName, long nTimers, const std::vector<long> &vDelay)
+    {
+        T tw;
+        std::vector<decltype(tw.add(0, 0))> ids;
+        ids.reserve(nTimers);
+
+        auto t = t_clock::now();
+        for (long i = 0; i < nTimers; i++)
+            ids.push_back(tw.add([]() { return -1; }, vDelay[i]));
+        report(sName + " add", nTimers, elapsed(t));
+
+        t = t_clock::now();
+        for (long i = 0; i < nTimers; i += 2)
+            tw.remove(ids[i]);
+        report(sName + " remove", nTimers / 2, elapsed(t));
+
+        // One ms at a time, as a running wheel would
+        t = t_clock::now();
+        std::size_t n = 0;
+        for (long i = 0; i <= 60000; i++)
+            n += tw.tick(1);
+        report(sName + " expire", n, elapsed(t));
+
+        // Periodic timers that keep coming back
+        long nRuns = 0;
+        for (long i = 0; i < nTimers; i++)
+            tw.add([&nRuns, i]() { nRuns++; return 10 + i % 90; }, vDelay[i] % 100);
+        t = t_clock::now();
+        for (long i = 0; i < 1000; i++)
+            tw.tick(1);
+        report(sName + " periodic", nRuns, elapsed(t));
+    }
+
+struct manual_wheel : zru::timer_wheel
+{
+    manual_wheel() : zru::timer_wheel(false) {}
+};
+
+int Bench_Timer(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long nTimers = 100000 * scale;
+
+    // Spread over a minute
+    std::mt19937 rng(42);
+    std::vector<long> vDelay(nTimers);
+    for (auto &d : vDelay)
+        d = rng() % 60000;
+
+    run_timers<manual_wheel>("timer_wheel", nTimers, vDelay);
+    run_timers<timer_map>("multimap", nTimers, vDelay);
+
+    return 0;
+}
+
+}
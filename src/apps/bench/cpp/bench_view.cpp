@@ -0,0 +1,65 @@
+
+#include <thread>
+
+#include "bench.h"
+
+namespace bench
+{
+
+/// Config style reads with one write in every nWrite operations
+template<typename F>
+    double run_reads(zru::property_bag_ts &pb, int nThreads, long nOps, long nWrite, F read)
+    {
+        std::vector<std::thread> th;
+        auto t = t_clock::now();
+
+        for (int i = 0; i < nThreads; i++)
+            th.emplace_back([&]()
+            {
+                for (long n = nOps / nThreads; 0 < n; n--)
+                    if (n % nWrite)
+                        read();
+                    else
+                        pb.inc(".", "cfg.server.writes", 1);
+            });
+
+        for (auto &x : th)
+            x.join();
+
+        return elapsed(t);
+    }
+
+int Bench_View(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long nOps = 200000 * scale;
+
+    zru::property_bag_ts pb;
+    for (int i = 0; i < 20; i++)
+        pb.set(".", "cfg.server.opt" + std::to_string(i), "a typical configuration string value");
+
+    // Unrelated data in the same shard, views must not copy it
+    for (int i = 0; i < 20000; i++)
+        pb.set(".", "data.rec" + std::to_string(i), i);
+
+    for (int nThreads : { 1, 2, 4, 8 })
+        for (long nWrite : { 100, 10000 })
+        {
+            std::stringstream ss;
+            ss << nThreads << " threads, 1/" << nWrite << " writes";
+
+            double t = run_reads(pb, nThreads, nOps, nWrite, [&]()
+            {   return pb.get(".", "cfg.server")["opt7"].val().toString().length();
+            });
+            report("get()  " + ss.str(), nOps, t);
+
+            t = run_reads(pb, nThreads, nOps, nWrite, [&]()
+            {   return (*pb.view(".", "cfg.server"))["opt7"].val().toString().length();
+            });
+            report("view() " + ss.str(), nOps, t);
+        }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,37 @@
+
+#include "bench.h"
+
+namespace bench
+{
+
+int Bench_Waits(const zru::property_bag &pbCl)
+{
+    long scale = pbCl.isset("size") ? pbCl.find("size")->second.val().toLong() : 1;
+    const long reps = 200000 * scale;
+
+    for (int nWaits : { 0, 1, 1000 })
+    {
+        zru::property_bag_ts pbs;
+
+        // One wait on the key itself, or a lot on keys that never change
+        zru::property_bag_ts::t_strlist keys;
+        if (1 == nWaits)
+            keys.push_back("data.k");
+        else
+            for (int i = 0; i < nWaits; i++)
+                keys.push_back("w" + std::to_string(i % 10) + ".k" + std::to_string(i));
+        if (keys.size())
+            pbs.add_named_wait_multiple("bench", ".", keys);
+
+        std::stringstream ss;
+        ss << "set() with " << nWaits << " waits";
+        long i = 0;
+        alloc_it(ss.str(), reps, [&]() { pbs.set(".", "data.k", i++); });
+
+        pbs.remove_all_named_waits();
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,141 @@
+
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+
+#include "bench.h"
+
+// Counts heap allocations for the benchmarks
+static std::atomic<long> g_nAllocs(0);
+
+// GCC inlines free() into code that called new and flags the pair,
+// but every new and delete here go through the two functions below
+#if defined(__GNUC__) && !defined(__clang__) && 11 <= __GNUC__
+#   pragma GCC diagnostic push
+#   pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// Every form goes through these two, so any delete matches any new
+static void* bench_alloc(std::size_t n, std::size_t a = 0) noexcept
+{
+    g_nAllocs++;
+    if (!n)
+        n = 1;
+#if defined(_WIN32)
+    return _aligned_malloc(n, a ? a : alignof(std::max_align_t));
+#else
+    void *p = 0;
+    if (a)
+        return posix_memalign(&p, a, n) ? 0 : p;
+    return std::malloc(n);
+#endif
+}
+
+static void bench_free(void *p) noexcept
+{
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+static void* bench_new(std::size_t n, std::size_t a = 0)
+{
+    if (void *p = bench_alloc(n, a))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t n) { return bench_new(n); }
+void* operator new[](std::size_t n) { return bench_new(n); }
+void* operator new(std::size_t n, std::align_val_t a) { return bench_new(n, (std::size_t)a); }
+void* operator new[](std::size_t n, std::align_val_t a) { return bench_new(n, (std::size_t)a); }
+
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept { return bench_alloc(n); }
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept { return bench_alloc(n); }
+void* operator new(std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return bench_alloc(n, (std::size_t)a); }
+void* operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return bench_alloc(n, (std::size_t)a); }
+
+void operator delete(void *p) noexcept { bench_free(p); }
+void operator delete[](void *p) noexcept { bench_free(p); }
+void operator delete(void *p, std::size_t) noexcept { bench_free(p); }
+void operator delete[](void *p, std::size_t) noexcept { bench_free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { bench_free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { bench_free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { bench_free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { bench_free(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept { bench_free(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept { bench_free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept { bench_free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept { bench_free(p); }
+
+#if defined(__GNUC__) && !defined(__clang__) && 11 <= __GNUC__
+#   pragma GCC diagnostic pop
+#endif
+
+long bench::allocs()
+{
+    return g_nAllocs;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *pUsage = "USAGE : bench [--only|-o benchmark-name]"
+                         "\n              [--size|-z scale-factor]"
+                         ;
+
+    // Read command line
+    auto pbCl = zru::parsers::parse_command_line<zru::t_str>(argc, argv);
+    pbCl.map_keys({ {"version", "v"},
+                    {"help", "h"},
+                    {"only", "o"},
+                    {"size", "z"}
+                  });
+
+    // Version string?
+    if (pbCl.isset("version"))
+    {   std::cout << APPVER << " [" << APPBUILD << "]" << std::endl;
+        return 0;
+    }
+
+    if (pbCl.isset("help"))
+    {   ZruShow(pUsage);
+        return 0;
+    }
+
+    const struct { const char *name; int (*fn)(const zru::property_bag &); } benchmarks[] =
+        {
+            { "json",   bench::Bench_Json },
+            { "str",    bench::Bench_Str },
+            { "any",    bench::Bench_Any },
+            { "map",    bench::Bench_Map },
+            { "queue",  bench::Bench_Queue },
+            { "shards", bench::Bench_Shards },
+            { "view",   bench::Bench_View },
+            { "path",   bench::Bench_Path },
+            { "waits",  bench::Bench_Waits },
+            { "signal", bench::Bench_Signal },
+            { "pool",   bench::Bench_Pool },
+            { "timer",  bench::Bench_Timer },
+            { "coro",   bench::Bench_Coro },
+            { "ring",   bench::Bench_Ring },
+            { "shm",    bench::Bench_Shm },
+            { "arena",  bench::Bench_Arena },
+            { "shmmap", bench::Bench_ShmMap },
+        };
+
+    zru::t_str sOnly = pbCl["only"].val().toString();
+    for (auto &b : benchmarks)
+        if (!sOnly.length() || sOnly == b.name)
+        {
+            ZruShow("\n--- ", b.name, " ---");
+            if (int r = b.fn(pbCl))
+                return r;
+        }
+
+    return 0;
+}
@@ -35,33 +35,54 @@
 namespace zru
 {
 
+// Shards in the global property bag
+#if !defined(ZRU_PB_SHARDS)
+#   define ZRU_PB_SHARDS 1
+#endif
+
 // Global property bag
-property_bag_ts     pb;
+property_bag_ts     pb(ZRU_PB_SHARDS);
+
+// Most empty elements an index may skip before an array turns into a map
+static const property_bag::t_size g_nMaxGap = 1024;
 
 
-property_bag::property_bag() : m_i(0), m_bArray(false)
+property_bag::property_bag() : m_i(0), m_bArray(false), m_h(0)
 {
 }
 
-property_bag::property_bag(const t_any &r) : m_i(0), m_bArray(false)
+property_bag::property_bag(const t_any &r) : m_i(0), m_bArray(false), m_h(0)
 {
     m_v = r;
 }
 
-property_bag::property_bag(const property_bag &r) : m_i(0), m_bArray(false)
+property_bag::property_bag(const property_bag &r) : m_i(0), m_bArray(false), m_h(0)
 {
     *this = r;
 }
 
+property_bag::property_bag(property_bag &&r) noexcept
+    : m_v(std::move(r.m_v)), m_i(r.m_i), m_m(std::move(r.m_m)), m_bArray(r.m_bArray),
+      m_a(std::move(r.m_a)), m_h(r.m_h)
+{
+    r.m_i = 0;
+    r.m_bArray = false;
+    r.m_h = 0;
+}
+
+property_bag::property_bag(t_any &&r) : m_v(std::move(r)), m_i(0), m_bArray(false), m_h(0)
+{
+}
+
 property_bag::property_bag(std::initializer_list<std::pair<t_str, t_any> > a)
-     : m_i(0), m_bArray(false)
+     : m_i(0), m_bArray(false), m_h(0)
 {
     for(auto it = std::begin(a); std::end(a) != it; it++)
         m_m[it->first] = it->second;
 }
 
 // property_bag::property_bag(std::initializer_list<std::pair<t_str, property_bag> > a)
-//       : m_i(0), m_bArray(false)
+//       : m_i(0), m_bArray(false), m_h(0)
 // {
 //     for(auto it = std::begin(a); std::end(a) != it; it++)
 //         m_m[it->first] = it->second;
@@ -73,14 +94,48 @@ property_bag& property_bag::operator = (const property_bag &r)
     m_v = r.m_v;
     m_m = r.m_m;
     m_bArray = r.m_bArray;
+    m_a = r.m_a;
+    m_h = r.m_h;
     return *this;
 }
 
+property_bag& property_bag::operator = (property_bag &&r) noexcept
+{
+    // r may be one of our children
+    property_bag t(std::move(r));
+    swap(t);
+
+    return *this;
+}
+
+void property_bag::swap(property_bag &r) noexcept
+{
+    m_v.swap(r.m_v);
+    m_m.swap(r.m_m);
+    std::swap(m_i, r.m_i);
+    std::swap(m_bArray, r.m_bArray);
+    m_a.swap(r.m_a);
+    std::swap(m_h, r.m_h);
+}
+
 property_bag& property_bag::operator = (const t_any &r)
 {
     m_i = 0;
     m_v = r;
     m_m.clear();
+    m_a.clear();
+    m_h = 0;
+
+    return *this;
+}
+
+property_bag& property_bag::operator = (t_any &&r)
+{
+    m_i = 0;
+    m_v = std::move(r);
+    m_m.clear();
+    m_a.clear();
+    m_h = 0;
 
     return *this;
 }
@@ -112,7 +167,7 @@ const property_bag::t_any& property_bag::val() const
 
 int property_bag::size() const
 {
-    return m_m.size();
+    return m_bArray ? m_a.size() - m_h : m_m.size();
 }
 
 int property_bag::length() const
@@ -125,8 +180,8 @@ int property_bag::length(const t_str &k) const
     if (!k.length())
         return 0;
 
-    property_bag::const_iterator it = m_m.find(k);
-    if (m_m.end() == it)
+    property_bag::const_iterator it = find(k);
+    if (end() == it)
         return 0;
 
     return it->second.length();
@@ -159,6 +214,10 @@ int property_bag::length(const t_str &sep, const t_str &k)
 
 bool property_bag::isset(const any &k) const
 {
+    t_size i;
+    if (m_bArray && _index(k, i))
+        return i < size() && _arr()[i].isset();
+
     t_str s = k.toString();
     if (!s.length())
         return false;
@@ -176,8 +235,8 @@ bool property_bag::issetStr(const t_str &k) const
     if (!k.length())
         return false;
 
-    t_map::const_iterator it = m_m.find(k);
-    if (m_m.end() == it)
+    const_iterator it = find(k);
+    if (end() == it)
         return false;
 
     return it->second.isset();
@@ -225,17 +284,353 @@ bool property_bag::isset(const t_str &sSep, std::initializer_list< t_str > a)
 
 property_bag& property_bag::operator[](const t_any &k)
 {
+    if (m_bArray)
+    {
+        t_size i;
+        if (_index(k, i) && _grow(i))
+            return _arr()[i];
+
+        // Not an index, or too far past the end, this is a map now
+        setArray(false);
+    }
+
     return m_m[k.toString()];
 }
 
+const property_bag& property_bag::operator[](const t_any &k) const
+{
+    static const property_bag empty;
+
+    const_iterator it = find(k);
+
+    return end() != it ? it->second : empty;
+}
+
 property_bag::const_iterator property_bag::find(const t_any &k) const
 {
-    return m_m.find(k.toString());
+    if (!m_bArray)
+        return m_m.find(k.toString());
+
+    t_size i;
+    if (!_index(k, i) || i >= size())
+        return end();
+
+    return const_iterator(_arr() + i, i);
 }
 
 property_bag::iterator property_bag::find(const t_any &k)
 {
-    return m_m.find(k.toString());
+    if (!m_bArray)
+        return m_m.find(k.toString());
+
+    t_size i;
+    if (!_index(k, i) || i >= size())
+        return end();
+
+    return iterator(_arr() + i, i);
+}
+
+property_bag::iterator property_bag::begin()
+{
+    if (!m_bArray || !size())
+        return m_m.begin();
+    return iterator(_arr(), 0);
+}
+
+property_bag::const_iterator property_bag::begin() const
+{
+    if (!m_bArray || !size())
+        return m_m.begin();
+    return const_iterator(_arr(), 0);
+}
+
+property_bag::iterator property_bag::end()
+{
+    if (!m_bArray || !size())
+        return m_m.end();
+    return iterator(_arr() + size(), size());
+}
+
+property_bag::const_iterator property_bag::end() const
+{
+    if (!m_bArray || !size())
+        return m_m.end();
+    return const_iterator(_arr() + size(), size());
+}
+
+property_bag::iterator property_bag::erase(iterator it)
+{
+    if (!it.m_p)
+        return m_m.erase(it.m_it);
+
+    // Popping from the front just moves the head
+    t_size i = it.m_p - _arr();
+    if (!i)
+    {
+        m_a[m_h++] = property_bag();
+        if (m_h == (t_size)m_a.size())
+            m_a.clear(), m_h = 0;
+        else if (16 <= m_h && m_h * 2 >= (t_size)m_a.size())
+            m_a.erase(m_a.begin(), m_a.begin() + m_h), m_h = 0;
+        return begin();
+    }
+
+    m_a.erase(m_a.begin() + m_h + i);
+
+    return i < size() ? iterator(_arr() + i, i) : end();
+}
+
+void property_bag::setArray(bool b)
+{
+    if (b == m_bArray)
+        return;
+
+    // An index far past the rest would need a huge array, stay a map
+    if (b)
+    {   t_size i;
+        for (auto it = m_m.begin(); m_m.end() != it; it++)
+            if (_index(it->first, i) && i > (t_size)m_m.size() + g_nMaxGap)
+                return;
+    }
+
+    m_bArray = b;
+
+    // Numeric keys go to their index, then anything else after the last one
+    if (b)
+    {
+        t_map m;
+        m.swap(m_m);
+        t_size i;
+        for (auto it = m.begin(); m.end() != it; it++)
+            if (_index(it->first, i))
+            {   if (i >= size())
+                    m_a.resize(m_h + i + 1);
+                _arr()[i] = std::move(it->second);
+            }
+        for (auto it = m.begin(); m.end() != it; it++)
+            if (!_index(it->first, i))
+                m_a.push_back(std::move(it->second));
+    }
+
+    // Array elements keyed by index
+    else
+    {
+        t_array a;
+        a.swap(m_a);
+        for (t_size i = m_h; i < (t_size)a.size(); i++)
+            m_m[std::to_string(i - m_h)] = std::move(a[i]);
+
+        // push() carries on after the last index
+        m_i = (t_size)a.size() - m_h;
+        m_h = 0;
+    }
+}
+
+bool property_bag::_grow(t_size i)
+{
+    if (i < size())
+        return true;
+
+    if (i > size() + g_nMaxGap)
+        return false;
+
+    m_a.resize(m_h + i + 1);
+    return true;
+}
+
+const t_str& property_bag::index_key(t_size i)
+{
+    // A deque doesn't move its strings as it grows
+    static std::shared_mutex mtx;
+    static std::deque<t_str> keys;
+
+    {   std::shared_lock<std::shared_mutex> l(mtx);
+        if (i < (t_size)keys.size())
+            return keys[i];
+    }
+
+    std::unique_lock<std::shared_mutex> l(mtx);
+    while ((t_size)keys.size() <= i)
+        keys.push_back(std::to_string(keys.size()));
+    return keys[i];
+}
+
+bool property_bag::_index(const t_any &k, t_size &i)
+{
+    if (k.isType({ any::at_size, any::at_int, any::at_uint, any::at_long,
+                   any::at_ulong, any::at_longlong, any::at_ulonglong }))
+    {
+        long long v = k.toLongLong();
+        i = (t_size)v;
+        return 0 <= v;
+    }
+
+    if (!k.isType({ any::at_string, any::at_wstring }))
+        return false;
+
+    // Digits only, "01" stays a key so it can round trip
+    t_str s = k.toString();
+    if (!s.length() || 18 < s.length() || (1 < s.length() && '0' == s[0]))
+        return false;
+
+    i = 0;
+    for (auto ch : s)
+        if ('0' > ch || '9' < ch)
+            return false;
+        else
+            i = i * 10 + (ch - '0');
+
+    return true;
+}
+
+const property_bag* property_bag::lookup(const t_str &sep, const t_str &k) const
+{
+    if (!sep.length())
+    {   if (!k.length())
+            return this;
+        const_iterator it = find(k);
+        return end() != it ? &it->second : 0;
+    }
+
+    // Like at(), empty keys are skipped
+    const property_bag *p = this;
+    for (t_str::size_type b = 0; p && b < k.length();)
+    {
+        t_str::size_type e = k.find(sep, b);
+        if (t_str::npos == e)
+            e = k.length();
+
+        if (e > b)
+        {   const_iterator it = p->find(k.substr(b, e - b));
+            p = p->end() != it ? &it->second : 0;
+        }
+
+        b = e + sep.length();
+    }
+
+    return p;
+}
+
+void property_bag::path::set(const t_str &sep, const t_str &k)
+{
+    m_sep = sep;
+    m_key = k;
+    m_seg.clear();
+    m_hash.clear();
+    m_idx.clear();
+
+    for (t_str::size_type b = 0; b < k.length();)
+    {
+        t_str::size_type e = sep.length() ? k.find(sep, b) : t_str::npos;
+        if (t_str::npos == e)
+            e = k.length();
+
+        if (e > b)
+        {
+            m_seg.push_back(k.substr(b, e - b));
+            m_hash.push_back(std::hash<t_str>()(m_seg.back()));
+
+            t_size i;
+            m_idx.push_back(_index(m_seg.back(), i) ? i : -1);
+        }
+
+        b = e + sep.length();
+    }
+}
+
+property_bag& property_bag::_child(const path &p, std::size_t i)
+{
+    if (m_bArray)
+    {
+        t_size n = p.index(i);
+        if (0 <= n && _grow(n))
+            return _arr()[n];
+
+        // Not an index, or too far past the end, this is a map now
+        setArray(false);
+    }
+
+#if defined(ZRU_PROPERTY_BAG_FLAT)
+    return m_m.at(p[i], p.hash(i));
+#else
+    return m_m[p[i]];
+#endif
+}
+
+const property_bag* property_bag::_find(const path &p, std::size_t i) const
+{
+    if (m_bArray)
+    {   t_size n = p.index(i);
+        return (0 <= n && n < size()) ? _arr() + n : 0;
+    }
+
+#if defined(ZRU_PROPERTY_BAG_FLAT)
+    t_map::const_iterator it = m_m.find(p[i], p.hash(i));
+#else
+    t_map::const_iterator it = m_m.find(p[i]);
+#endif
+
+    return m_m.end() != it ? &it->second : 0;
+}
+
+property_bag& property_bag::at(const path &p)
+{
+    property_bag *r = this;
+    for (std::size_t i = 0; i < p.size(); i++)
+        r = &r->_child(p, i);
+
+    return *r;
+}
+
+const property_bag* property_bag::lookup(const path &p) const
+{
+    const property_bag *r = this;
+    for (std::size_t i = 0; r && i < p.size(); i++)
+        r = r->_find(p, i);
+
+    return r;
+}
+
+bool property_bag::isset(const path &p) const
+{
+    if (!p.size())
+        return false;
+
+    const property_bag *r = lookup(p);
+
+    return r && r->isset();
+}
+
+int property_bag::length(const path &p) const
+{
+    if (!p.size())
+        return 0;
+
+    const property_bag *r = lookup(p);
+
+    return r ? r->length() : 0;
+}
+
+bool property_bag::erase(const path &p)
+{
+    if (!p.size())
+        return false;
+
+    // Walk to the parent without creating anything
+    property_bag *r = this;
+    for (std::size_t i = 0; r && i + 1 < p.size(); i++)
+        r = r->_find(p, i);
+
+    property_bag *c = r ? r->_find(p, p.size() - 1) : 0;
+    if (!c)
+        return false;
+
+    if (r->m_bArray)
+        r->erase(iterator(c, c - r->_arr()));
+    else
+        r->m_m.erase(p[p.size() - 1]);
+
+    return true;
 }
 
 property_bag& property_bag::at(const t_str &sep, const t_str &k)
@@ -268,8 +663,8 @@ bool property_bag::erase(const t_str &k)
     if (!k.length())
         return false;
 
-    t_map::iterator it = m_m.find(k);
-    if (m_m.end() == it)
+    iterator it = find(k);
+    if (end() == it)
         return false;
 
     erase(it);
@@ -306,8 +701,8 @@ bool property_bag::apply(const t_str &k, tf_apply f)
     if (!k.length())
         return false;
 
-    t_map::iterator it = m_m.find(k);
-    if (m_m.end() == it)
+    iterator it = find(k);
+    if (end() == it)
         return false;
 
     return it->second.apply(f);
@@ -373,23 +768,64 @@ bool property_bag::each(pfn_EachV f)
 
 property_bag::t_size property_bag::push(const property_bag &pb)
 {
+    if (!m_bArray && !m_m.size())
+        m_bArray = true;
+
+    if (m_bArray)
+    {   m_a.push_back(pb);
+        return size() - 1;
+    }
+
     (*this)[t_any(m_i).toString()] = pb;
     return m_i++;
 }
 
 property_bag::t_size property_bag::push(const t_any &v)
 {
+    if (!m_bArray && !m_m.size())
+        m_bArray = true;
+
+    if (m_bArray)
+    {   m_a.emplace_back(v);
+        return size() - 1;
+    }
+
     (*this)[t_any(m_i).toString()] = v;
     return m_i++;
 }
 
+property_bag::t_size property_bag::push(property_bag &&pb)
+{
+    if (!m_bArray && !m_m.size())
+        m_bArray = true;
+
+    if (m_bArray)
+    {   m_a.push_back(std::move(pb));
+        return size() - 1;
+    }
+
+    (*this)[t_any(m_i).toString()] = std::move(pb);
+    return m_i++;
+}
+
 property_bag property_bag::pop()
 {
-    iterator it = m_m.begin();
+    if (m_bArray)
+    {
+        if (!size())
+            return property_bag();
+
+        property_bag ret = std::move(m_a[m_h]);
+        erase(begin());
+
+        return ret;
+    }
+
+    t_map::iterator it = m_m.begin();
     if (m_m.end() == it)
         return property_bag();
 
-    property_bag ret = it->second;
+    property_bag ret = std::move(it->second);
 
     m_m.erase(it);
 
@@ -399,13 +835,23 @@ property_bag property_bag::pop()
 property_bag property_bag::pop(long n)
 {
     property_bag ret;
+    if (m_bArray)
+    {
+        ret.setArray(true);
+        while (0 <= --n && size())
+        {   ret.m_a.push_back(std::move(m_a[m_h]));
+            erase(begin());
+        }
+        return ret;
+    }
+
     while (0 <= --n)
     {
-        iterator it = m_m.begin();
+        t_map::iterator it = m_m.begin();
         if (m_m.end() == it)
             break;
 
-        ret[it->first] = it->second;
+        ret[it->first] = std::move(it->second);
 
         m_m.erase(it);
     }
@@ -413,11 +859,35 @@ property_bag property_bag::pop(long n)
     return ret;
 }
 
+property_bag::t_size property_bag::pop(std::vector<property_bag> &v, long n)
+{
+    t_size c = 0;
+    if (m_bArray)
+    {
+        for (; c < n && size(); c++)
+        {   v.push_back(std::move(m_a[m_h]));
+            erase(begin());
+        }
+        return c;
+    }
+
+    for (; c < n && m_m.size(); c++)
+    {
+        t_map::iterator it = m_m.begin();
+        v.push_back(std::move(it->second));
+        m_m.erase(it);
+    }
+
+    return c;
+}
+
 property_bag::t_size property_bag::merge(const property_bag &pb, bool bOverwrite)
 {
     t_size n = 1;
     m_v = pb.m_v;
-    for (t_map::const_iterator it = pb.m_m.begin(); pb.m_m.end() != it; it++)
+    if (pb.m_bArray && !size())
+        setArray(true);
+    for (const_iterator it = pb.begin(); pb.end() != it; it++)
         if (bOverwrite || !isset(it->first))
             (*this)[it->first].merge(it->second, bOverwrite);
 
@@ -428,19 +898,26 @@ property_bag::t_size property_bag::map_keys(const property_bag &keys, property_b
 {
     t_size n = 1;
     m_v = pb.m_v;
-    for (auto it = keys.m_m.begin(); keys.m_m.end() != it; it++)
+    for (auto it = keys.begin(); keys.end() != it; it++)
     {
         bool bFirst = isset(it->first);
         bool bSecond = pb.isset(it->second.val().toString());
 
+        // Copy first, pb may be this bag and inserting can move its values
         if (!bFirst && bSecond)
-            (*this)[it->first] = pb[it->second.val()];
+        {   property_bag v = pb[it->second.val()];
+            (*this)[it->first] = std::move(v);
+        }
 
         else if (bFirst && bSecond && bOverwrite)
-            (*this)[it->first] = pb[it->second.val()];
+        {   property_bag v = pb[it->second.val()];
+            (*this)[it->first] = std::move(v);
+        }
 
         else if (bFirst && !bSecond && bBidirectional)
-            pb[it->second.val()] = (*this)[it->first];
+        {   property_bag v = (*this)[it->first];
+            pb[it->second.val()] = std::move(v);
+        }
     }
 
     return n;
@@ -448,90 +925,154 @@ property_bag::t_size property_bag::map_keys(const property_bag &keys, property_b
 
 int property_bag_ts::size(const string &sSep, const string &sKey)
 {
-    t_scopelock lk(m_mLock);
+    // The root is spread across the shards
+    if (1 < m_shards.size() && _isroot(sSep, sKey))
+    {   int n = 0;
+        for (auto &sh : m_shards)
+        {   t_readlock lk(sh->lock);
+            n += sh->pb.size();
+        }
+        return n;
+    }
+
+    pb_shard &s = _shard(sSep, sKey);
+    t_readlock lk(s.lock);
 
-    return m_pb.at(sSep, sKey).size();
+    const property_bag *p = s.pb.lookup(sSep, sKey);
+
+    return p ? p->size() : 0;
 }
 
 int property_bag_ts::length(const string &sSep, const string &sKey)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_readlock lk(s.lock);
+
+    const property_bag *p = s.pb.lookup(sSep, sKey);
 
-    return m_pb.at(sSep, sKey).val().toString().length();
+    return p ? p->val().toString().length() : 0;
 }
 
 bool property_bag_ts::set(const string &sSep, const string &sKey, const property_bag &pbVal)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    m_pb.at(sSep, sKey) = pbVal;
+    s.pb.at(sSep, sKey) = pbVal;
 
-    _sig(sSep, sKey);
+    _sig(s, sSep, sKey);
 
     return true;
 }
 
 bool property_bag_ts::set(const string &sSep, const string &sKey, const property_bag::t_any &vVal)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
     if (vVal.isVoid())
-        m_pb.erase(sSep, sKey);
+        s.pb.erase(sSep, sKey);
     else
-        m_pb.at(sSep, sKey) = vVal;
+        s.pb.at(sSep, sKey) = vVal;
 
-    _sig(sSep, sKey);
+    _sig(s, sSep, sKey);
 
     return true;
 }
 
 property_bag property_bag_ts::get(const string &sSep, const string &sKey)
 {
-    std::unique_lock<std::mutex> lk(m_mLock);
+    // The root is spread across the shards
+    if (1 < m_shards.size() && _isroot(sSep, sKey))
+    {   property_bag pb;
+        for (auto &sh : m_shards)
+        {   t_readlock lk(sh->lock);
+            pb.merge(sh->pb);
+        }
+        return pb;
+    }
+
+    pb_shard &s = _shard(sSep, sKey);
+    t_readlock lk(s.lock);
+
+    const property_bag *p = s.pb.lookup(sSep, sKey);
+
+    return p ? *p : property_bag();
+}
+
+property_bag_ts::t_pbview property_bag_ts::view(const string &sSep, const string &sKey)
+{
+    // The root is spread across the shards
+    if (1 < m_shards.size() && _isroot(sSep, sKey))
+        return std::make_shared<const property_bag>(get(sSep, sKey));
 
-    return m_pb.at(sSep, sKey);
+    return _view(_shard(sSep, sKey), sSep + '\n' + sKey,
+                 [&](const property_bag &pb) { return pb.lookup(sSep, sKey); });
 }
 
 bool property_bag_ts::inc(const string &sSep, const string &sKey, const property_bag::t_any &v)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    m_pb.at(sSep, sKey) += v;
+    s.pb.at(sSep, sKey) += v;
 
-    _sig(sSep, sKey);
+    _sig(s, sSep, sKey);
 
     return true;
 }
 
 bool property_bag_ts::dec(const string &sSep, const string &sKey, const property_bag::t_any &v)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    m_pb.at(sSep, sKey) += v;
+    s.pb.at(sSep, sKey) -= v;
 
-    _sig(sSep, sKey);
+    _sig(s, sSep, sKey);
 
     return true;
 }
 
 bool property_bag_ts::merge(const string &sSep, const string &sKey, const property_bag &pbValue, bool bOverwrite)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    m_pb.at(sSep, sKey).merge(pbValue, bOverwrite);
+    s.pb.at(sSep, sKey).merge(pbValue, bOverwrite);
 
-    _sig(sSep, sKey);
+    _sig(s, sSep, sKey);
 
     return true;
 }
 
 bool property_bag_ts::map_keys(const string &sSep, const string &sKey, const property_bag &keys, property_bag &pb, bool bOverwrite, bool bBidirectional)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    m_pb.at(sSep, sKey).map_keys(keys, pb, bOverwrite, bBidirectional);
+    s.pb.at(sSep, sKey).map_keys(keys, pb, bOverwrite, bBidirectional);
 
-    _sig(sSep, sKey);
+    _sig(s, sSep, sKey);
+
+    return true;
+}
+
+bool property_bag_ts::map_keys(const string &sSep, const string &sKey, const property_bag &keys, bool bOverwrite, bool bBidirectional)
+{
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    s.pb.at(sSep, sKey).map_keys(keys, s.pb, bOverwrite, bBidirectional);
+
+    _sig(s, sSep, sKey);
 
     return true;
 }
@@ -539,66 +1080,288 @@ bool property_bag_ts::map_keys(const string &sSep, const string &sKey, const pro
 
 bool property_bag_ts::isset(const string &sSep, const string &sKey)
 {
-    t_scopelock lk(m_mLock);
+    if (!sKey.length())
+        return false;
+
+    pb_shard &s = _shard(sSep, sKey);
+    t_readlock lk(s.lock);
 
-    return m_pb.isset(sSep, sKey);
+    const property_bag *p = s.pb.lookup(sSep, sKey);
+
+    return p && p->isset();
 }
 
 bool property_bag_ts::erase(const string &sSep, const string &sKey)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    if (!m_pb.erase(sSep, sKey))
+    if (!s.pb.erase(sSep, sKey))
         return false;
 
-    _sig(sSep, sKey);
+    _sig(s, sSep, sKey);
 
     return true;
 }
 
-property_bag::t_size property_bag_ts::push(const string &sSep, const string &sKey, const property_bag &pbValue, bool bSignalAll)
+int property_bag_ts::size(const property_bag::path &p)
 {
-    t_scopelock lk(m_mLock);
+    if (1 < m_shards.size() && !p.size())
+        return size(p.sep(), p.key());
 
-    property_bag::t_size ret = m_pb.at(sSep, sKey).push(pbValue);
+    pb_shard &s = _shard(p);
+    t_readlock lk(s.lock);
 
-    _sig(sSep, sKey, bSignalAll);
+    const property_bag *r = s.pb.lookup(p);
 
-    return ret;
+    return r ? r->size() : 0;
 }
 
-property_bag::t_size property_bag_ts::push(const string &sSep, const string &sKey, const property_bag::t_any &vValue, bool bSignalAll)
+int property_bag_ts::length(const property_bag::path &p)
+{
+    pb_shard &s = _shard(p);
+    t_readlock lk(s.lock);
+
+    return s.pb.length(p);
+}
+
+bool property_bag_ts::set(const property_bag::path &p, const property_bag &pbVal)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(p);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    property_bag::t_size ret = m_pb.at(sSep, sKey).push(vValue);
+    s.pb.at(p) = pbVal;
 
-    _sig(sSep, sKey, bSignalAll);
+    _sig(s, p);
 
-    return ret;
+    return true;
 }
 
-property_bag property_bag_ts::popn(const string &sSep, const string &sKey, property_bag::t_size n)
+bool property_bag_ts::set(const property_bag::path &p, const property_bag::t_any &vVal)
 {
-    t_scopelock lk(m_mLock);
-
-    property_bag &r = m_pb.at(sSep, sKey);
+    pb_shard &s = _shard(p);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    if (!r.size())
-        return property_bag();
+    if (vVal.isVoid())
+        s.pb.erase(p);
+    else
+        s.pb.at(p) = vVal;
 
-    property_bag ret = r.pop(n);
+    _sig(s, p);
 
-    return ret;
+    return true;
 }
 
-
-property_bag property_bag_ts::popn(const string &sSep, const string &sKey, property_bag::t_size n, property_bag::t_size uTimeout)
+property_bag property_bag_ts::get(const property_bag::path &p)
 {
-    t_scopelock lk(m_mLock);
+    if (1 < m_shards.size() && !p.size())
+        return get(p.sep(), p.key());
 
-    property_bag ret;
-    property_bag &r = m_pb.at(sSep, sKey);
+    pb_shard &s = _shard(p);
+    t_readlock lk(s.lock);
+
+    const property_bag *r = s.pb.lookup(p);
+
+    return r ? *r : property_bag();
+}
+
+property_bag_ts::t_pbview property_bag_ts::view(const property_bag::path &p)
+{
+    if (1 < m_shards.size() && !p.size())
+        return view(p.sep(), p.key());
+
+    return _view(_shard(p), p.sep() + '\n' + p.key(),
+                 [&](const property_bag &pb) { return pb.lookup(p); });
+}
+
+bool property_bag_ts::inc(const property_bag::path &p, const property_bag::t_any &v)
+{
+    pb_shard &s = _shard(p);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    s.pb.at(p) += v;
+
+    _sig(s, p);
+
+    return true;
+}
+
+bool property_bag_ts::dec(const property_bag::path &p, const property_bag::t_any &v)
+{
+    pb_shard &s = _shard(p);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    s.pb.at(p) -= v;
+
+    _sig(s, p);
+
+    return true;
+}
+
+bool property_bag_ts::isset(const property_bag::path &p)
+{
+    pb_shard &s = _shard(p);
+    t_readlock lk(s.lock);
+
+    return s.pb.isset(p);
+}
+
+bool property_bag_ts::erase(const property_bag::path &p)
+{
+    pb_shard &s = _shard(p);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    if (!s.pb.erase(p))
+        return false;
+
+    _sig(s, p);
+
+    return true;
+}
+
+property_bag::t_size property_bag_ts::push(const property_bag::path &p, const property_bag &pbValue, bool bSignalAll)
+{
+    pb_shard &s = _shard(p);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag::t_size ret = s.pb.at(p).push(pbValue);
+
+    _sig(s, p, bSignalAll);
+
+    return ret;
+}
+
+property_bag::t_size property_bag_ts::push(const property_bag::path &p, const property_bag::t_any &vValue, bool bSignalAll)
+{
+    pb_shard &s = _shard(p);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag::t_size ret = s.pb.at(p).push(vValue);
+
+    _sig(s, p, bSignalAll);
+
+    return ret;
+}
+
+property_bag::t_size property_bag_ts::popv(std::vector<property_bag> &v, const property_bag::path &p, property_bag::t_size n, property_bag::t_size uTimeout)
+{
+    pb_shard &s = _shard(p);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag *r = &s.pb.at(p);
+
+    if (!r->size())
+    {
+        if (!uTimeout)
+            return 0;
+
+        t_pbwptr pbw(new pb_waitable());
+
+        _wait(s, pbw, lk, p, uTimeout);
+
+        r = &s.pb.at(p);
+    }
+
+    return r->pop(v, n);
+}
+
+bool property_bag_ts::pop(property_bag &r, const property_bag::path &p, property_bag::t_size uTimeout)
+{
+    pb_shard &s = _shard(p);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag *q = &s.pb.at(p);
+
+    if (!q->size())
+    {
+        if (!uTimeout)
+            return false;
+
+        t_pbwptr pbw(new pb_waitable());
+
+        _wait(s, pbw, lk, p, uTimeout);
+
+        q = &s.pb.at(p);
+        if (!q->size())
+            return false;
+    }
+
+    r = q->pop();
+
+    return true;
+}
+
+bool property_bag_ts::wait(const property_bag::path &p, property_bag::t_size uTimeout)
+{
+    t_pbwptr pbw(new pb_waitable());
+
+    pb_shard &s = _shard(p);
+    t_writelock lk(s.lock);
+
+    return _wait(s, pbw, lk, p, uTimeout);
+}
+
+property_bag::t_size property_bag_ts::push(const string &sSep, const string &sKey, const property_bag &pbValue, bool bSignalAll)
+{
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag::t_size ret = s.pb.at(sSep, sKey).push(pbValue);
+
+    _sig(s, sSep, sKey, bSignalAll);
+
+    return ret;
+}
+
+property_bag::t_size property_bag_ts::push(const string &sSep, const string &sKey, const property_bag::t_any &vValue, bool bSignalAll)
+{
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag::t_size ret = s.pb.at(sSep, sKey).push(vValue);
+
+    _sig(s, sSep, sKey, bSignalAll);
+
+    return ret;
+}
+
+property_bag property_bag_ts::popn(const string &sSep, const string &sKey, property_bag::t_size n)
+{
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag &r = s.pb.at(sSep, sKey);
+
+    if (!r.size())
+        return property_bag();
+
+    property_bag ret = r.pop(n);
+
+    return ret;
+}
+
+
+property_bag property_bag_ts::popn(const string &sSep, const string &sKey, property_bag::t_size n, property_bag::t_size uTimeout)
+{
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag ret;
+    property_bag &r = s.pb.at(sSep, sKey);
 
     if (r.size())
         ret = r.pop(n);
@@ -608,13 +1371,11 @@ property_bag property_bag_ts::popn(const string &sSep, const string &sKey, prope
 
     else
     {
-        string key(sSep + sKey);
-
         t_pbwptr pbw(new pb_waitable());
 
-        _wait(pbw, lk, key, uTimeout);
+        _wait(s, pbw, lk, sSep, sKey, uTimeout);
 
-        property_bag &r = m_pb.at(sSep, sKey);
+        property_bag &r = s.pb.at(sSep, sKey);
 
         if (!r.size())
             return ret;
@@ -627,9 +1388,11 @@ property_bag property_bag_ts::popn(const string &sSep, const string &sKey, prope
 
 property_bag property_bag_ts::pop(const string &sSep, const string &sKey)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    property_bag &r = m_pb.at(sSep, sKey);
+    property_bag &r = s.pb.at(sSep, sKey);
 
     if (!r.size())
         return property_bag();
@@ -641,10 +1404,12 @@ property_bag property_bag_ts::pop(const string &sSep, const string &sKey)
 
 property_bag property_bag_ts::pop(const string &sSep, const string &sKey, property_bag::t_size uTimeout)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
     property_bag ret;
-    property_bag &r = m_pb.at(sSep, sKey);
+    property_bag &r = s.pb.at(sSep, sKey);
 
     if (r.size())
         ret = r.pop();
@@ -654,13 +1419,11 @@ property_bag property_bag_ts::pop(const string &sSep, const string &sKey, proper
 
     else
     {
-        string key(sSep + sKey);
-
         t_pbwptr pbw(new pb_waitable());
 
-        _wait(pbw, lk, key, uTimeout);
+        _wait(s, pbw, lk, sSep, sKey, uTimeout);
 
-        property_bag &r2 = m_pb.at(sSep, sKey);
+        property_bag &r2 = s.pb.at(sSep, sKey);
 
         if (!r2.size())
             return ret;
@@ -671,11 +1434,36 @@ property_bag property_bag_ts::pop(const string &sSep, const string &sKey, proper
     return ret;
 }
 
+property_bag::t_size property_bag_ts::popv(std::vector<property_bag> &v, const string &sSep, const string &sKey, property_bag::t_size n, property_bag::t_size uTimeout)
+{
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag *r = &s.pb.at(sSep, sKey);
+
+    if (!r->size())
+    {
+        if (!uTimeout)
+            return 0;
+
+        t_pbwptr pbw(new pb_waitable());
+
+        _wait(s, pbw, lk, sSep, sKey, uTimeout);
+
+        r = &s.pb.at(sSep, sKey);
+    }
+
+    return r->pop(v, n);
+}
+
 bool property_bag_ts::pop(property_bag &p, const string &sSep, const string &sKey, property_bag::t_size uTimeout)
 {
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    property_bag &r = m_pb.at(sSep, sKey);
+    property_bag &r = s.pb.at(sSep, sKey);
 
     if (r.size())
         p = r.pop();
@@ -685,13 +1473,11 @@ bool property_bag_ts::pop(property_bag &p, const string &sSep, const string &sKe
 
     else
     {
-        string key(sSep + sKey);
-
         t_pbwptr pbw(new pb_waitable());
 
-        _wait(pbw, lk, key, uTimeout);
+        _wait(s, pbw, lk, sSep, sKey, uTimeout);
 
-        property_bag &r2 = m_pb.at(sSep, sKey);
+        property_bag &r2 = s.pb.at(sSep, sKey);
 
         if (!r2.size())
             return false;
@@ -706,13 +1492,16 @@ bool property_bag_ts::pop(property_bag &p, const string &sSep, const string &sKe
 property_bag property_bag_ts::swp(const string &sSep, const string &sKey, const property_bag &pbValue)
 {
     property_bag pb;
-    t_scopelock lk(m_mLock);
 
-    pb = m_pb.at(sSep, sKey);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    pb = s.pb.at(sSep, sKey);
 
-    m_pb.at(sSep, sKey) = pbValue;
+    s.pb.at(sSep, sKey) = pbValue;
 
-    _sig(sSep, sKey);
+    _sig(s, sSep, sKey);
 
     return pb;
 
@@ -721,13 +1510,16 @@ property_bag property_bag_ts::swp(const string &sSep, const string &sKey, const
 property_bag property_bag_ts::swp(const string &sSep, const string &sKey, const property_bag::t_any &vValue)
 {
     property_bag pb;
-    t_scopelock lk(m_mLock);
 
-    pb = m_pb.at(sSep, sKey);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    m_pb.at(sSep, sKey) = vValue;
+    pb = s.pb.at(sSep, sKey);
 
-    _sig(sSep, sKey);
+    s.pb.at(sSep, sKey) = vValue;
+
+    _sig(s, sSep, sKey);
 
     return pb;
 
@@ -736,18 +1528,19 @@ property_bag property_bag_ts::swp(const string &sSep, const string &sKey, const
 property_bag property_bag_ts::swp(const string &sSep, const string &sKey, const property_bag &pbValue, property_bag::t_size uTimeout)
 {
     property_bag pb;
-    t_scopelock lk(m_mLock);
 
-    property_bag *p = &m_pb.at(sSep, sKey);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag *p = &s.pb.at(sSep, sKey);
     if (uTimeout && !p->size())
     {
-        string key(sSep + sKey);
-
         t_pbwptr pbw(new pb_waitable());
 
-        _wait(pbw, lk, key, uTimeout);
+        _wait(s, pbw, lk, sSep, sKey, uTimeout);
 
-        p = &m_pb.at(sSep, sKey);
+        p = &s.pb.at(sSep, sKey);
 
         if (!p->size())
             return property_bag();
@@ -757,7 +1550,7 @@ property_bag property_bag_ts::swp(const string &sSep, const string &sKey, const
 
     *p = pbValue;
 
-    _sig(sSep, sKey);
+    _sig(s, sSep, sKey);
 
     return pb;
 }
@@ -765,18 +1558,19 @@ property_bag property_bag_ts::swp(const string &sSep, const string &sKey, const
 property_bag property_bag_ts::swp(const string &sSep, const string &sKey, const property_bag::t_any &vValue, property_bag::t_size uTimeout)
 {
     property_bag pb;
-    t_scopelock lk(m_mLock);
 
-    property_bag *p = &m_pb.at(sSep, sKey);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
+
+    property_bag *p = &s.pb.at(sSep, sKey);
     if (uTimeout && !p->length())
     {
-        string key(sSep + sKey);
-
         t_pbwptr pbw(new pb_waitable());
 
-        _wait(pbw, lk, key, uTimeout);
+        _wait(s, pbw, lk, sSep, sKey, uTimeout);
 
-        p = &m_pb.at(sSep, sKey);
+        p = &s.pb.at(sSep, sKey);
 
         if (!p->size())
             return property_bag();
@@ -786,76 +1580,142 @@ property_bag property_bag_ts::swp(const string &sSep, const string &sKey, const
 
     *p = vValue;
 
-    _sig(sSep, sKey);
+    _sig(s, sSep, sKey);
 
     return pb;
 }
 
-void property_bag_ts::sig(const t_str &sSep, const t_str &sKey, bool bSignalAll)
+bool property_bag_ts::pb_queue::pop(property_bag &p, property_bag::t_size uTimeout)
 {
-    t_scopelock lk(m_mLock);
+    if (m_q.pop(p))
+        return true;
+
+    if (!uTimeout)
+        return false;
+
+    auto tEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(uTimeout);
+
+    // Made before the lock, the stop callback takes it too
+    stop_token st = stop_token::current();
+    stop_callback cb(st, [this]() { { t_scopelock lk(m_lock); } m_cond.notify_all(); });
+
+    t_scopelock lk(m_lock);
+
+    // Pairs with the fence in _wake(), either we see the item or it sees us
+    m_waiters++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool b;
+    while (!(b = m_q.pop(p)) && !st.stop_requested())
+        if (std::cv_status::timeout == m_cond.wait_until(lk, tEnd))
+        {   b = m_q.pop(p);
+            break;
+        }
 
-    _sig(sSep, sKey, bSignalAll);
+    m_waiters--;
+
+    return b;
 }
 
-bool property_bag_ts::wait(const t_str &sSep, const t_str &sKey, property_bag::t_size uTimeout)
+void property_bag_ts::pb_queue::_wake()
 {
-    t_str key(sSep + sKey);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_waiters.load(std::memory_order_relaxed))
+        return;
 
-    t_pbwptr pbw(new pb_waitable());
+    // The waiter holds the lock until it is waiting
+    { t_scopelock lk(m_lock); }
+
+    m_cond.notify_one();
+}
+
+property_bag_ts::t_queueptr property_bag_ts::get_queue(const t_str &sName, std::size_t nSize)
+{
+    t_scopelock lk(m_qLock);
 
-    t_scopelock lk(m_mLock);
+    t_queueptr &q = m_queues[sName];
+    if (!q)
+        q = std::make_shared<pb_queue>(nSize);
 
-    return _wait(pbw, lk, key, uTimeout);
+    return q;
 }
 
-bool property_bag_ts::wait_multiple(const t_str &sSep, const t_strlist &keys, property_bag::t_size uTimeout)
+bool property_bag_ts::remove_queue(const t_str &sName)
 {
-    if (!keys.size())
-        return false;
+    t_scopelock lk(m_qLock);
 
-    t_strlist sl;
-    if (!sSep.length())
-        sl = keys;
-    else
-        for (auto it = keys.begin(); keys.end() != it; it++)
-            sl.push_back(sSep + *it);
+    return 0 < m_queues.erase(sName);
+}
 
-    // Create our wait object
+bool property_bag_ts::qpush(const t_str &sName, const property_bag &pbValue)
+{
+    return get_queue(sName)->push(pbValue);
+}
+
+bool property_bag_ts::qpush(const t_str &sName, const property_bag::t_any &vValue)
+{
+    return get_queue(sName)->push(vValue);
+}
+
+bool property_bag_ts::qpop(property_bag &p, const t_str &sName, property_bag::t_size uTimeout)
+{
+    return get_queue(sName)->pop(p, uTimeout);
+}
+
+void property_bag_ts::sig(const t_str &sSep, const t_str &sKey, bool bSignalAll)
+{
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+
+    _sig(s, sSep, sKey, bSignalAll);
+}
+
+bool property_bag_ts::wait(const t_str &sSep, const t_str &sKey, property_bag::t_size uTimeout)
+{
     t_pbwptr pbw(new pb_waitable());
 
-    t_scopelock lk(m_mLock);
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
 
-    return _wait_multiple(pbw, lk, sl, uTimeout);
+    return _wait(s, pbw, lk, sSep, sKey, uTimeout);
 }
 
-void property_bag_ts::add_named_wait(const t_str &sName, const t_str &sSep, const t_str &sKey)
+bool property_bag_ts::wait_multiple(const t_str &sSep, const t_strlist &keys, property_bag::t_size uTimeout)
 {
-    t_str key(sSep + sKey);
+    if (!keys.size())
+        return false;
 
     // Create our wait object
-    t_pbwptr pbw(new pb_waitable(key));
-
-    t_scopelock lk(m_mLock);
+    t_pbwptr pbw(new pb_waitable());
+    pbw->arm();
 
-    // +++ Warn if there are a lot of these
-    if (100 < m_waitable.size())
-        ZruWarning("There are ", m_waitable.size(), " named waits on property bag ", &sName);
+    // Hook each key in its shard
+    t_hooks hooks;
+    for (auto it = keys.begin(); keys.end() != it; it++)
+    {   pb_shard &s = _shard(sSep, *it);
+        t_writelock lk(s.lock);
+        hooks.push_back(_add_wait(s, sSep, *it, pbw));
+    }
 
-    // Find existing wait
-    auto it = m_waitable.find(sName);
+    // Wait for something, or for the thread to be stopped
+    bool bRet;
+    {   stop_token st = stop_token::current();
+        stop_callback cb(st, [&pbw]() { pbw->wake(); });
+        bRet = (std::cv_status::no_timeout == pbw->wait_for(std::chrono::milliseconds(uTimeout), st));
+    }
 
-    // Remove if it exists, +++ not sure if we shouldn't just fail?
-    if(m_waitable.end() != it)
-    {   t_strlist &keys = it->second->get_keys();
-        for (auto kit = keys.begin(); keys.end() != kit; kit++)
-            _remove_wait(*kit, it->second);
-        m_waitable.erase(it);
+    // Remove the hooks
+    for (auto &h : hooks)
+    {   t_writelock lk(h.s->lock);
+        _remove_wait(h);
     }
 
-    m_waitable[sName] = pbw;
+    return bRet;
+}
 
-    _add_wait(key, pbw);
+void property_bag_ts::add_named_wait(const t_str &sName, const t_str &sSep, const t_str &sKey)
+{
+    add_named_wait_multiple(sName, sSep, { sKey });
 }
 
 void property_bag_ts::add_named_wait_multiple(const t_str &sName, const t_str &sSep, const t_strlist &keys)
@@ -864,15 +1724,12 @@ void property_bag_ts::add_named_wait_multiple(const t_str &sName, const t_str &s
         return;
 
     t_strlist sl;
-    if (!sSep.length())
-        sl = keys;
-    else
-        for (auto it = keys.begin(); keys.end() != it; it++)
-            sl.push_back(sSep + *it);
+    for (auto it = keys.begin(); keys.end() != it; it++)
+        sl.push_back(sSep + *it);
 
     t_pbwptr pbw(new pb_waitable(sl));
 
-    t_scopelock lk(m_mLock);
+    t_scopelock lk(m_wLock);
 
     // +++ Warn if there are a lot of these
     if (100 < m_waitable.size())
@@ -883,21 +1740,22 @@ void property_bag_ts::add_named_wait_multiple(const t_str &sName, const t_str &s
 
     // Remove if it exists, +++ not sure if we shouldn't just fail?
     if(m_waitable.end() != it)
-    {   t_strlist &keys = it->second->get_keys();
-        for (auto kit = keys.begin(); keys.end() != kit; kit++)
-            _remove_wait(*kit, it->second);
+    {   _remove_named(it->second);
         m_waitable.erase(it);
     }
 
     m_waitable[sName] = pbw;
 
-    for (auto kit = sl.begin(); sl.end() != kit; kit++)
-        _add_wait(*kit, pbw);
+    for (auto it = keys.begin(); keys.end() != it; it++)
+    {   pb_shard &s = _shard(sSep, *it);
+        t_writelock slk(s.lock);
+        pbw->get_hooks().push_back(_add_wait(s, sSep, *it, pbw));
+    }
 }
 
 int64_t property_bag_ts::get_named_wait_count(const t_str &sName)
 {
-    t_scopelock lk(m_mLock);
+    t_scopelock lk(m_wLock);
 
     auto it = m_waitable.find(sName);
     if(m_waitable.end() == it)
@@ -908,7 +1766,7 @@ int64_t property_bag_ts::get_named_wait_count(const t_str &sName)
 
 int64_t property_bag_ts::get_named_update_count(const t_str &sName)
 {
-    t_scopelock lk(m_mLock);
+    t_scopelock lk(m_wLock);
 
     auto it = m_waitable.find(sName);
     if(m_waitable.end() == it)
@@ -919,137 +1777,336 @@ int64_t property_bag_ts::get_named_update_count(const t_str &sName)
 
 bool property_bag_ts::named_wait(const t_str &sName, property_bag::t_size uTimeout)
 {
-    t_scopelock lk(m_mLock);
+    t_pbwptr pbw;
 
-    auto it = m_waitable.find(sName);
-    if(m_waitable.end() == it)
-        return false;
+    {   t_scopelock lk(m_wLock);
+
+        auto it = m_waitable.find(sName);
+        if(m_waitable.end() == it)
+            return false;
+
+        pbw = it->second;
+    }
+
+    stop_token st = stop_token::current();
+    stop_callback cb(st, [&pbw]() { pbw->wake(); });
 
-    return (std::cv_status::no_timeout == it->second->wait_for(lk, std::chrono::milliseconds(uTimeout)));
+    return (std::cv_status::no_timeout == pbw->wait_for(std::chrono::milliseconds(uTimeout), st));
 }
 
 void property_bag_ts::remove_named_wait(const t_str &sName)
 {
-    t_scopelock lk(m_mLock);
+    t_scopelock lk(m_wLock);
 
     auto it = m_waitable.find(sName);
     if(m_waitable.end() == it)
         return;
 
-    t_strlist &keys = it->second->get_keys();
-    for (auto kit = keys.begin(); keys.end() != kit; kit++)
-        _remove_wait(*kit, it->second);
+    _remove_named(it->second);
 
     m_waitable.erase(it);
 }
 
 void property_bag_ts::remove_all_named_waits()
 {
+    t_scopelock lk(m_wLock);
+
     for (auto it = m_waitable.begin(); m_waitable.end() != it;)
     {
-        t_strlist &keys = it->second->get_keys();
-        for (auto kit = keys.begin(); keys.end() != kit; kit++)
-            _remove_wait(*kit, it->second);
+        _remove_named(it->second);
         m_waitable.erase(it++);
     }
 }
 
-void property_bag_ts::_add_wait(const t_str &sKey, t_pbwptr pbw)
+property_bag_ts::t_pbwptr property_bag_ts::async_wait(const t_str &sSep, const t_str &sKey, std::function<void()> f)
 {
-    m_wait[sKey].push_back(pbw);
+    return async_wait_multiple(sSep, { sKey }, std::move(f));
 }
 
-void property_bag_ts::_remove_wait(const t_str &sKey, t_pbwptr pbw)
+property_bag_ts::t_pbwptr property_bag_ts::async_wait_multiple(const t_str &sSep, const t_strlist &keys, std::function<void()> f)
 {
-    // Erase the wait object
-    auto it = m_wait.find(sKey);
-    if(m_wait.end() == it)
-        return;
+    t_pbwptr pbw(new pb_waitable(std::move(f)));
 
-    // If size is one, it's just us
-    if (it->second.size() <= 1)
-        m_wait.erase(it);
+    for (auto &k : keys)
+    {   pb_shard &s = _shard(sSep, k);
+        t_writelock lk(s.lock);
+        pbw->get_hooks().push_back(_add_wait(s, sSep, k, pbw));
+    }
 
-    // Find our object in the list (I'm guessing it's not worth a map here)
-    else
-        for (auto cit = it->second.begin(); it->second.end() != cit; cit++)
-            if (cit->get() == pbw.get())
-            {
-                it->second.erase(cit);
-                break;
-            }
+    return pbw;
 }
 
-void property_bag_ts::_sig(const t_str &sKey, bool bSignalAll)
+property_bag_ts::t_pbwptr property_bag_ts::async_pop(property_bag &p, const t_str &sSep, const t_str &sKey, std::function<void()> f)
 {
-    if (!sKey.length())
-        return;
+    pb_shard &s = _shard(sSep, sKey);
+    t_writelock lk(s.lock);
+    _changed(s);
 
-    auto it = m_wait.find(sKey);
-    if (m_wait.end() == it)
-        return;
+    property_bag &r = s.pb.at(sSep, sKey);
+    if (r.size())
+    {   p = r.pop();
+        return t_pbwptr();
+    }
+
+    t_pbwptr pbw(new pb_waitable(std::move(f)));
+    pbw->get_hooks().push_back(_add_wait(s, sSep, sKey, pbw));
+
+    return pbw;
+}
+
+void property_bag_ts::async_cancel(const t_pbwptr &pbw)
+{
+    if (pbw)
+        _remove_named(pbw);
+}
+
+property_bag_ts::pb_shard& property_bag_ts::_shard(const t_str &sSep, const t_str &sKey)
+{
+    if (1 == m_shards.size())
+        return *m_shards[0];
+
+    // Skip leading separators, the first key picks the shard
+    t_str::size_type b = 0, n = sSep.length();
+    if (n)
+        while (!sKey.compare(b, n, sSep))
+            b += n;
+
+    t_str::size_type e = n ? sKey.find(sSep, b) : t_str::npos;
+    if (t_str::npos == e)
+        e = sKey.length();
+
+    std::size_t h = std::hash<std::string_view>()(std::string_view(sKey).substr(b, e - b));
+
+    return *m_shards[h % m_shards.size()];
+}
+
+property_bag_ts::pb_shard& property_bag_ts::_shard(const property_bag::path &p)
+{
+    if (1 == m_shards.size())
+        return *m_shards[0];
+
+    // Same hash as the string version, so both land on the same shard
+    std::size_t h = p.size() ? p.hash(0) : std::hash<t_str>()(t_str());
+
+    return *m_shards[h % m_shards.size()];
+}
+
+void property_bag_ts::_changed(pb_shard &s)
+{
+    s.gen.fetch_add(1, std::memory_order_release);
+}
+
+property_bag_ts::t_pbview property_bag_ts::_view(pb_shard &s, const t_str &sId,
+                                                 const std::function<const property_bag*(const property_bag&)> &f)
+{
+    // A view from this generation, no shard lock needed
+    uint64_t g = s.gen.load(std::memory_order_acquire);
+    {   t_readlock lk(s.view_lock);
+        if (s.view_gen == g)
+        {   auto it = s.views.find(sId);
+            if (s.views.end() != it)
+                return it->second;
+        }
+    }
 
-    for (auto cit = it->second.begin(); it->second.end() != cit; cit++)
+    // Writers are locked out, so the generation holds while we copy, and
+    // readers after the same key wait for this copy rather than make their own
+    t_readlock lk(s.lock);
+    g = s.gen.load(std::memory_order_acquire);
+
+    t_writelock lkv(s.view_lock);
+    if (s.view_gen != g)
+    {   s.views.clear();
+        s.view_gen = g;
+    }
+
+    t_pbview &v = s.views[sId];
+    if (!v)
+    {   const property_bag *p = f(s.pb);
+        v = p ? std::make_shared<const property_bag>(*p) : std::make_shared<const property_bag>();
+    }
+
+    return v;
+}
+
+bool property_bag_ts::_isroot(const t_str &sSep, const t_str &sKey)
+{
+    if (!sSep.length())
+        return !sKey.length();
+
+    for (t_str::size_type b = 0; b < sKey.length(); b += sSep.length())
+        if (sKey.compare(b, sSep.length(), sSep))
+            return false;
+
+    return true;
+}
+
+/// Returns the next non-empty segment of k from b on, or false at the end
+static bool next_segment(const t_str &sep, std::string_view k, std::string_view::size_type &b, std::string_view &seg)
+{
+    while (b < k.length())
+    {
+        std::string_view::size_type e = sep.length() ? k.find(sep, b) : std::string_view::npos;
+        if (std::string_view::npos == e)
+            e = k.length();
+
+        seg = k.substr(b, e - b);
+        b = e + sep.length();
+
+        if (seg.length())
+            return true;
+    }
+
+    return false;
+}
+
+property_bag_ts::wait_node* property_bag_ts::_wait_child(wait_node *n, std::string_view seg)
+{
+    auto it = n->next.find(seg);
+    if (n->next.end() == it)
+    {   it = n->next.emplace(t_str(seg), new wait_node()).first;
+        it->second->parent = n;
+        it->second->key = it->first;
+    }
+
+    return it->second.get();
+}
+
+property_bag_ts::wait_hook property_bag_ts::_add_wait(pb_shard &s, const t_str &sSep, const t_str &sKey, t_pbwptr pbw)
+{
+    wait_node *n = &s.wait;
+
+    std::string_view seg;
+    std::string_view::size_type b = 0;
+    while (next_segment(sSep, sKey, b, seg))
+        n = _wait_child(n, seg);
+
+    n->waits.push_back(pbw);
+
+    return { &s, n, std::prev(n->waits.end()) };
+}
+
+property_bag_ts::wait_hook property_bag_ts::_add_wait(pb_shard &s, const property_bag::path &p, t_pbwptr pbw)
+{
+    wait_node *n = &s.wait;
+
+    for (std::size_t i = 0; i < p.size(); i++)
+        n = _wait_child(n, p[i]);
+
+    n->waits.push_back(pbw);
+
+    return { &s, n, std::prev(n->waits.end()) };
+}
+
+void property_bag_ts::_remove_wait(const wait_hook &h)
+{
+    wait_node *n = h.n;
+    n->waits.erase(h.it);
+
+    // Drop the branch once nobody below it is waiting
+    while (n->parent && n->waits.empty() && n->next.empty())
+    {   wait_node *p = n->parent;
+        p->next.erase(n->key);
+        n = p;
+    }
+}
+
+void property_bag_ts::_remove_named(t_pbwptr pbw)
+{
+    for (auto &h : pbw->get_hooks())
+    {   t_writelock lk(h.s->lock);
+        _remove_wait(h);
+    }
+
+    pbw->get_hooks().clear();
+}
+
+void property_bag_ts::_sig(wait_node &n, bool bSignalAll)
+{
+    for (auto cit = n.waits.begin(); n.waits.end() != cit; cit++)
     {
         if (bSignalAll)
             cit->get()->notify_all();
-        else
-        {
-            cit->get()->notify_one();
+        // A waiter that already woke, or an async wait that already fired, passes it on
+        else if (cit->get()->notify_one())
             break;
-        }
     }
 }
 
-void property_bag_ts::_sig(const t_str &sSep, const t_str &sKey, bool bSignalAll)
+void property_bag_ts::_sig(pb_shard &s, const t_str &sSep, const t_str &sKey, bool bSignalAll)
 {
-    if (!sKey.length())
+    // Nobody is waiting
+    wait_node *n = &s.wait;
+    if (!sKey.length() || (n->next.empty() && n->waits.empty()))
         return;
 
-    if (!sSep.length())
-        return _sig(sKey, bSignalAll);
+    _sig(*n, bSignalAll);
 
-    t_str::size_type p = 0;
-    t_str k, key = sKey;
-    while(key.length())
+    // Each key on the way down, stop where nobody is listening
+    std::string_view seg;
+    std::string_view::size_type b = 0;
+    while (next_segment(sSep, sKey, b, seg))
     {
-        p = key.find_first_of(sSep);
-        if (t_str::npos == p)
-        {	_sig(k.append(sSep).append(key), bSignalAll);
+        auto it = n->next.find(seg);
+        if (n->next.end() == it)
             return;
-        }
-        else
-            _sig(k.append(sSep).append(key.substr(0,p)), bSignalAll),
-            key = key.substr(p + sSep.length());
-    };
+
+        n = it->second.get();
+        _sig(*n, bSignalAll);
+    }
 }
 
-bool property_bag_ts::_wait(t_pbwptr pbw, t_scopelock &lk, const t_str &key, property_bag::t_size uTimeout)
+void property_bag_ts::_sig(pb_shard &s, const property_bag::path &p, bool bSignalAll)
 {
-    _add_wait(key, pbw);
+    // Nobody is waiting
+    wait_node *n = &s.wait;
+    if (!p.key().length() || (n->next.empty() && n->waits.empty()))
+        return;
 
-    bool bRet = (std::cv_status::no_timeout == pbw->wait_for(lk, std::chrono::milliseconds(uTimeout)));
+    _sig(*n, bSignalAll);
 
-    _remove_wait(key, pbw);
+    for (std::size_t i = 0; i < p.size(); i++)
+    {
+        auto it = n->next.find(p[i]);
+        if (n->next.end() == it)
+            return;
 
-    return bRet;
+        n = it->second.get();
+        _sig(*n, bSignalAll);
+    }
 }
 
-bool property_bag_ts::_wait_multiple(t_pbwptr pbw, t_scopelock &lk, const t_strlist &keys, property_bag::t_size uTimeout)
+bool property_bag_ts::_wait(pb_shard &s, t_pbwptr pbw, t_writelock &lk, const t_str &sSep, const t_str &sKey, property_bag::t_size uTimeout)
 {
-    if (!keys.size())
-        return false;
+    pbw->arm();
 
-    // Add the hooks
-    for (auto it = keys.begin(); keys.end() != it; it++)
-        _add_wait(*it, pbw);
+    return _wait(s, pbw, lk, _add_wait(s, sSep, sKey, pbw), uTimeout);
+}
+
+bool property_bag_ts::_wait(pb_shard &s, t_pbwptr pbw, t_writelock &lk, const property_bag::path &p, property_bag::t_size uTimeout)
+{
+    pbw->arm();
 
-    // Wait for something
-    bool bRet = (std::cv_status::no_timeout == pbw->wait_for(lk, std::chrono::milliseconds(uTimeout)));
+    return _wait(s, pbw, lk, _add_wait(s, p, pbw), uTimeout);
+}
 
-    // Remove the hooks
-    for (auto it = keys.begin(); keys.end() != it; it++)
-        _remove_wait(*it, pbw);
+bool property_bag_ts::_wait(pb_shard &s, t_pbwptr pbw, t_writelock &lk, const wait_hook &h, property_bag::t_size uTimeout)
+{
+    // The shard stays free while we wait
+    lk.unlock();
+
+    bool bRet;
+    {   stop_token st = stop_token::current();
+        stop_callback cb(st, [&pbw]() { pbw->wake(); });
+        bRet = (std::cv_status::no_timeout == pbw->wait_for(std::chrono::milliseconds(uTimeout), st));
+    }
+
+    lk.lock();
+
+    // Callers usually go on to pop, and the snapshot may be rebuilt while we waited
+    _changed(s);
+
+    _remove_wait(h);
 
     return bRet;
 }
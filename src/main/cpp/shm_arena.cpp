@@ -0,0 +1,267 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+
+#include "libzru.h"
+
+#include <cerrno>
+#include <thread>
+
+// PTHREAD_MUTEX_ROBUST is an enum, not something to test for
+#if defined(__linux__) || defined(__FreeBSD__)
+#   define ZRU_ROBUST_MUTEX
+#endif
+
+namespace zru
+{
+
+/// 'zrar', written last by the creator
+static const uint32_t g_nMagic = 0x7a726172;
+static const uint32_t g_nVersion = 1;
+
+/// Marks a block in use, or free
+static const uint32_t g_nUsed = 0x7a726275;
+static const uint32_t g_nFree = 0x7a726266;
+
+/// Number of size classes
+static const int g_nClasses = 48;
+
+/// Front of each block
+struct block_header
+{
+    /// Size class, the block is 16 << cls bytes
+    uint32_t            cls;
+
+    /// g_nUsed or g_nFree
+    uint32_t            state;
+};
+
+#if defined(ZRU_POSIX)
+
+shm_mutex::shm_mutex()
+{
+    pthread_mutexattr_t a;
+    pthread_mutexattr_init(&a);
+    pthread_mutexattr_setpshared(&a, PTHREAD_PROCESS_SHARED);
+#if defined(ZRU_ROBUST_MUTEX)
+    pthread_mutexattr_setrobust(&a, PTHREAD_MUTEX_ROBUST);
+#endif
+    pthread_mutex_init(&m_mtx, &a);
+    pthread_mutexattr_destroy(&a);
+}
+
+shm_mutex::~shm_mutex()
+{
+    pthread_mutex_destroy(&m_mtx);
+}
+
+bool shm_mutex::lock()
+{
+    int r = pthread_mutex_lock(&m_mtx);
+#if defined(ZRU_ROBUST_MUTEX)
+    if (EOWNERDEAD == r)
+    {   pthread_mutex_consistent(&m_mtx);
+        return true;
+    }
+#endif
+    if (r)
+        ZruError("pthread_mutex_lock() failed : ", r);
+    return false;
+}
+
+bool shm_mutex::try_lock()
+{
+    int r = pthread_mutex_trylock(&m_mtx);
+#if defined(ZRU_ROBUST_MUTEX)
+    if (EOWNERDEAD == r)
+    {   pthread_mutex_consistent(&m_mtx);
+        return true;
+    }
+#endif
+    return !r;
+}
+
+void shm_mutex::unlock()
+{
+    pthread_mutex_unlock(&m_mtx);
+}
+
+#endif
+
+bool shm_arena::open(const t_str &sName, int64_t nSize, bool bCreate)
+{
+    close();
+
+    if ((int64_t)eHeaderSize + eBlockHeader >= nSize)
+        return false;
+
+    if (!m_mem.open(sName, nSize, bCreate))
+        return false;
+
+    header *h = (header*)m_mem.ptr();
+
+    // A new share is zeroed, free lists and root included
+    if (!m_mem.isExisting())
+    {   new (&h->lock) shm_mutex;
+        h->version = g_nVersion;
+        h->size = (uint64_t)nSize;
+        h->top = eHeaderSize;
+        h->magic.store(g_nMagic, std::memory_order_release);
+    }
+
+    // Give the creator a moment to finish
+    else
+        for (int i = 0; i < 1000 && g_nMagic != h->magic.load(std::memory_order_acquire); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    if (g_nMagic != h->magic.load(std::memory_order_acquire) || g_nVersion != h->version || (uint64_t)nSize != h->size)
+    {   ZruWarning("Not a matching arena : ", sName);
+        m_mem.close();
+        return false;
+    }
+
+    m_pHdr = h;
+    m_pBase = (char*)h;
+
+    return true;
+}
+
+void shm_arena::close()
+{
+    // The mutex stays, other processes may still be using it
+    m_pHdr = 0;
+    m_pBase = 0;
+    m_mem.close();
+}
+
+void shm_arena::_lock()
+{
+    if (!m_pHdr->lock.lock())
+        return;
+
+    m_pHdr->recovered++;
+    ZruWarning("Took over the lock of a process that died, at most one block leaked");
+
+    // used is a separate store and may not have caught up, count it again from the lists
+    uint64_t nFree = 0;
+    for (int c = 0; c < g_nClasses; c++)
+        for (uint64_t off = m_pHdr->free[c]; off; off = *(uint64_t*)(m_pBase + off + eBlockHeader))
+            nFree += (uint64_t)16 << c;
+    m_pHdr->used = m_pHdr->top - eHeaderSize - nFree;
+}
+
+void* shm_arena::alloc(std::size_t n)
+{
+    if (!m_pHdr || !n)
+        return 0;
+
+    int c = 0;
+    while (c < g_nClasses && ((uint64_t)16 << c) < n + eBlockHeader)
+        c++;
+    if (g_nClasses <= c)
+        return 0;
+
+    const uint64_t nBlock = (uint64_t)16 << c;
+
+    // Reuse a free block, or carve a new one off the top, each one store, used follows
+    _lock();
+    uint64_t off = m_pHdr->free[c];
+    if (off)
+        m_pHdr->free[c] = *(uint64_t*)(m_pBase + off + eBlockHeader);
+    else if (m_pHdr->top + nBlock <= m_pHdr->size)
+        off = m_pHdr->top, m_pHdr->top += nBlock;
+    if (off)
+        m_pHdr->used += nBlock;
+    m_pHdr->lock.unlock();
+
+    if (!off)
+        return 0;
+
+    block_header *b = (block_header*)(m_pBase + off);
+    b->cls = (uint32_t)c;
+    b->state = g_nUsed;
+
+    return m_pBase + off + eBlockHeader;
+}
+
+void shm_arena::free(void *p)
+{
+    if (!m_pHdr || !p)
+        return;
+
+    uint64_t off = (uint64_t)((char*)p - m_pBase) - eBlockHeader;
+    block_header *b = (block_header*)(m_pBase + off);
+    if (eHeaderSize > off || m_pHdr->size <= off || g_nUsed != b->state || g_nClasses <= (int)b->cls)
+    {   ZruError("Not a block in use from this arena");
+        return;
+    }
+
+    b->state = g_nFree;
+
+    _lock();
+    *(uint64_t*)p = m_pHdr->free[b->cls];
+    m_pHdr->free[b->cls] = off;
+    m_pHdr->used -= (uint64_t)16 << b->cls;
+    m_pHdr->lock.unlock();
+}
+
+void* shm_arena::root() const
+{
+    return m_pHdr ? at(m_pHdr->root.load(std::memory_order_acquire)) : 0;
+}
+
+bool shm_arena::set_root(void *p, void *pExpected)
+{
+    if (!m_pHdr)
+        return false;
+
+    uint64_t nExpected = offset(pExpected);
+    return m_pHdr->root.compare_exchange_strong(nExpected, offset(p), std::memory_order_acq_rel);
+}
+
+std::size_t shm_arena::capacity() const
+{
+    return m_pHdr ? (std::size_t)(m_pHdr->size - eHeaderSize) : 0;
+}
+
+std::size_t shm_arena::used() const
+{
+    return m_pHdr ? (std::size_t)m_pHdr->used : 0;
+}
+
+uint64_t shm_arena::recovered() const
+{
+    return m_pHdr ? m_pHdr->recovered : 0;
+}
+
+} // end namespace
@@ -0,0 +1,410 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+
+#include "libzru.h"
+
+#include <thread>
+
+namespace zru
+{
+
+/// 'zrmp', written last by the creator
+static const uint32_t g_nMagic = 0x7a726d70;
+static const uint32_t g_nVersion = 1;
+
+/// Stripe locks, a power of two
+static const uint32_t g_nStripes = 64;
+
+/// FNV-1a, never zero
+static uint32_t hash_key(const t_str &s)
+{
+    uint32_t h = 2166136261u;
+    for (unsigned char c : s)
+        h = (h ^ c) * 16777619u;
+    return h ? h : 1;
+}
+
+/// Waits while f() is non-zero, gives up after a while in case whoever was writing died
+template<typename F>
+    static bool wait_while(F f)
+    {
+        for (int i = 0; f(); i++)
+        {   if (100000 <= i)
+                return false;
+            if (64 <= i)
+                std::this_thread::yield();
+        }
+        return true;
+    }
+
+/// Waits for an even sequence, returns it, or an odd one if the writer never finished
+static uint32_t wait_even(const std::atomic<uint32_t> &seq)
+{
+    uint32_t q = 0;
+    wait_while([&]() { return 1 & (q = seq.load(std::memory_order_acquire)); });
+    return q;
+}
+
+/// Next even sequence, zero means empty
+static uint32_t next_even(uint32_t q)
+{
+    return (q + 2) ? q + 2 : 2;
+}
+
+/// Value bits of a scalar any, false for anything else
+static bool pack(const any &v, uint32_t &t, uint64_t &b)
+{
+    t = (uint32_t)v.getType();
+    switch (v.getType())
+    {
+        default :
+            return false;
+
+        case any::at_bool :
+            b = v.toBool() ? 1 : 0;
+            return true;
+
+        case any::at_char : case any::at_int : case any::at_long : case any::at_longlong :
+            b = (uint64_t)v.toLongLong();
+            return true;
+
+        case any::at_uchar : case any::at_uint : case any::at_ulong : case any::at_ulonglong : case any::at_size :
+            b = v.toULongLong();
+            return true;
+
+        case any::at_float : case any::at_double :
+        {   double d = v.toDouble();
+            memcpy(&b, &d, sizeof(b));
+            return true;
+        }
+    }
+}
+
+/// Puts value bits back in an any
+static bool unpack(uint32_t t, uint64_t b, any &v)
+{
+    double d;
+    memcpy(&d, &b, sizeof(d));
+
+    switch (t)
+    {
+        default : v.clear(); return false;
+        case any::at_bool : v.set_bool(0 != b); break;
+        case any::at_char : v.set_char((char)b); break;
+        case any::at_uchar : v.set_uchar((unsigned char)b); break;
+        case any::at_int : v.set_int((int)b); break;
+        case any::at_uint : v.set_uint((unsigned int)b); break;
+        case any::at_long : v.set_long((long)b); break;
+        case any::at_ulong : v.set_ulong((unsigned long)b); break;
+        case any::at_longlong : v.set_longlong((long long)b); break;
+        case any::at_ulonglong : v.set_ulonglong((unsigned long long)b); break;
+        case any::at_size : v.set_size((std::size_t)b); break;
+        case any::at_float : v.set_float((float)d); break;
+        case any::at_double : v.set_double(d); break;
+    }
+
+    return true;
+}
+
+bool shm_map::open(const t_str &sName, uint64_t nCapacity, bool bCreate, int nKeyMax)
+{
+    close();
+
+    if (!nCapacity || 0 >= nKeyMax)
+        return false;
+
+    uint64_t nCap = 1;
+    while (nCap < nCapacity)
+        nCap <<= 1;
+
+    const uint64_t nSlot = (sizeof(slot) + nKeyMax + 7) & ~(uint64_t)7;
+
+    if (!m_mem.open(sName, eHeaderSize + nCap * nSlot, bCreate))
+        return false;
+
+    header *h = (header*)m_mem.ptr();
+
+    // A new share is zeroed, every slot empty
+    if (!m_mem.isExisting())
+    {   for (auto &x : h->stripe)
+            new (&x) shm_mutex;
+        h->version = g_nVersion;
+        h->capacity = nCap;
+        h->key_max = (uint32_t)nKeyMax;
+        h->magic.store(g_nMagic, std::memory_order_release);
+    }
+
+    // Give the creator a moment to finish
+    else
+        for (int i = 0; i < 1000 && g_nMagic != h->magic.load(std::memory_order_acquire); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    if (g_nMagic != h->magic.load(std::memory_order_acquire) || g_nVersion != h->version
+        || nCap != h->capacity || (uint32_t)nKeyMax != h->key_max)
+    {   ZruWarning("Not a matching map : ", sName);
+        m_mem.close();
+        return false;
+    }
+
+    m_pHdr = h;
+    m_pSlots = m_mem.str() + eHeaderSize;
+    m_nMask = nCap - 1;
+    m_nSlot = nSlot;
+    m_nKeyMax = nKeyMax;
+
+    return true;
+}
+
+void shm_map::close()
+{
+    m_pHdr = 0;
+    m_pSlots = 0;
+    m_nMask = 0;
+    m_nSlot = 0;
+    m_nKeyMax = 0;
+    m_mem.close();
+}
+
+uint64_t shm_map::size() const
+{
+    return m_pHdr ? m_pHdr->count.load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t shm_map::recovered() const
+{
+    return m_pHdr ? m_pHdr->recovered.load(std::memory_order_relaxed) : 0;
+}
+
+void shm_map::_lock(int nStripe)
+{
+    if (!m_pHdr->stripe[nStripe].lock())
+        return;
+
+    m_pHdr->recovered++;
+    ZruWarning("Took over stripe ", nStripe, " from a process that died, repairing its slots");
+
+    // Only holders of this stripe write slots whose hash is in it
+    for (uint64_t i = 0; i <= m_nMask; i++)
+    {
+        slot *s = _slot(i);
+        uint32_t h = s->hash.load(std::memory_order_relaxed);
+        if (!h || (int)(h & (g_nStripes - 1)) != nStripe)
+            continue;
+
+        // Died claiming it, set() may have put keys past it since, so it
+        // can't go back to empty, it keeps the hash and a key that never matches
+        uint32_t q = s->seq.load(std::memory_order_relaxed);
+        if (!q)
+        {   s->klen = 0;
+            s->type.store(any::at_void, std::memory_order_relaxed);
+            s->seq.store(2, std::memory_order_release);
+        }
+
+        // Died writing it, the value is lost, a half written key has no length and never matches
+        else if (q & 1)
+        {   s->type.store(any::at_void, std::memory_order_relaxed);
+            s->seq.store(next_even(q - 1), std::memory_order_release);
+        }
+    }
+}
+
+shm_map::slot* shm_map::_find(const t_str &sKey, uint32_t h) const
+{
+    for (uint64_t i = 0; i <= m_nMask; i++)
+    {
+        slot *s = _slot(h + i);
+
+        // Empty ends the probe, keys are never removed from slots
+        uint32_t q = wait_even(s->seq);
+        if (!q)
+        {   if (!s->hash.load(std::memory_order_acquire))
+                return 0;
+
+            // Being claimed, or left claimed by a writer that died, set() went past it
+            continue;
+        }
+
+        // Key and length don't change once the slot is even
+        if (!(q & 1) && h == s->hash.load(std::memory_order_relaxed)
+            && sKey.length() == s->klen && !memcmp(_key(s), sKey.data(), s->klen))
+            return s;
+    }
+
+    return 0;
+}
+
+bool shm_map::get(const t_str &sKey, any &v) const
+{
+    if (!m_pHdr || !sKey.length() || sKey.length() > (std::size_t)m_nKeyMax)
+        return false;
+
+    slot *s = _find(sKey, hash_key(sKey));
+    if (!s)
+        return false;
+
+    // Read until no write overlapped
+    for (;;)
+    {
+        uint32_t q = wait_even(s->seq);
+        if (q & 1)
+            return false;
+
+        uint32_t t = s->type.load(std::memory_order_relaxed);
+        uint64_t b = s->value.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (q == s->seq.load(std::memory_order_relaxed))
+            return unpack(t, b, v);
+    }
+}
+
+bool shm_map::set(const t_str &sKey, const any &v)
+{
+    uint32_t t;
+    uint64_t b;
+    if (!m_pHdr || !sKey.length() || sKey.length() > (std::size_t)m_nKeyMax || !pack(v, t, b))
+        return false;
+
+    const uint32_t h = hash_key(sKey);
+    const int nStripe = (int)(h & (g_nStripes - 1));
+
+    _lock(nStripe);
+
+    bool bSet = false;
+    for (uint64_t i = 0; !bSet && i <= m_nMask; i++)
+    {
+        slot *s = _slot(h + i);
+
+        // Someone else is claiming it, a writer that died doing so holds another
+        // stripe, ours was repaired by _lock(), so it can't be our key
+        if (!wait_while([&]() { return !s->seq.load(std::memory_order_acquire) && s->hash.load(std::memory_order_acquire); }))
+            continue;
+
+        uint32_t q = wait_even(s->seq);
+
+        // Left half written by a dead writer on another stripe
+        if (q & 1)
+            continue;
+
+        // Claim an empty slot with the hash, then fill it in
+        if (!q)
+        {   uint32_t z = 0;
+            if (!s->hash.compare_exchange_strong(z, h, std::memory_order_acq_rel))
+            {   i--;
+                continue;
+            }
+
+            s->seq.store(1, std::memory_order_relaxed);
+            memcpy(_key(s), sKey.data(), sKey.length());
+            s->klen = (uint32_t)sKey.length();
+            s->type.store(t, std::memory_order_relaxed);
+            s->value.store(b, std::memory_order_relaxed);
+            s->seq.store(2, std::memory_order_release);
+
+            m_pHdr->count++;
+            bSet = true;
+        }
+
+        // Our key, writers of it hold this stripe
+        else if (h == s->hash.load(std::memory_order_relaxed)
+                 && sKey.length() == s->klen && !memcmp(_key(s), sKey.data(), s->klen))
+        {
+            bool bNew = any::at_void == s->type.load(std::memory_order_relaxed);
+
+            s->seq.store(q + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            s->type.store(t, std::memory_order_relaxed);
+            s->value.store(b, std::memory_order_relaxed);
+            s->seq.store(next_even(q), std::memory_order_release);
+
+            if (bNew)
+                m_pHdr->count++;
+            bSet = true;
+        }
+    }
+
+    m_pHdr->stripe[nStripe].unlock();
+
+    return bSet;
+}
+
+bool shm_map::erase(const t_str &sKey)
+{
+    if (!m_pHdr || !sKey.length() || sKey.length() > (std::size_t)m_nKeyMax)
+        return false;
+
+    const uint32_t h = hash_key(sKey);
+    const int nStripe = (int)(h & (g_nStripes - 1));
+
+    _lock(nStripe);
+
+    bool bErased = false;
+    slot *s = _find(sKey, h);
+    if (s && any::at_void != s->type.load(std::memory_order_relaxed))
+    {
+        uint32_t q = s->seq.load(std::memory_order_relaxed);
+        s->seq.store(q + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s->type.store(any::at_void, std::memory_order_relaxed);
+        s->seq.store(next_even(q), std::memory_order_release);
+
+        m_pHdr->count--;
+        bErased = true;
+    }
+
+    m_pHdr->stripe[nStripe].unlock();
+
+    return bErased;
+}
+
+void shm_map::each(const std::function<void(const t_str&, const any&)> &f) const
+{
+    if (!m_pHdr)
+        return;
+
+    any v;
+    for (uint64_t i = 0; i <= m_nMask; i++)
+    {
+        slot *s = _slot(i);
+        uint32_t q = wait_even(s->seq);
+        if (!q || (q & 1))
+            continue;
+
+        t_str sKey(_key(s), s->klen);
+        if (get(sKey, v))
+            f(sKey, v);
+    }
+}
+
+} // end namespace
@@ -0,0 +1,296 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+#include "libzru.h"
+
+namespace zru
+{
+
+/// 'zrrg', written last by the creator
+static const uint32_t g_nMagic = 0x7a727267;
+static const uint32_t g_nVersion = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "shm_ring needs lock free atomics to share them between processes");
+
+/// Milliseconds left until tEnd
+static long ms_left(const std::chrono::steady_clock::time_point &tEnd)
+{
+    return (long)std::chrono::ceil<std::chrono::milliseconds>(tEnd - std::chrono::steady_clock::now()).count();
+}
+
+bool shm_ring::open(const t_str &sName, int64_t nSize, bool bCreate, int nFlags)
+{
+    close();
+
+    if (0 >= nSize)
+        return false;
+
+    uint64_t nCap = 4096;
+    while (nCap < (uint64_t)nSize)
+        nCap <<= 1;
+
+    if (!m_mem.open(sName, eHeaderSize + nCap, bCreate))
+        return false;
+
+    header *h = (header*)m_mem.ptr();
+
+    // A new share is zeroed, which is where everything starts
+    if (!m_mem.isExisting())
+    {   h->version = g_nVersion;
+        h->size = nCap;
+        h->flags = (uint32_t)nFlags;
+        h->magic.store(g_nMagic, std::memory_order_release);
+    }
+
+    // Give the creator a moment to finish
+    else
+        for (int i = 0; i < 1000 && g_nMagic != h->magic.load(std::memory_order_acquire); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    if (g_nMagic != h->magic.load(std::memory_order_acquire) || g_nVersion != h->version || nCap != h->size)
+    {   ZruWarning("Not a matching ring : ", sName);
+        m_mem.close();
+        return false;
+    }
+
+    m_pHdr = h;
+    m_pData = m_mem.str() + eHeaderSize;
+    m_nMask = nCap - 1;
+    m_nFlags = (int)h->flags;
+
+    return true;
+}
+
+void shm_ring::close()
+{
+    m_pHdr = 0;
+    m_pData = 0;
+    m_nMask = 0;
+    m_nFlags = 0;
+    m_mem.close();
+}
+
+std::size_t shm_ring::size() const
+{
+    if (!m_pHdr)
+        return 0;
+
+    uint64_t h = m_pHdr->head.load(std::memory_order_acquire);
+    return (std::size_t)(m_pHdr->tail.load(std::memory_order_acquire) - h);
+}
+
+void* shm_ring::reserve(std::size_t nBytes, long lMs)
+{
+    if (!m_pHdr || nBytes > max_record())
+        return 0;
+
+    const uint64_t nCap = m_nMask + 1;
+    const uint64_t nNeed = (eRecHeader + nBytes + 7) & ~(uint64_t)7;
+
+    // Room at t, including the rest of the lap if the record won't fit in it
+    auto room = [&](uint64_t t, uint64_t &nPad)
+    {   uint64_t off = t & m_nMask;
+        nPad = off + nNeed > nCap ? nCap - off : 0;
+        return t + nPad + nNeed - m_pHdr->head.load(std::memory_order_acquire) <= nCap;
+    };
+
+    // Only read the clock if we have to wait
+    std::chrono::steady_clock::time_point tEnd;
+
+    for (;;)
+    {
+        uint64_t nPad, t = m_pHdr->tail.load(std::memory_order_relaxed);
+        if (room(t, nPad))
+        {
+            if (eSingleProducer & m_nFlags)
+                m_pHdr->tail.store(t + nPad + nNeed, std::memory_order_relaxed);
+
+            else if (!m_pHdr->tail.compare_exchange_weak(t, t + nPad + nNeed, std::memory_order_relaxed))
+                continue;
+
+            // The consumer skips this as soon as it gets here
+            if (nPad)
+                _word(t)->store((uint32_t)nPad | ePad, std::memory_order_release);
+
+            char *r = m_pData + ((t + nPad) & m_nMask);
+            ((uint32_t*)r)[1] = (uint32_t)nBytes;
+            return r + eRecHeader;
+        }
+
+        // Full, sleep until the consumer frees something
+        if (0 >= lMs)
+            return 0;
+        if (tEnd == std::chrono::steady_clock::time_point())
+            tEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(lMs);
+        long ms = ms_left(tEnd);
+        if (0 >= ms)
+            return 0;
+
+        uint32_t s = m_pHdr->space_seq.load();
+        m_pHdr->space_wait++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!room(m_pHdr->tail.load(std::memory_order_relaxed), nPad))
+            futex_wait(&m_pHdr->space_seq, s, ms, true);
+
+        m_pHdr->space_wait--;
+    }
+}
+
+void shm_ring::commit(void *p)
+{
+    char *r = (char*)p - eRecHeader;
+    uint32_t nTotal = (eRecHeader + ((uint32_t*)r)[1] + 7) & ~(uint32_t)7;
+    ((std::atomic<uint32_t>*)r)->store(nTotal, std::memory_order_release);
+
+    _wake_consumer();
+}
+
+bool shm_ring::push(const void *p, std::size_t nBytes, long lMs)
+{
+    void *r = reserve(nBytes, lMs);
+    if (!r)
+        return false;
+
+    memcpy(r, p, nBytes);
+    commit(r);
+
+    return true;
+}
+
+const void* shm_ring::peek(std::size_t &nBytes, long lMs)
+{
+    if (!m_pHdr)
+        return 0;
+
+    // Only read the clock if we have to wait
+    std::chrono::steady_clock::time_point tEnd;
+
+    for (;;)
+    {
+        // Only we move the head
+        uint64_t h = m_pHdr->head.load(std::memory_order_relaxed);
+        uint32_t w = _word(h)->load(std::memory_order_acquire);
+
+        // Skip the rest of the lap
+        if (ePad & w)
+        {   release(m_pData + (h & m_nMask) + eRecHeader);
+            continue;
+        }
+
+        if (w)
+        {   char *r = m_pData + (h & m_nMask);
+            nBytes = ((uint32_t*)r)[1];
+            return r + eRecHeader;
+        }
+
+        // Empty, sleep until a producer commits
+        if (0 >= lMs)
+            return 0;
+        if (tEnd == std::chrono::steady_clock::time_point())
+            tEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(lMs);
+        long ms = ms_left(tEnd);
+        if (0 >= ms)
+            return 0;
+
+        uint32_t s = m_pHdr->data_seq.load();
+        m_pHdr->data_wait.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool bSlept = !_word(h)->load(std::memory_order_acquire);
+        if (bSlept)
+            futex_wait(&m_pHdr->data_seq, s, ms, true);
+
+        m_pHdr->data_wait.store(0);
+
+        // Woken for the first record, give the producer a chance to add more
+        if (bSlept)
+            std::this_thread::yield();
+    }
+}
+
+void shm_ring::release(const void *p)
+{
+    char *r = (char*)p - eRecHeader;
+    uint32_t w = ((std::atomic<uint32_t>*)r)->load(std::memory_order_relaxed);
+
+    // Later laps put record headers anywhere in here, they have to read as uncommitted
+    uint32_t nTotal = w & ~(uint32_t)ePad;
+    memset(r, 0, nTotal);
+
+    m_pHdr->head.store(m_pHdr->head.load(std::memory_order_relaxed) + nTotal, std::memory_order_release);
+
+    _wake_producers();
+}
+
+bool shm_ring::pop(t_str &s, long lMs)
+{
+    std::size_t n = 0;
+    const void *p = peek(n, lMs);
+    if (!p)
+        return false;
+
+    s.assign((const char*)p, n);
+    release(p);
+
+    return true;
+}
+
+void shm_ring::_wake_consumer()
+{
+    // Pairs with the fence in peek(), either it sees the record or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_pHdr->data_wait.load(std::memory_order_relaxed))
+        return;
+
+    m_pHdr->data_seq++;
+    futex_wake(&m_pHdr->data_seq, 1, true);
+}
+
+void shm_ring::_wake_producers()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_pHdr->space_wait.load(std::memory_order_relaxed))
+        return;
+
+    // Wait for half the ring, waking for each record makes them take turns one at a time
+    uint64_t nUsed = m_pHdr->tail.load(std::memory_order_relaxed) - m_pHdr->head.load(std::memory_order_relaxed);
+    if (nUsed > (m_nMask + 1) / 2)
+        return;
+
+    m_pHdr->space_seq++;
+    futex_wake(&m_pHdr->space_seq, -1, true);
+}
+
+} // end namespace
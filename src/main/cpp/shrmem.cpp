@@ -37,6 +37,21 @@
 #   include <sys/mman.h>
 #   include <sys/stat.h>
 #   include <fcntl.h>
+#   include <sys/file.h>
+#   include <cerrno>
+#   include <thread>
+#   if defined(__linux__)
+#       include <sys/vfs.h>
+#       include <sys/syscall.h>
+#       include <linux/magic.h>
+#       include <linux/mempolicy.h>
+#       if !defined(MADV_POPULATE_READ)
+#           define MADV_POPULATE_READ 22
+#       endif
+#       if !defined(MADV_POPULATE_WRITE)
+#           define MADV_POPULATE_WRITE 23
+#       endif
+#   endif
 #endif
 
 
@@ -45,6 +60,40 @@ namespace zru
 
 #if defined(ZRU_POSIX)
 
+/// 'zrgw', written last by the creator
+static const uint32_t g_nGrowMagic = 0x7a726777;
+static const uint32_t g_nGrowVersion = 1;
+
+/// Front of a growable share
+struct grow_header
+{
+    /// Set once the header is ready
+    std::atomic<uint32_t>               magic;
+
+    /// Layout version
+    uint32_t                            version;
+
+    /// Bytes in the share, header included
+    std::atomic<int64_t>                size;
+
+    /// Bumped after each grow, once size is set
+    std::atomic<uint64_t>               gen;
+};
+
+static_assert(sizeof(grow_header) <= shrmem::eGrowHeader, "grow_header doesn't fit");
+
+/// Non-zero if the kernel has MADV_POPULATE_READ and _WRITE, 5.14 and up
+static bool has_populate()
+{
+#if defined(__linux__)
+    // Checked before the range, which is empty
+    static const bool b = !madvise((void*)(std::intptr_t)sysconf(_SC_PAGESIZE), 0, MADV_POPULATE_WRITE);
+    return b;
+#else
+    return false;
+#endif
+}
+
 void shrmem::close()
 {
     // Unmap memory
@@ -53,11 +102,21 @@ void shrmem::close()
         m_pMem = (void*)-1;
     }
     m_sz = 0;
+    m_nOff = 0;
+    m_nGen = 0;
+    m_bGrow = false;
 
-    // Close the share link if we created it
-    if (!m_bExisting && 0 < m_sFile.length())
-    {   shm_unlink(m_sFile.c_str());
+    // Close the share link if we created it, and forget the name either
+    // way, or closing twice would unlink someone else's share
+    if (0 < m_sFile.length())
+    {   if (!m_bExisting && !m_bFile)
+        {   if (m_bHuge)
+                unlink(m_sPath.c_str());
+            else
+                shm_unlink(m_sFile.c_str());
+        }
         m_sFile.clear();
+        m_sPath.clear();
     }
 
     // Close the file handle
@@ -67,10 +126,19 @@ void shrmem::close()
     }
 
     m_bExisting = false;
+    m_bHuge = false;
+    m_bFile = false;
+    m_bReadOnly = false;
 }
 
 
 bool shrmem::open(const t_str &sFile, int64_t sz, bool bCreate)
+{
+    return open(sFile, sz, bCreate, options());
+}
+
+
+bool shrmem::open(const t_str &sFile, int64_t sz, bool bCreate, const options &opt)
 {
     int permissions = 0777;
 
@@ -84,8 +152,41 @@ bool shrmem::open(const t_str &sFile, int64_t sz, bool bCreate)
     if (0 >= sz)
         return false;
 
+    // Huge pages live in a file on hugetlbfs, in whole pages
+    t_str sPath = sFile;
+    if (opt.huge)
+    {
+#if defined(__linux__)
+        struct statfs fs;
+        if (statfs(opt.hugetlbfs.c_str(), &fs) || HUGETLBFS_MAGIC != (unsigned long)fs.f_type)
+        {   ZruWarning("No hugetlbfs at ", opt.hugetlbfs);
+            return false;
+        }
+
+        sPath = opt.hugetlbfs + sFile;
+        sz = (sz + fs.f_bsize - 1) / fs.f_bsize * fs.f_bsize;
+#else
+        ZruWarning("Huge pages are only supported on Linux");
+        return false;
+#endif
+    }
+
+    // Room for the size and generation, hugetlbfs pages can't be remapped larger
+    if (opt.growable)
+    {   if (opt.huge)
+        {   ZruWarning("Huge page shares can't grow : ", sFile);
+            return false;
+        }
+        sz += eGrowHeader;
+    }
+
+    auto fOpen = [&](int flags)
+    {   return (void*)(std::intptr_t)(opt.huge ? ::open(sPath.c_str(), flags, permissions)
+                                               : shm_open(sPath.c_str(), flags, permissions));
+    };
+
     // Try to open existing
-    m_fd = (void*)(std::intptr_t)shm_open(sFile.c_str(), O_RDWR, permissions);
+    m_fd = fOpen(O_RDWR);
     if ((void*)-1 == m_fd)
     {
         // Do we want to create one?
@@ -93,26 +194,174 @@ bool shrmem::open(const t_str &sFile, int64_t sz, bool bCreate)
             return false;
 
         // Try to create a new share
-        m_fd = (void*)(std::intptr_t)shm_open(sFile.c_str(), O_RDWR | O_CREAT, permissions);
+        m_fd = fOpen(O_RDWR | O_CREAT);
         if ((void*)-1 == m_fd)
             return false;
 
-        // Set the size
+        // Ours to remove from here on
+        m_sFile = sFile;
+        m_sPath = sPath;
+        m_bHuge = opt.huge;
+
+        // Set the size, hugetlbfs fails here if there aren't enough free pages
         if (0 > ftruncate((int)(std::intptr_t)m_fd, sz))
-        {   close();
+        {   ZruWarning("ftruncate() failed : ", errno);
+            close();
             return false;
         }
     }
 
-    // Share already exists
+    // Share already exists, mapping past its end would fault on access
     else
-        m_bExisting = true;
+    {   m_bExisting = true;
+
+        struct stat st;
+        if (0 > fstat((int)(std::intptr_t)m_fd, &st) || sz > st.st_size)
+        {   close();
+            return false;
+        }
+
+        // It may have grown
+        if (opt.growable)
+            sz = st.st_size;
+    }
 
     // Save file name
     m_sFile = sFile;
+    m_sPath = sPath;
+    m_bHuge = opt.huge;
+
+    if (!map(sz, opt))
+        return false;
+
+    if (!opt.growable)
+        return true;
+
+    grow_header *h = (grow_header*)m_pMem;
+
+    // A new share is zeroed, generation included
+    if (!m_bExisting)
+    {   h->version = g_nGrowVersion;
+        h->size.store(sz, std::memory_order_relaxed);
+        h->magic.store(g_nGrowMagic, std::memory_order_release);
+    }
+
+    // Give the creator a moment to finish
+    else
+        for (int i = 0; i < 1000 && g_nGrowMagic != h->magic.load(std::memory_order_acquire); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    if (g_nGrowMagic != h->magic.load(std::memory_order_acquire) || g_nGrowVersion != h->version)
+    {   ZruWarning("Not a growable share : ", sFile);
+        close();
+        return false;
+    }
+
+    m_nOff = eGrowHeader;
+    m_bGrow = true;
+
+    // Anything other than the current generation makes remap() look
+    m_nGen = h->gen.load(std::memory_order_acquire) - 1;
+
+    return remap();
+}
+
+
+bool shrmem::grow(int64_t sz)
+{
+    if (!m_bGrow || 0 > sz)
+        return false;
+
+    grow_header *h = (grow_header*)m_pMem;
+    int fd = (int)(std::intptr_t)m_fd;
+    int64_t total = eGrowHeader + sz;
+
+    // One grower at a time, across processes too
+    if (flock(fd, LOCK_EX))
+        return false;
+
+    // Size first, so a process that sees the new generation can map it all
+    bool bOk = true;
+    if (total > h->size.load(std::memory_order_relaxed))
+    {   bOk = !ftruncate(fd, total);
+        if (!bOk)
+        {   ZruWarning("ftruncate() failed : ", errno);
+        }
+        else
+        {   h->size.store(total, std::memory_order_release);
+            h->gen.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    flock(fd, LOCK_UN);
+
+    return bOk && remap();
+}
+
+
+bool shrmem::isStale()
+{
+    return m_bGrow && ((grow_header*)m_pMem)->gen.load(std::memory_order_acquire) != m_nGen;
+}
+
+
+bool shrmem::remap()
+{
+    if ((void*)-1 == m_pMem)
+        return false;
+
+    if (!m_bGrow)
+        return true;
+
+    // Generation before size, a grow sets them the other way around
+    uint64_t nGen = ((grow_header*)m_pMem)->gen.load(std::memory_order_acquire);
+    if (nGen == m_nGen)
+        return true;
+
+    int64_t total = ((grow_header*)m_pMem)->size.load(std::memory_order_acquire);
+    if (total > m_sz)
+    {
+#if defined(__linux__)
+        // Moves the page tables, nothing is copied or faulted again
+        void *p = mremap(m_pMem, m_sz, total, MREMAP_MAYMOVE);
+        if ((void*)-1 == p)
+        {   ZruWarning("mremap() failed : ", errno);
+            return false;
+        }
+#else
+        void *p = mmap(0, total, PROT_READ | PROT_WRITE, MAP_SHARED, (int)(std::intptr_t)m_fd, 0);
+        if ((void*)-1 == p)
+        {   ZruWarning("mmap() failed : ", errno);
+            return false;
+        }
+        munmap(m_pMem, m_sz);
+#endif
+        m_pMem = p;
+        m_sz = total;
+    }
+
+    m_nGen = nGen;
+
+    return true;
+}
+
+
+bool shrmem::map(int64_t sz, const options &opt)
+{
+    // MAP_POPULATE leaves shared pages to write fault again, and places
+    // them before thp or node can be set, so it is only the fallback
+    bool bPopulateAdv = opt.populate && has_populate();
+    int flags = MAP_SHARED;
+#if defined(MAP_POPULATE)
+    bool bMapPopulate = opt.populate && !bPopulateAdv && !opt.thp && 0 > opt.node;
+    if (bMapPopulate)
+        flags |= MAP_POPULATE;
+#else
+    bool bMapPopulate = false;
+#endif
 
     // Map the shared memory
-    m_pMem = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_SHARED, (int)(std::intptr_t)m_fd, 0);
+    m_pMem = mmap(0, sz, m_bReadOnly ? PROT_READ : PROT_READ | PROT_WRITE, flags, (int)(std::intptr_t)m_fd, 0);
     if ((void *)-1 == m_pMem)
     {   close();
         return false;
@@ -121,9 +370,152 @@ bool shrmem::open(const t_str &sFile, int64_t sz, bool bCreate)
     // Save share size
     m_sz = sz;
 
+#if defined(__linux__)
+
+    // These are hints, the share works without them
+    if (opt.thp && madvise(m_pMem, sz, MADV_HUGEPAGE))
+        ZruWarning("madvise(MADV_HUGEPAGE) failed : ", errno);
+
+    if (0 <= opt.node)
+    {
+        unsigned long mask[16] = { 0 };
+        const int nBits = (int)(sizeof(mask) * 8);
+
+        // The kernel reads one bit less than it is told
+        if (nBits - 1 <= opt.node)
+        {   ZruWarning("NUMA node out of range : ", opt.node);
+        }
+
+        else
+        {   mask[opt.node / (sizeof(long) * 8)] |= 1ul << (opt.node % (sizeof(long) * 8));
+            if (syscall(SYS_mbind, m_pMem, (unsigned long)sz, MPOL_BIND, mask, (unsigned long)nBits, 0))
+                ZruWarning("mbind() failed : ", errno);
+        }
+    }
+
+    // A read only map can't take write faults
+    if (bPopulateAdv && madvise(m_pMem, sz, m_bReadOnly ? MADV_POPULATE_READ : MADV_POPULATE_WRITE))
+    {   ZruWarning("madvise(MADV_POPULATE) failed : ", errno);
+        bPopulateAdv = false;
+    }
+
+#endif
+
+    // Reading a page faults it in too
+    if (opt.populate && !bPopulateAdv && !bMapPopulate)
+    {   long nPage = sysconf(_SC_PAGESIZE);
+        for (int64_t i = 0; i < sz; i += nPage)
+            (void)*(volatile char*)((char*)m_pMem + i);
+    }
+
+    if (opt.lock && mlock(m_pMem, sz))
+        ZruWarning("mlock() failed, RLIMIT_MEMLOCK may be too low : ", errno);
+
     return true;
 }
 
+
+bool shrmem::open_file(const t_str &sPath, int64_t sz, int nFlags)
+{
+    return open_file(sPath, sz, nFlags, options());
+}
+
+
+bool shrmem::open_file(const t_str &sPath, int64_t sz, int nFlags, const options &opt)
+{
+    close();
+
+    if (!sPath.length() || 0 > sz)
+        return false;
+
+    if (opt.huge || opt.growable)
+    {   ZruWarning("Huge pages and growing are for shares, not files : ", sPath);
+        return false;
+    }
+
+    bool bReadOnly = 0 != (nFlags & eReadOnly);
+    int flags = bReadOnly ? O_RDONLY : O_RDWR;
+    if (!bReadOnly && (nFlags & eCreate))
+        flags |= O_CREAT;
+
+    int fd = ::open(sPath.c_str(), flags, 0666);
+    if (0 > fd)
+        return false;
+
+    m_fd = (void*)(std::intptr_t)fd;
+    m_sFile = sPath;
+    m_sPath = sPath;
+    m_bFile = true;
+    m_bReadOnly = bReadOnly;
+
+    struct stat st;
+    if (0 > fstat(fd, &st))
+    {   close();
+        return false;
+    }
+
+    // Whole file, or grow it to fit
+    if (!sz)
+        sz = st.st_size;
+    else if (sz > st.st_size && (bReadOnly || 0 > ftruncate(fd, sz)))
+    {   close();
+        return false;
+    }
+
+    // Nothing to map
+    if (!sz)
+    {   close();
+        return false;
+    }
+
+    m_bExisting = 0 < st.st_size;
+
+    return map(sz, opt);
+}
+
+
+bool shrmem::flush(bool bWait, int64_t off, int64_t len)
+{
+    if ((void*)-1 == m_pMem || 0 > off || off > size())
+        return false;
+
+    if (0 > len || off + len > size())
+        len = size() - off;
+    off += m_nOff;
+
+    // msync() wants a page aligned start
+    int64_t nPage = sysconf(_SC_PAGESIZE);
+    int64_t a = off / nPage * nPage;
+
+    return !msync((char*)m_pMem + a, len + off - a, bWait ? MS_SYNC : MS_ASYNC);
+}
+
+
+bool shrmem::advise(int nAdvice, int64_t off, int64_t len)
+{
+    if ((void*)-1 == m_pMem || 0 > off || off > size())
+        return false;
+
+    if (0 > len || off + len > size())
+        len = size() - off;
+    off += m_nOff;
+
+    int adv;
+    switch (nAdvice)
+    {   case eAdviseNormal :        adv = POSIX_MADV_NORMAL; break;
+        case eAdviseSequential :    adv = POSIX_MADV_SEQUENTIAL; break;
+        case eAdviseRandom :        adv = POSIX_MADV_RANDOM; break;
+        case eAdviseWillNeed :      adv = POSIX_MADV_WILLNEED; break;
+        case eAdviseDontNeed :      adv = POSIX_MADV_DONTNEED; break;
+        default :                   return false;
+    }
+
+    int64_t nPage = sysconf(_SC_PAGESIZE);
+    int64_t a = off / nPage * nPage;
+
+    return !posix_madvise((char*)m_pMem + a, len + off - a, adv);
+}
+
 #endif
 
 
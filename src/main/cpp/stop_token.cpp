@@ -0,0 +1,102 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+#include "libzru.h"
+
+namespace zru
+{
+
+/// The calling thread's token
+static stop_token& current_token()
+{
+    thread_local stop_token t;
+    return t;
+}
+
+stop_token stop_token::current()
+{
+    return current_token();
+}
+
+stop_scope::stop_scope(const stop_token &t)
+    : m_prev(current_token())
+{
+    current_token() = t;
+}
+
+stop_scope::~stop_scope()
+{
+    current_token() = m_prev;
+}
+
+bool stop_source::request_stop()
+{
+    if (m_s->stop.exchange(true, std::memory_order_acq_rel))
+        return false;
+
+    // Callbacks can't be removed while they run
+    std::unique_lock<std::mutex> lk(m_s->lock);
+    for (auto f : m_s->cbs)
+        (*f)();
+
+    return true;
+}
+
+stop_callback::stop_callback(const stop_token &t, std::function<void()> f)
+    : m_f(std::move(f))
+{
+    if (!t.m_s)
+        return;
+
+    {   std::unique_lock<std::mutex> lk(t.m_s->lock);
+        if (!t.m_s->stop.load(std::memory_order_acquire))
+        {   m_it = t.m_s->cbs.insert(t.m_s->cbs.end(), &m_f);
+            m_s = t.m_s;
+            return;
+        }
+    }
+
+    // Already stopped
+    m_f();
+}
+
+stop_callback::~stop_callback()
+{
+    if (!m_s)
+        return;
+
+    std::unique_lock<std::mutex> lk(m_s->lock);
+    m_s->cbs.erase(m_it);
+}
+
+} // end namespace
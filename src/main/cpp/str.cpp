@@ -0,0 +1,137 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+#include "libzru.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define ZRU_STR_X86
+#   include <immintrin.h>
+#endif
+
+namespace zru::str
+{
+
+#if defined(ZRU_STR_X86)
+
+/// 16 bytes at a time, compares against each member
+__attribute__((target("sse2")))
+static std::size_t scan_sse2(const char *p, std::size_t n, const char *v, int nv, bool bIn)
+{
+    __m128i m[char_class::max_simd];
+    for (int k = 0; k < nv; k++)
+        m[k] = _mm_set1_epi8(v[k]);
+
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i r = _mm_setzero_si128();
+        for (int k = 0; k < nv; k++)
+            r = _mm_or_si128(r, _mm_cmpeq_epi8(b, m[k]));
+
+        unsigned mask = (unsigned)_mm_movemask_epi8(r);
+        if (!bIn)
+            mask = ~mask & 0xffff;
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i;
+}
+
+/// 32 bytes at a time, compares against each member
+__attribute__((target("avx2")))
+static std::size_t scan_avx2(const char *p, std::size_t n, const char *v, int nv, bool bIn)
+{
+    __m256i m[char_class::max_simd];
+    for (int k = 0; k < nv; k++)
+        m[k] = _mm256_set1_epi8(v[k]);
+
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i r = _mm256_setzero_si256();
+        for (int k = 0; k < nv; k++)
+            r = _mm256_or_si256(r, _mm256_cmpeq_epi8(b, m[k]));
+
+        unsigned mask = (unsigned)_mm256_movemask_epi8(r);
+        if (!bIn)
+            mask = ~mask;
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i;
+}
+
+typedef std::size_t (*pfn_Scan)(const char*, std::size_t, const char*, int, bool);
+
+/// Picks the widest kernel the cpu supports, null if it has none, 32 bit builds can run without sse2
+static pfn_Scan select_scan()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return scan_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return scan_sse2;
+    return 0;
+}
+
+#endif
+
+std::size_t char_class::scan(const char *p, std::size_t n, bool bIn) const
+{
+    const unsigned char *u = (const unsigned char*)p;
+    std::size_t i = 0;
+
+    // Most runs are short, check a few bytes before setting up vectors
+    for (std::size_t e = (8 < n) ? 8 : n; i < e; i++)
+        if (m_t[u[i]] == bIn)
+            return i;
+
+#if defined(ZRU_STR_X86)
+
+    static const pfn_Scan fScan = select_scan();
+    if (fScan && max_simd >= m_n && 16 <= n - i)
+        i += fScan(p + i, n - i, m_v, m_n, bIn);
+
+#endif
+
+    for (; i < n; i++)
+        if (m_t[u[i]] == bIn)
+            return i;
+
+    return n;
+}
+
+} // end namespace
@@ -35,11 +35,16 @@
 #if defined(ZRU_POSIX)
 #   include <unistd.h>
 #   include <signal.h>
+#   if defined(__linux__)
+#       include <sys/syscall.h>
+#       include <linux/futex.h>
+#       include <climits>
+#       include <cerrno>
+#   endif
 #elif defined(ZRU_WINDOWS)
 #   include <windows.h>
 #endif
 
-
 namespace zru
 {
 
@@ -51,7 +56,7 @@ static void ctrl_c_handler(int s)
         exit(1);
     }
 
-    (*g_fCount)++;
+    *g_fCount = *g_fCount + 1;
     ZruWarning("~ ctrl-c ~");
 }
 
@@ -98,4 +103,50 @@ void install_ctrl_c_handler(volatile int *fCount)
 #endif
 
 
+//-------------------------------------------------------------------
+#if defined(__linux__)
+
+bool futex_wait(std::atomic<uint32_t> *p, uint32_t v, long lMs, bool bShared)
+{
+    struct timespec ts, *pts = 0;
+    if (0 <= lMs)
+    {   ts.tv_sec = lMs / 1000;
+        ts.tv_nsec = (lMs % 1000) * 1000000;
+        pts = &ts;
+    }
+
+    int op = bShared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+    if (!syscall(SYS_futex, (uint32_t*)p, op, v, pts, 0, 0))
+        return true;
+
+    return ETIMEDOUT != errno;
+}
+
+void futex_wake(std::atomic<uint32_t> *p, int n, bool bShared)
+{
+    int op = bShared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+    syscall(SYS_futex, (uint32_t*)p, op, 0 > n ? INT_MAX : n, 0, 0, 0);
+}
+
+//-------------------------------------------------------------------
+#else
+
+bool futex_wait(std::atomic<uint32_t> *p, uint32_t v, long lMs, bool /*bShared*/)
+{
+    // No futex, nap in short slices
+    auto tEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(lMs);
+    while (p->load() == v)
+    {   if (0 <= lMs && std::chrono::steady_clock::now() >= tEnd)
+            return false;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return true;
+}
+
+void futex_wake(std::atomic<uint32_t> * /*p*/, int /*n*/, bool /*bShared*/)
+{
+}
+
+#endif
+
 } // end namespace
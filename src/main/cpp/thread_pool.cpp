@@ -0,0 +1,160 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+#include "libzru.h"
+
+namespace zru
+{
+
+/// Pool and worker of the calling thread
+static thread_local thread_pool *g_pPool = 0;
+static thread_local std::size_t g_nWorker = 0;
+
+thread_pool::thread_pool(std::size_t nThreads)
+    : m_nNext(0), m_nPending(0), m_nIdle(0), m_bStop(false)
+{
+    if (!nThreads)
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (std::size_t i = 0; i < nThreads; i++)
+        m_w.emplace_back(new worker(
+            [this, i]() { g_pPool = this; g_nWorker = i; return 0; },
+            [this, i]() { return _run(i); }));
+
+    // Start once every queue exists, threads steal from each other
+    for (auto &w : m_w)
+        w->thread.start();
+}
+
+thread_pool::~thread_pool()
+{
+    {   std::unique_lock<std::mutex> lk(m_lock);
+        m_bStop = true;
+    }
+    m_cv.notify_all();
+
+    // Stop them all first, tasks blocked on a property bag wake together
+    for (auto &w : m_w)
+        w->thread.abort();
+
+    for (auto &w : m_w)
+        w->thread.join();
+}
+
+thread_pool* thread_pool::current()
+{
+    return g_pPool;
+}
+
+void thread_pool::post(t_task f)
+{
+    // Our own threads keep what they spawn, others deal round robin
+    std::size_t i = (this == g_pPool) ? g_nWorker : m_nNext++ % m_w.size();
+
+    // Count it first so the count never goes negative
+    m_nPending++;
+
+    {   std::unique_lock<std::mutex> lk(m_w[i]->lock);
+        m_w[i]->q.push_back(std::move(f));
+    }
+
+    // Pairs with the idle count going up before the sleeper checks m_nPending
+    if (m_nIdle.load())
+    {   { std::unique_lock<std::mutex> lk(m_lock); }
+        m_cv.notify_one();
+    }
+}
+
+bool thread_pool::_take(std::size_t i, t_task &t)
+{
+    if (!m_nPending.load())
+        return false;
+
+    // Newest of our own, it's likely still in cache
+    {   worker &w = *m_w[i];
+        std::unique_lock<std::mutex> lk(w.lock);
+        if (w.q.size())
+        {   t = std::move(w.q.back());
+            w.q.pop_back();
+            m_nPending--;
+            return true;
+        }
+    }
+
+    // Oldest of someone else's
+    for (std::size_t n = 1; n < m_w.size(); n++)
+    {
+        worker &w = *m_w[(i + n) % m_w.size()];
+        std::unique_lock<std::mutex> lk(w.lock, std::try_to_lock);
+        if (lk && w.q.size())
+        {   t = std::move(w.q.front());
+            w.q.pop_front();
+            m_nPending--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int thread_pool::_run(std::size_t i)
+{
+    t_task t;
+    if (_take(i, t))
+    {
+        try
+        {
+            t();
+        }
+        catch(const std::exception &e)
+        {
+            ZruError("Task threw : ", e.what());
+        }
+        catch(...)
+        {
+            ZruError("Task threw an unknown exception");
+        }
+
+        return m_bStop ? -1 : 0;
+    }
+
+    // Nothing to do, sleep until something is posted
+    std::unique_lock<std::mutex> lk(m_lock);
+    m_nIdle++;
+    m_cv.wait_for(lk, std::chrono::milliseconds(100), [this]() { return m_bStop || m_nPending.load(); });
+    m_nIdle--;
+
+    return m_bStop ? -1 : 0;
+}
+
+} // end namespace
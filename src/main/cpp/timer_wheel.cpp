@@ -0,0 +1,309 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+#include "libzru.h"
+
+namespace zru
+{
+
+timer_wheel::timer_wheel(bool bStart, thread_pool *pPool)
+    : m_free(eNil), m_head(eOverflow + 1, eNil), m_nCount(0), m_now(0),
+      m_nRunning(0), m_pPool(pPool), m_t0(std::chrono::steady_clock::now()),
+      m_bClock(bStart), m_wakeAt(0), m_thread([this]() { return _thread(); }, false)
+{
+    if (bStart)
+        m_thread.start();
+}
+
+timer_wheel::~timer_wheel()
+{
+    m_thread.stop();
+    m_wake.signal_all();
+    m_thread.join();
+
+    while (m_nRunning.load())
+        std::this_thread::yield();
+}
+
+timer_wheel::t_id timer_wheel::add(pfn_Timer f, long lMs)
+{
+    std::unique_lock<std::mutex> lk(m_lock);
+
+    uint32_t i = m_free;
+    if (eNil != i)
+        m_free = m_t[i].next;
+    else
+    {   i = (uint32_t)m_t.size();
+        m_t.push_back(timer());
+        m_t[i].gen = 0;
+    }
+
+    timer &t = m_t[i];
+    t.f = std::move(f);
+    t.due = _due(lMs);
+    t.bCancel = false;
+    _link(i);
+    m_nCount++;
+
+    // Wake the thread if it means to sleep past this one
+    bool bWake = m_bClock && t.due < m_wakeAt;
+    t_id id = ((t_id)t.gen << 32) | i;
+
+    lk.unlock();
+
+    if (bWake)
+        m_wake.signal_one();
+
+    return id;
+}
+
+bool timer_wheel::remove(t_id id)
+{
+    std::unique_lock<std::mutex> lk(m_lock);
+
+    uint32_t i = (uint32_t)id;
+    if (i >= m_t.size() || m_t[i].gen != (uint32_t)(id >> 32) || eFree == m_t[i].slot)
+        return false;
+
+    // It goes when it comes back
+    if (eRunning == m_t[i].slot)
+    {   m_t[i].bCancel = true;
+        return true;
+    }
+
+    _unlink(i);
+    _free(i);
+
+    return true;
+}
+
+std::size_t timer_wheel::size()
+{
+    std::unique_lock<std::mutex> lk(m_lock);
+    return m_nCount;
+}
+
+std::size_t timer_wheel::tick(long nMs)
+{
+    std::unique_lock<std::mutex> lk(m_lock);
+    return _advance(lk, m_now + std::max(0L, nMs));
+}
+
+int32_t timer_wheel::_slot(uint64_t due) const
+{
+    uint64_t d = due - m_now;
+    if (d < eSlots0)
+        return (int32_t)(due & (eSlots0 - 1));
+
+    for (int l = 1; l < (int)eLevels; l++)
+        if (d < ((uint64_t)eSlots0 << (eBits * l)))
+            return eSlots0 + (l - 1) * eSlots + (int32_t)((due >> (eBits0 + eBits * (l - 1))) & (eSlots - 1));
+
+    return eOverflow;
+}
+
+void timer_wheel::_link(uint32_t i)
+{
+    timer &t = m_t[i];
+
+    t.slot = _slot(t.due);
+    t.prev = eNil;
+    t.next = m_head[t.slot];
+    if (eNil != t.next)
+        m_t[t.next].prev = i;
+    m_head[t.slot] = i;
+}
+
+void timer_wheel::_unlink(uint32_t i)
+{
+    timer &t = m_t[i];
+
+    if (eNil != t.prev)
+        m_t[t.prev].next = t.next;
+    else
+        m_head[t.slot] = t.next;
+
+    if (eNil != t.next)
+        m_t[t.next].prev = t.prev;
+}
+
+void timer_wheel::_free(uint32_t i)
+{
+    timer &t = m_t[i];
+    t.f = pfn_Timer();
+    t.slot = eFree;
+    t.gen++;
+    t.next = m_free;
+    m_free = i;
+    m_nCount--;
+}
+
+void timer_wheel::_relink(int32_t s)
+{
+    uint32_t i = m_head[s];
+    m_head[s] = eNil;
+
+    while (eNil != i)
+    {   uint32_t n = m_t[i].next;
+        _link(i);
+        i = n;
+    }
+}
+
+void timer_wheel::_cascade(int l)
+{
+    int32_t idx = (int32_t)((m_now >> (eBits0 + eBits * (l - 1))) & (eSlots - 1));
+
+    // The level above wraps too
+    if (!idx)
+    {   if (l + 1 < (int)eLevels)
+            _cascade(l + 1);
+        else
+            _relink(eOverflow);
+    }
+
+    _relink(eSlots0 + (l - 1) * eSlots + idx);
+}
+
+std::size_t timer_wheel::_advance(std::unique_lock<std::mutex> &lk, uint64_t now)
+{
+    std::size_t n = 0;
+    std::vector<job> v;
+
+    while (m_now < now)
+    {
+        // Nothing to do, the slots don't care where we stop
+        if (!m_nCount)
+        {   m_now = now;
+            break;
+        }
+
+        m_now++;
+
+        if (!(m_now & (eSlots0 - 1)))
+            _cascade(1);
+
+        int32_t s = (int32_t)(m_now & (eSlots0 - 1));
+        for (uint32_t i = m_head[s]; eNil != i; i = m_t[i].next)
+        {   m_t[i].slot = eRunning;
+            v.push_back({ i, std::move(m_t[i].f) });
+        }
+        m_head[s] = eNil;
+
+        if (!v.size())
+            continue;
+
+        n += v.size();
+
+        lk.unlock();
+
+        for (auto &j : v)
+            if (m_pPool)
+            {   m_nRunning++;
+                m_pPool->post([this, j]() mutable { _run(j); m_nRunning--; });
+            }
+            else
+                _run(j);
+
+        v.clear();
+
+        lk.lock();
+    }
+
+    return n;
+}
+
+void timer_wheel::_run(job &j)
+{
+    int r = j.f();
+
+    std::unique_lock<std::mutex> lk(m_lock);
+
+    timer &t = m_t[j.i];
+    if (0 > r || t.bCancel)
+    {   _free(j.i);
+        return;
+    }
+
+    t.f = std::move(j.f);
+    t.due = _due(r);
+    _link(j.i);
+}
+
+uint64_t timer_wheel::_due(long lMs) const
+{
+    uint64_t now = m_bClock ? std::max(m_now, _clock()) : m_now;
+
+    // Never in the slot we are on, that would be a full turn late
+    return std::max(now + std::max(0L, lMs), m_now + 1);
+}
+
+long timer_wheel::_next() const
+{
+    if (!m_nCount)
+        return 1000;
+
+    // The first busy slot before the next cascade
+    long n = 1;
+    for (uint64_t t = m_now + 1; n < eSlots0; t++, n++)
+        if (!(t & (eSlots0 - 1)) || eNil != m_head[t & (eSlots0 - 1)])
+            break;
+
+    return n;
+}
+
+uint64_t timer_wheel::_clock() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_t0).count();
+}
+
+int timer_wheel::_thread()
+{
+    m_wake.reset();
+
+    if (!m_thread.wantRun())
+        return -1;
+
+    long ms;
+    {   std::unique_lock<std::mutex> lk(m_lock);
+        _advance(lk, _clock());
+        ms = _next();
+        m_wakeAt = m_now + ms;
+    }
+
+    m_wake.wait_ms(ms);
+
+    return 0;
+}
+
+} // end namespace
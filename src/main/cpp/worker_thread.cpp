@@ -32,13 +32,68 @@
 
 #include "libzru.h"
 
+#include <set>
+
 #if defined(ZRU_POSIX)
-#   include <signal.h>
+#   include <pthread.h>
+#   include <sched.h>
+#   include <unistd.h>
+#   include <sys/resource.h>
+#   include <cerrno>
+#   if defined(__linux__)
+#       include <sys/syscall.h>
+#   endif
+#elif defined(ZRU_WINDOWS)
+#   include <windows.h>
 #endif
 
 namespace zru
 {
 
+#if defined(__linux__)
+
+bool signal::wait_ms(long lMs)
+{
+    // A poll doesn't spin
+    if (m_v.load(std::memory_order_acquire) || 0 >= lMs)
+        return m_v.load(std::memory_order_relaxed);
+
+    // Spin a little longer than recent waits needed
+    int s = m_nSpin.load(std::memory_order_relaxed);
+    int nMax = std::min(m_nMaxSpin, s * 2 + 10);
+    for (int i = 0; i < nMax; i++)
+    {
+        cpu_relax();
+        if (m_v.load(std::memory_order_acquire))
+        {   m_nSpin.store(s + (i - s) / 8, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Didn't pay off, spin less next time
+    if (nMax)
+        m_nSpin.store(s - s / 8 - 1 < 0 ? 0 : s - s / 8 - 1, std::memory_order_relaxed);
+
+    auto tEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(lMs);
+
+    m_nWaiters++;
+
+    while (!m_v.load())
+    {
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(tEnd - std::chrono::steady_clock::now()).count();
+        if (0 >= ms)
+            break;
+
+        futex_wait(&m_v, 0, ms);
+    }
+
+    m_nWaiters--;
+
+    return m_v.load();
+}
+
+#endif
+
 worker_thread::~worker_thread()
 {
     join();
@@ -51,6 +106,24 @@ worker_thread::worker_thread()
     m_fRun = 0;
     m_fEnd = 0;
     m_bRun = false;
+
+    m_nIterations = 0;
+    m_nBusy = 0;
+    m_nIdle = 0;
+    m_nMax = 0;
+    m_nRunStart = 0;
+    for (auto &h : m_hist)
+        h = 0;
+}
+
+/// Live threads, for all_stats()
+static std::mutex& registry_lock() { static std::mutex m; return m; }
+static std::set<const worker_thread*>& registry() { static std::set<const worker_thread*> s; return s; }
+
+/// Steady clock in ns
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 worker_thread::worker_thread(pfn_Worker fRun, bool bStart)
@@ -73,6 +146,28 @@ worker_thread::worker_thread(pfn_Worker fInit, pfn_Worker fRun, pfn_Worker fEnd,
         start();
 }
 
+worker_thread::worker_thread(pfn_Worker fRun, const options &opt, bool bStart)
+    : worker_thread()
+{
+    m_fRun = fRun;
+    m_opt = opt;
+
+    if (bStart)
+        start();
+}
+
+worker_thread::worker_thread(pfn_Worker fInit, pfn_Worker fRun, pfn_Worker fEnd, const options &opt, bool bStart)
+    : worker_thread()
+{
+    m_fInit = fInit;
+    m_fRun = fRun;
+    m_fEnd = fEnd;
+    m_opt = opt;
+
+    if (bStart)
+        start();
+}
+
 bool worker_thread::wait(int nMs)
 {
     if (0 >= nMs)
@@ -88,41 +183,64 @@ bool worker_thread::wait(int nMs)
 
 void worker_thread::Run()
 {
-    init();
+    set_options(m_opt);
 
-    try
-    {
-        // Convince compiler that an exception might happen
-        worker_thread::init_exceptions();
+    // Blocking calls on this thread watch our token
+    stop_scope sc(m_stop.get_token());
 
+    // Listed while the thread runs, however it leaves
+    struct listed
+    {   const worker_thread *p;
+        listed(const worker_thread *x) : p(x) { std::unique_lock<std::mutex> lk(registry_lock()); registry().insert(p); }
+        ~listed() { std::unique_lock<std::mutex> lk(registry_lock()); registry().erase(p); }
+    } l(this);
+
+    do
+    {
         if (m_fInit)
             if (0 > m_fInit())
-                return;
+                break;
+
+        // One clock read per run, the end of one run starts the next
+        bool bStats = m_opt.stats;
+        uint64_t t = bStats ? now_ns() : 0;
 
         if (m_fRun)
             do
             {
                 // Call the run function
+                if (bStats)
+                    m_nRunStart.store(t, std::memory_order_relaxed);
+
                 int nDelay = m_fRun();
 
+                uint64_t t2 = 0;
+                if (bStats)
+                {   t2 = now_ns();
+                    m_nRunStart.store(0, std::memory_order_relaxed);
+                    _count(t2 - t);
+                    t = t2;
+                }
+
                 // Does the callee want to quit?
                 if (0 > nDelay)
                     m_bRun = false;
 
                 // Do they want a delay?
                 else if (0 < nDelay)
-                    wait(nDelay);
+                {   wait(nDelay);
+                    if (bStats)
+                    {   t = now_ns();
+                        _add(m_nIdle, t - t2);
+                    }
+                }
 
             } while (m_bRun);
 
         if (m_fEnd)
             m_fEnd();
 
-    }
-
-    catch(throw_abort)
-    {
-    }
+    } while (0);
 
     // Notify that we're leaving
     {
@@ -134,6 +252,69 @@ void worker_thread::Run()
     m_cvLock.notify_all();
 }
 
+void worker_thread::_count(uint64_t nNs)
+{
+    _add(m_nIterations, 1);
+    _add(m_nBusy, nNs);
+
+    if (nNs > m_nMax.load(std::memory_order_relaxed))
+        m_nMax.store(nNs, std::memory_order_relaxed);
+
+    // Bucket by the highest bit of the run time in us
+    uint64_t us = nNs / 1000;
+    int b = 0;
+    while (us && b < eHistBuckets - 1)
+        us >>= 1, b++;
+
+    _add(m_hist[b], 1);
+}
+
+worker_thread::stats_info worker_thread::stats() const
+{
+    stats_info si;
+    si.name = m_opt.name;
+    si.iterations = m_nIterations.load(std::memory_order_relaxed);
+    si.busy_ns = m_nBusy.load(std::memory_order_relaxed);
+    si.idle_ns = m_nIdle.load(std::memory_order_relaxed);
+    si.max_ns = m_nMax.load(std::memory_order_relaxed);
+
+    uint64_t t = m_nRunStart.load(std::memory_order_relaxed);
+    if (t)
+    {   uint64_t n = now_ns();
+        si.running_ns = n > t ? n - t : 0;
+    }
+
+    for (auto &h : m_hist)
+        si.hist.push_back(h.load(std::memory_order_relaxed));
+
+    return si;
+}
+
+property_bag worker_thread::all_stats()
+{
+    property_bag pb;
+
+    std::unique_lock<std::mutex> lk(registry_lock());
+    for (auto p : registry())
+    {
+        stats_info si = p->stats();
+
+        property_bag r;
+        r["name"] = si.name;
+        r["iterations"] = (long long)si.iterations;
+        r["busy_ns"] = (long long)si.busy_ns;
+        r["idle_ns"] = (long long)si.idle_ns;
+        r["max_ns"] = (long long)si.max_ns;
+        r["running_ns"] = (long long)si.running_ns;
+        for (auto h : si.hist)
+            r["hist"].push((long long)h);
+
+        pb.push(std::move(r));
+    }
+
+    return pb;
+}
+
 bool worker_thread::start()
 {
     if (m_pThread)
@@ -142,6 +323,10 @@ bool worker_thread::start()
     m_bRun = true;
     m_bQuitting = false;
 
+    // A token only stops once
+    if (m_stop.stop_requested())
+        m_stop = stop_source();
+
     // Create thread
     m_pThread = new (m_vThread) std::thread([this](){ Run(); });
 
@@ -196,75 +381,126 @@ bool worker_thread::abort()
     if (!m_pThread)
         return false;
 
-#if defined(ZRU_WINDOWS)
+    // Used to throw from a signal handler, which could leave locks held and the heap broken
+    stop();
 
-    bool bSuccess = false;
-    HANDLE h = m_pThread->native_handle();
-    if (INVALID_HANDLE_VALUE == h)
-        return false;
+    // Wake anything the thread is blocked on
+    m_stop.request_stop();
 
-    if (INFINITE == SuspendThread(h))
-        return false;
+    return true;
+}
 
-    CONTEXT ctx;
-    ctx.ContextFlags = CONTEXT_CONTROL;
-    if (GetThreadContext(h, &ctx))
-    {
-#   if defined( _WIN64 )
-        ctx.Rip = (DWORD)(DWORD_PTR)throw_exception;
-#   else
-        ctx.Eip = (DWORD)(DWORD_PTR)throw_exception;
-#   endif
+#if defined(__linux__)
 
-        bSuccess = SetThreadContext(h, &ctx) ? true : false;
-    }
+bool worker_thread::set_options(const options &opt)
+{
+    bool bRet = true;
 
-    ResumeThread(h);
+    if (opt.name.length())
+        if (int e = pthread_setname_np(pthread_self(), opt.name.substr(0, 15).c_str()))
+        {   ZruWarning("pthread_setname_np() failed : ", e);
+            bRet = false;
+        }
 
-    return bSuccess;
+    if (opt.cpus.size())
+    {
+        cpu_set_t cs;
+        CPU_ZERO(&cs);
+        for (int c : opt.cpus)
+            if (0 <= c && CPU_SETSIZE > c)
+                CPU_SET(c, &cs);
+
+        if (int e = pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs))
+        {   ZruWarning("pthread_setaffinity_np() failed : ", e);
+            bRet = false;
+        }
+    }
 
-#elif defined(ZRU_POSIX)
+    if (eSchedDefault != opt.policy)
+    {
+        int policy = eSchedFifo == opt.policy ? SCHED_FIFO
+                   : eSchedRR == opt.policy ? SCHED_RR
+                   : SCHED_OTHER;
 
-    pthread_kill(m_pThread->native_handle(), SIGUSR2);
+        struct sched_param sp;
+        sp.sched_priority = SCHED_OTHER == policy ? 0 : opt.priority;
 
-#endif
+        if (int e = pthread_setschedparam(pthread_self(), policy, &sp))
+        {   ZruWarning("pthread_setschedparam() failed : ", e);
+            bRet = false;
+        }
+    }
 
-    return false;
-}
+    // Linux applies this to the thread, not the process
+    if (opt.nice)
+        if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), opt.nice))
+        {   ZruWarning("setpriority() failed : ", errno);
+            bRet = false;
+        }
 
-void worker_thread::throw_exception() noexcept(false)
-{
-    throw throw_abort();
+    return bRet;
 }
 
-void worker_thread::init_exceptions()
+#elif defined(ZRU_WINDOWS)
+
+bool worker_thread::set_options(const options &opt)
 {
-    volatile int i = 0;
-    if (i)
-        throw_exception();
+    bool bRet = true;
+
+    if (opt.cpus.size())
+    {
+        DWORD_PTR mask = 0;
+        for (int c : opt.cpus)
+            if (0 <= c && (int)(sizeof(mask) * 8) > c)
+                mask |= (DWORD_PTR)1 << c;
+
+        if (!SetThreadAffinityMask(GetCurrentThread(), mask))
+        {   ZruWarning("SetThreadAffinityMask() failed : ", GetLastError());
+            bRet = false;
+        }
+    }
+
+    int pri = (eSchedFifo == opt.policy || eSchedRR == opt.policy) ? THREAD_PRIORITY_TIME_CRITICAL
+            : (0 > opt.nice) ? THREAD_PRIORITY_ABOVE_NORMAL
+            : (0 < opt.nice) ? THREAD_PRIORITY_BELOW_NORMAL
+            : THREAD_PRIORITY_NORMAL;
+
+    if (THREAD_PRIORITY_NORMAL != pri && !SetThreadPriority(GetCurrentThread(), pri))
+    {   ZruWarning("SetThreadPriority() failed : ", GetLastError());
+        bRet = false;
+    }
+
+    return bRet;
 }
 
-#if defined(ZRU_POSIX)
+#else
 
-void worker_thread::worker_thread_sig(int sig)
+bool worker_thread::set_options(const options &opt)
 {
-    if(SIGUSR2 == sig)
-        throw throw_abort();
+    bool bRet = true;
+
+    if (eSchedDefault != opt.policy)
+    {
+        int policy = eSchedFifo == opt.policy ? SCHED_FIFO
+                   : eSchedRR == opt.policy ? SCHED_RR
+                   : SCHED_OTHER;
+
+        struct sched_param sp;
+        sp.sched_priority = SCHED_OTHER == policy ? 0 : opt.priority;
+
+        if (int e = pthread_setschedparam(pthread_self(), policy, &sp))
+        {   ZruWarning("pthread_setschedparam() failed : ", e);
+            bRet = false;
+        }
+    }
+
+    return bRet;
 }
 
 #endif
 
 void worker_thread::init()
 {
-#if defined(ZRU_POSIX)
-
-    struct sigaction sa;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    sa.sa_handler = worker_thread_sig;
-    sigaction(SIGUSR2, &sa, 0);
-
-#endif
 }
 
 } // end namespace
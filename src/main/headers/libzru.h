@@ -33,6 +33,8 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <algorithm>
 #include <sstream>
 #include <vector>
 #include <locale>
@@ -41,9 +43,12 @@
 #include <iomanip>
 #include <initializer_list>
 #include <list>
+#include <deque>
 #include <map>
+#include <optional>
 #include <functional>
 #include <mutex>
+#include <shared_mutex>
 #include <condition_variable>
 #include <chrono>
 #include <cstdint>
@@ -65,8 +70,17 @@ namespace zru
 #include "libzru/any.h"
 #include "libzru/str.h"
 #include "libzru/md5.h"
+#include "libzru/flat_map.h"
+#include "libzru/mpmc_queue.h"
+#include "libzru/stop_token.h"
 #include "libzru/property_bag.h"
 #include "libzru/parsers.h"
 #include "libzru/shrmem.h"
+#include "libzru/shm_ring.h"
+#include "libzru/shm_arena.h"
+#include "libzru/shm_map.h"
 #include "libzru/worker_thread.h"
+#include "libzru/thread_pool.h"
+#include "libzru/timer_wheel.h"
+#include "libzru/coro.h"
 
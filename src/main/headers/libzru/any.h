@@ -167,6 +167,9 @@ namespace zru
         // Copy constructor
         any(const any& r) : any() { (*this) = r; }
 
+        // Move constructor
+        any(any&& r) noexcept : any() { take(r); }
+
         // Default destructor
         ~any() { clear(); }
 
@@ -237,9 +240,12 @@ namespace zru
 
         any& set(any& v, const any& r)
         {
+            if (&v == &r)
+                return v;
+
             switch(r.getType())
             {
-                default : break;
+                default : v.clear(); break;
                 case at_bool : v.set_bool(r.vBool); break;
                 case at_char : v.set_char(r.vChar); break;
                 case at_uchar : v.set_uchar(r.vUChar); break;
@@ -268,6 +274,23 @@ namespace zru
             return set(*this, r);
         }
 
+        any& operator = (any&& r) noexcept
+        {
+            if (this != &r)
+            {   clear();
+                take(r);
+            }
+            return *this;
+        }
+
+        /// Exchanges values, strings and vectors are moved rather than copied
+        void swap(any &r) noexcept
+        {
+            any t(std::move(r));
+            r = std::move(*this);
+            *this = std::move(t);
+        }
+
         static any& inc(any& v, const any &r)
         {
             switch(v.getType())
@@ -350,7 +373,7 @@ namespace zru
             return dec(*this, 1);
         }
 
-        bool eq(any& v, const any& r)
+        static bool eq(const any& v, const any& r)
         {
             switch(r.getType())
             {
@@ -377,7 +400,7 @@ namespace zru
             return false;
         }
 
-        bool operator == (const any &r)
+        bool operator == (const any &r) const
         {
             return eq(*this, r);
         }
@@ -690,6 +713,9 @@ namespace zru
         any& set_string(const t_str &v) { make(at_string); (*pString) = v; return *this; }
         any& operator =(const char *v) { make(at_string); (*pString) = v; return *this; }
         any& set_char_ptr(const char *v) { make(at_string); (*pString) = v; return *this; }
+        any(t_str &&v) : any() { make(at_string); (*pString) = std::move(v); }
+        any& operator =(t_str &&v) { make(at_string); (*pString) = std::move(v); return *this; }
+        any& set_string(t_str &&v) { make(at_string); (*pString) = std::move(v); return *this; }
         t_str toString() const
         {
             try
@@ -766,6 +792,9 @@ namespace zru
         any& set_wstring(const t_wstr &v) { make(at_wstring); (*pWString) = v; return *this; }
         any& operator =(const wchar_t *v) { make(at_wstring); (*pWString) = v; return *this; }
         any& set_wchar_ptr(const wchar_t *v) { make(at_wstring); (*pWString) = v; return *this; }
+        any(t_wstr &&v) : any() { make(at_wstring); (*pWString) = std::move(v); }
+        any& operator =(t_wstr &&v) { make(at_wstring); (*pWString) = std::move(v); return *this; }
+        any& set_wstring(t_wstr &&v) { make(at_wstring); (*pWString) = std::move(v); return *this; }
         t_wstr toWString() const
         {
             switch(type)
@@ -800,6 +829,9 @@ namespace zru
         any(const vector &v) : any() { make(typeOf(v)); (*pVector) = v; }
         any& operator =(const vector &v) { make(typeOf(v)); (*pVector) = v; return *this; }
         any& set_vector(const vector &v) { make(typeOf(v)); (*pVector) = v; return *this; }
+        any(vector &&v) : any() { make(at_vector); (*pVector) = std::move(v); }
+        any& operator =(vector &&v) { make(at_vector); (*pVector) = std::move(v); return *this; }
+        any& set_vector(vector &&v) { make(at_vector); (*pVector) = std::move(v); return *this; }
         vector toVector()
         {
             switch(type)
@@ -815,6 +847,23 @@ namespace zru
             return vector();
         }
 
+    private:
+
+        /// Moves the value out of r, leaving r void, we must be void
+        void take(any &r) noexcept
+        {
+            switch(r.type)
+            {
+                default : memcpy(&vULongLong, &r.vULongLong, sizeof(vULongLong)); break;
+                case at_void : break;
+                case at_string : pString = new(&vString) t_str(std::move(*r.pString)); break;
+                case at_wstring : pWString = new(&vWString) t_wstr(std::move(*r.pWString)); break;
+                case at_vector : pVector = new(&vVector) vector(std::move(*r.pVector)); break;
+            }
+            type = r.type;
+            r.clear();
+        }
+
     private:
 
         union
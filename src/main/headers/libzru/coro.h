@@ -0,0 +1,296 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+#pragma once
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#   define ZRU_COROUTINES
+#endif
+
+#if defined(ZRU_COROUTINES)
+
+#include <coroutine>
+#include <memory>
+#include <mutex>
+
+namespace zru
+{
+
+/// Fire and forget coroutine
+/**
+    Runs on the calling thread up to its first co_await, then on
+    whichever pool the awaitable resumes it on. Awaitables resume on
+    the pool they were awaited from, or co_pool() when that wasn't a
+    pool thread. Nothing holds a thread while a coroutine waits, so
+    thousands of them can share a few threads.
+
+    Keep what the coroutine needs in its parameters, a coroutine
+    lambda's captures belong to the lambda and not to the frame.
+
+    @code
+        zru::co_task worker(zru::thread_pool &tp)
+        {
+            co_await zru::co_schedule(tp);
+            zru::property_bag p;
+            while (co_await zru::co_pop(zru::pb, p, ".", "jobs", 60000))
+                run(p);
+        }
+    @endcode
+*/
+class co_task
+{
+public:
+
+    struct promise_type
+    {
+        co_task get_return_object() { return co_task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+
+        void unhandled_exception()
+        {
+            try { throw; }
+            catch (const std::exception &e) { ZruError("Coroutine threw : ", e.what()); }
+            catch (...) { ZruError("Coroutine threw"); }
+        }
+    };
+};
+
+/// Pool awaitables resume on when they weren't awaited from a pool thread
+inline thread_pool& co_pool()
+{
+    static thread_pool tp;
+    return tp;
+}
+
+/// Times out awaitables
+inline timer_wheel& co_timers()
+{
+    // The pool must outlive the wheel that posts to it
+    co_pool();
+    static timer_wheel tw;
+    return tw;
+}
+
+/// Moves the coroutine onto a pool
+class co_schedule
+{
+public:
+
+    explicit co_schedule(thread_pool &tp) : m_tp(tp) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) { m_tp.post([h]() { h.resume(); }); }
+
+    void await_resume() const noexcept {}
+
+private:
+
+    /// Where to go
+    thread_pool         &m_tp;
+};
+
+/// Awaits a property_bag_ts key change or pop, see co_wait() and co_pop()
+/**
+    Co_awaiting it gives true if the key changed or a value was
+    popped, false on timeout. A timeout of zero doesn't wait.
+*/
+class co_pb_await
+{
+    /// Shared with the callbacks, which can outlive the awaiter
+    struct state
+    {
+        std::mutex                      lock;
+
+        /// Set once the coroutine is on its way back
+        bool                            done = false;
+        bool                            result = false;
+
+        /// Set when the timeout fired with a change on its way
+        bool                            expired = false;
+
+        std::coroutine_handle<>         h;
+        thread_pool                     *tp = 0;
+
+        property_bag_ts                 *pb = 0;
+        property_bag                    *p = 0;
+        t_str                           sep;
+        property_bag_ts::t_strlist                       keys;
+
+        /// Current hook and timeout
+        property_bag_ts::t_pbwptr       pbw;
+        timer_wheel::t_id               timer = 0;
+
+        /// Hooks the keys, returns false if a value was popped, call with lock held
+        bool hook(const std::shared_ptr<state> &s)
+        {
+            // Runs with the shard locked, so just pass it on
+            auto f = [s]() { s->tp->post([s]() { changed(s); }); };
+
+            pb->async_cancel(pbw);
+            pbw = p ? pb->async_pop(*p, sep, keys.front(), f)
+                    : pb->async_wait_multiple(sep, keys, f);
+            return pbw ? true : false;
+        }
+
+        /// A hooked key changed, a pop has to try again
+        static void changed(const std::shared_ptr<state> &s)
+        {
+            std::unique_lock<std::mutex> lk(s->lock);
+            if (s->done)
+                return;
+            if (!s->p)
+                s->finish(true);
+
+            // Past the timeout, one last try without hooking again
+            else if (s->expired)
+                s->finish(s->pb->pop(*s->p, s->sep, s->keys.front(), 0));
+
+            else if (!s->hook(s))
+                s->finish(true);
+        }
+
+        /// The timeout fired
+        static void timeout(const std::shared_ptr<state> &s)
+        {
+            std::unique_lock<std::mutex> lk(s->lock);
+            if (s->done)
+                return;
+
+            // Unhook first, a signal-one change must not land on a hook
+            // nobody is waiting on any more
+            s->pb->async_cancel(s->pbw);
+
+            // It took one already, changed() is on its way to finish
+            if (s->pbw && s->pbw->has_fired())
+                s->expired = true;
+            else
+                s->finish(false);
+        }
+
+        /// Sends the coroutine back once, call with lock held
+        void finish(bool r)
+        {
+            if (done)
+                return;
+            done = true;
+            result = r;
+            auto hh = h;
+            tp->post([hh]() { hh.resume(); });
+        }
+    };
+
+public:
+
+    co_pb_await(property_bag_ts &pb, property_bag *p, const t_str &sSep, const property_bag_ts::t_strlist &keys, property_bag::t_size uTimeout)
+        : m_s(std::make_shared<state>()), m_uTimeout(uTimeout)
+    {
+        m_s->pb = &pb;
+        m_s->p = p;
+        m_s->sep = sSep;
+        m_s->keys = keys;
+    }
+
+    bool await_ready()
+    {
+        if (m_uTimeout && m_s->keys.size())
+            return false;
+
+        // Nothing to wait for
+        m_s->result = m_s->p && m_s->keys.size() ? m_s->pb->pop(*m_s->p, m_s->sep, m_s->keys.front(), 0) : false;
+        return true;
+    }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        // Once the lock is released the coroutine may already be running elsewhere
+        auto s = m_s;
+        s->h = h;
+        s->tp = thread_pool::current() ? thread_pool::current() : &co_pool();
+
+        std::unique_lock<std::mutex> lk(s->lock);
+
+        if (!s->hook(s))
+        {   s->done = s->result = true;
+            return false;
+        }
+
+        s->timer = co_timers().add([s]() { state::timeout(s); return -1; }, (long)m_uTimeout);
+
+        return true;
+    }
+
+    bool await_resume()
+    {
+        property_bag_ts::t_pbwptr pbw;
+        timer_wheel::t_id t = 0;
+
+        {   std::unique_lock<std::mutex> lk(m_s->lock);
+            pbw.swap(m_s->pbw);
+            std::swap(t, m_s->timer);
+        }
+
+        // The hook's callback holds the state, unhooking breaks the cycle
+        m_s->pb->async_cancel(pbw);
+        if (t)
+            co_timers().remove(t);
+
+        return m_s->result;
+    }
+
+private:
+
+    /// Shared state
+    std::shared_ptr<state>          m_s;
+
+    /// Timeout in ms
+    property_bag::t_size            m_uTimeout;
+};
+
+/// Awaits a change to the key or anything below it
+inline co_pb_await co_wait(property_bag_ts &pb, const t_str &sSep, const t_str &sKey, property_bag::t_size uTimeout)
+{   return co_pb_await(pb, 0, sSep, { sKey }, uTimeout); }
+
+/// Awaits a change to any of the keys
+inline co_pb_await co_wait_multiple(property_bag_ts &pb, const t_str &sSep, const property_bag_ts::t_strlist &keys, property_bag::t_size uTimeout)
+{   return co_pb_await(pb, 0, sSep, keys, uTimeout); }
+
+/// Awaits a value to pop into p
+inline co_pb_await co_pop(property_bag_ts &pb, property_bag &p, const t_str &sSep, const t_str &sKey, property_bag::t_size uTimeout)
+{   return co_pb_await(pb, &p, sSep, { sKey }, uTimeout); }
+
+} // end namespace
+
+#endif
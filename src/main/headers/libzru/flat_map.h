@@ -0,0 +1,353 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <cstdint>
+#include <functional>
+
+namespace zru
+{
+
+/// Map kept in a single vector in insertion order
+/**
+    Lookups scan a packed array of hashes while the map is small,
+    past t_small keys an open addressing index of positions is added.
+    Erasing only marks the element dead, lookups and iteration step
+    over it, and the vector is compacted once half of it is dead. So
+    using the map as a queue, or erasing keys one by one, stays cheap.
+
+    Unlike std::map, inserting may move the elements, references and
+    iterators are only good until the next insert or erase.
+*/
+template<typename K, typename V, typename t_hash = std::hash<K> >
+    class flat_map
+    {
+    public:
+
+        typedef std::pair<K, V> value_type;
+
+        typedef std::vector<value_type> t_vector;
+
+        /// Walks the live elements in insertion order
+        template<typename t_map, typename t_value>
+            class iterator_t
+            {
+            public:
+
+                typedef t_value value_type;
+                typedef t_value& reference;
+                typedef t_value* pointer;
+                typedef std::ptrdiff_t difference_type;
+                typedef std::forward_iterator_tag iterator_category;
+
+                iterator_t() : m_m(0), m_i(0) {}
+
+                iterator_t(t_map *m, std::size_t i) : m_m(m), m_i(i) {}
+
+                /// Allows iterator to const_iterator
+                template<typename t_map2, typename t_value2>
+                    iterator_t(const iterator_t<t_map2, t_value2> &r) : m_m(r.m_m), m_i(r.m_i) {}
+
+                reference operator *() const { return m_m->m_e[m_i]; }
+
+                pointer operator ->() const { return &m_m->m_e[m_i]; }
+
+                iterator_t& operator ++() { m_i = m_m->_next(m_i + 1); return *this; }
+
+                iterator_t operator ++(int) { iterator_t r(*this); ++(*this); return r; }
+
+                bool operator ==(const iterator_t &r) const { return m_i == r.m_i; }
+
+                bool operator !=(const iterator_t &r) const { return m_i != r.m_i; }
+
+            private:
+
+                template<typename, typename> friend class iterator_t;
+                friend class flat_map;
+
+                t_map                       *m_m;
+                std::size_t                 m_i;
+            };
+
+        typedef iterator_t<flat_map, value_type> iterator;
+
+        typedef iterator_t<const flat_map, const value_type> const_iterator;
+
+        /// Keys below this are found by scanning the hashes
+        enum { t_small = 16 };
+
+    public:
+
+        flat_map() : m_head(0), m_n(0) {}
+
+        flat_map(const flat_map &r) = default;
+
+        /// Leaves r empty, the counts aren't just copied
+        flat_map(flat_map &&r) noexcept : m_head(0), m_n(0) { swap(r); }
+
+        flat_map& operator =(const flat_map &r) = default;
+
+        flat_map& operator =(flat_map &&r) noexcept
+        {
+            clear();
+            swap(r);
+            return *this;
+        }
+
+        iterator begin() { return iterator(this, m_head); }
+        const_iterator begin() const { return const_iterator(this, m_head); }
+
+        iterator end() { return iterator(this, m_e.size()); }
+        const_iterator end() const { return const_iterator(this, m_e.size()); }
+
+        std::size_t size() const { return m_n; }
+
+        bool empty() const { return !m_n; }
+
+        void clear()
+        {
+            m_e.clear();
+            m_h.clear();
+            m_dead.clear();
+            m_idx.clear();
+            m_head = 0;
+            m_n = 0;
+        }
+
+        void swap(flat_map &r) noexcept
+        {
+            m_e.swap(r.m_e);
+            m_h.swap(r.m_h);
+            m_dead.swap(r.m_dead);
+            m_idx.swap(r.m_idx);
+            std::swap(m_head, r.m_head);
+            std::swap(m_n, r.m_n);
+        }
+
+        /// Returns the hash used to look up k
+        static std::size_t hash(const K &k) { return t_hash()(k); }
+
+        /// Find with a precomputed hash
+        iterator find(const K &k, std::size_t h)
+        {
+            std::size_t i = _find(k, h);
+            return m_e.size() > i ? iterator(this, i) : end();
+        }
+
+        const_iterator find(const K &k, std::size_t h) const
+        {
+            std::size_t i = _find(k, h);
+            return m_e.size() > i ? const_iterator(this, i) : end();
+        }
+
+        iterator find(const K &k) { return find(k, hash(k)); }
+
+        const_iterator find(const K &k) const { return find(k, hash(k)); }
+
+        std::size_t count(const K &k) const { return end() != find(k) ? 1 : 0; }
+
+        /// Returns the value for k, inserting it if needed
+        V& at(const K &k, std::size_t h)
+        {
+            std::size_t i = _find(k, h);
+            if (m_e.size() > i)
+                return m_e[i].second;
+
+            m_e.emplace_back(k, V());
+            m_h.push_back(h);
+            m_dead.push_back(0);
+            m_n++;
+            _index(m_e.size() - 1);
+
+            return m_e.back().second;
+        }
+
+        V& operator[](const K &k) { return at(k, hash(k)); }
+
+        iterator erase(iterator it)
+        {
+            std::size_t i = it.m_i;
+
+            // Free what it holds now, the slot goes at the next compact
+            m_e[i] = value_type();
+            m_dead[i] = 1;
+            if (!--m_n)
+            {   clear();
+                return end();
+            }
+
+            std::size_t n = _next(i + 1);
+            if (i == m_head)
+                m_head = n;
+
+            std::size_t nDead = m_e.size() - m_n;
+            if (t_small <= nDead && nDead * 2 >= m_e.size())
+                n = _compact(n);
+
+            return iterator(this, n);
+        }
+
+        std::size_t erase(const K &k)
+        {
+            iterator it = find(k);
+            if (end() == it)
+                return 0;
+            erase(it);
+            return 1;
+        }
+
+    private:
+
+        /// Returns the first live position from i on
+        std::size_t _next(std::size_t i) const
+        {
+            while (i < m_e.size() && m_dead[i])
+                i++;
+            return i;
+        }
+
+        /// Returns the position of k or npos
+        std::size_t _find(const K &k, std::size_t h) const
+        {
+            if (m_idx.empty())
+            {
+                for (std::size_t i = m_head; i < m_h.size(); i++)
+                    if (m_h[i] == h && !m_dead[i] && m_e[i].first == k)
+                        return i;
+                return npos;
+            }
+
+            // Dead elements keep their slot until the next rebuild
+            std::size_t mask = m_idx.size() - 1;
+            for (std::size_t s = h & mask; m_idx[s]; s = (s + 1) & mask)
+            {
+                std::size_t i = m_idx[s] - 1;
+                if (m_h[i] == h && !m_dead[i] && m_e[i].first == k)
+                    return i;
+            }
+
+            return npos;
+        }
+
+        /// Adds position i to the index, growing it as needed
+        void _index(std::size_t i)
+        {
+            if (m_idx.empty())
+            {   if (t_small < size())
+                    _rebuild();
+                return;
+            }
+
+            if (m_e.size() * 2 > m_idx.size())
+                return _rebuild();
+
+            _slot(i);
+        }
+
+        void _slot(std::size_t i)
+        {
+            std::size_t mask = m_idx.size() - 1;
+            std::size_t s = m_h[i] & mask;
+            while (m_idx[s])
+                s = (s + 1) & mask;
+            m_idx[s] = (uint32_t)(i + 1);
+        }
+
+        /// Rebuilds the index from scratch
+        void _rebuild()
+        {
+            m_idx.clear();
+            if (t_small >= size())
+                return;
+
+            std::size_t n = 64;
+            while (n < m_e.size() * 4)
+                n <<= 1;
+
+            m_idx.assign(n, 0);
+            for (std::size_t i = m_head; i < m_e.size(); i++)
+                if (!m_dead[i])
+                    _slot(i);
+        }
+
+        /// Drops the dead elements, returns where position keep moved to
+        std::size_t _compact(std::size_t keep)
+        {
+            std::size_t j = 0, k = m_n;
+            for (std::size_t i = m_head; i < m_e.size(); i++)
+                if (!m_dead[i])
+                {
+                    if (i == keep)
+                        k = j;
+                    if (i != j)
+                        m_e[j] = std::move(m_e[i]), m_h[j] = m_h[i];
+                    j++;
+                }
+
+            m_e.erase(m_e.begin() + j, m_e.end());
+            m_h.resize(j);
+            m_dead.assign(j, 0);
+            m_head = 0;
+            _rebuild();
+
+            return k;
+        }
+
+    private:
+
+        static const std::size_t npos = ~(std::size_t)0;
+
+        /// Keys and values
+        t_vector                    m_e;
+
+        /// Key hashes, parallel to m_e
+        std::vector<std::size_t>    m_h;
+
+        /// Non-zero where the element was erased, parallel to m_e
+        std::vector<uint8_t>        m_dead;
+
+        /// Open addressing index, position + 1, zero is empty
+        std::vector<uint32_t>       m_idx;
+
+        /// First live element
+        std::size_t                 m_head;
+
+        /// Live elements
+        std::size_t                 m_n;
+    };
+
+} // end namespace
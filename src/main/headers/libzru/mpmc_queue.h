@@ -0,0 +1,161 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+namespace zru
+{
+
+/// Bounded lock free queue, any number of producers and consumers
+/**
+    Each cell carries a sequence number that says whose turn it is,
+    a producer claims a cell by moving the tail, a consumer by moving
+    the head, so the only contention is the CAS on those two counters.
+    The size is rounded up to a power of two.
+
+    push() and pop() never block, they return false when the queue is
+    full or empty.
+*/
+template<typename T>
+    class mpmc_queue
+    {
+    public:
+
+        explicit mpmc_queue(std::size_t nSize = 1024)
+        {
+            std::size_t n = 2;
+            while (n < nSize)
+                n <<= 1;
+
+            m_mask = n - 1;
+            m_cells.reset(new cell[n]);
+            for (std::size_t i = 0; i < n; i++)
+                m_cells[i].seq.store(i, std::memory_order_relaxed);
+
+            m_head.store(0, std::memory_order_relaxed);
+            m_tail.store(0, std::memory_order_relaxed);
+        }
+
+        mpmc_queue(const mpmc_queue&) = delete;
+        mpmc_queue& operator = (const mpmc_queue&) = delete;
+
+        /// Adds v to the queue, returns false if it is full
+        template<typename V>
+            bool push(V &&v)
+            {
+                cell *c;
+                std::size_t pos = m_tail.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                    c = &m_cells[pos & m_mask];
+                    std::size_t seq = c->seq.load(std::memory_order_acquire);
+                    std::intptr_t dif = (std::intptr_t)seq - (std::intptr_t)pos;
+                    if (!dif)
+                    {   if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                            break;
+                    }
+                    else if (0 > dif)
+                        return false;
+                    else
+                        pos = m_tail.load(std::memory_order_relaxed);
+                }
+
+                c->data = std::forward<V>(v);
+                c->seq.store(pos + 1, std::memory_order_release);
+
+                return true;
+            }
+
+        /// Moves the oldest item into v, returns false if empty
+        bool pop(T &v)
+        {
+            cell *c;
+            std::size_t pos = m_head.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                c = &m_cells[pos & m_mask];
+                std::size_t seq = c->seq.load(std::memory_order_acquire);
+                std::intptr_t dif = (std::intptr_t)seq - (std::intptr_t)(pos + 1);
+                if (!dif)
+                {   if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (0 > dif)
+                    return false;
+                else
+                    pos = m_head.load(std::memory_order_relaxed);
+            }
+
+            v = std::move(c->data);
+            c->data = T();
+            c->seq.store(pos + m_mask + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        /// Number of items, only a hint while other threads are busy
+        std::size_t size() const
+        {
+            std::size_t t = m_tail.load(std::memory_order_relaxed);
+            std::size_t h = m_head.load(std::memory_order_relaxed);
+            return t > h ? t - h : 0;
+        }
+
+        bool empty() const { return !size(); }
+
+        std::size_t capacity() const { return m_mask + 1; }
+
+    private:
+
+        struct cell
+        {
+            std::atomic<std::size_t>    seq;
+            T                           data;
+        };
+
+        /// Producers and consumers each get their own cache line
+        alignas(64) std::atomic<std::size_t>    m_tail;
+        alignas(64) std::atomic<std::size_t>    m_head;
+
+        /// The ring
+        alignas(64) std::unique_ptr<cell[]>     m_cells;
+
+        /// Ring size - 1
+        std::size_t                             m_mask;
+    };
+
+} // end namespace
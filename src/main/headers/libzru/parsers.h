@@ -79,6 +79,7 @@ namespace zru::parsers
 
         // White space
         const t_str sWhiteSpace = tcTT(t_char, " \t\r\n");
+        static const str::char_class ccWhiteSpace(sWhiteSpace);
         const t_str sQuotes = tcTT(t_char, "\"'");
         const t_str sEscape = tcTT(t_char, "\\");
 
@@ -86,7 +87,7 @@ namespace zru::parsers
         while (t_str::npos != pos && pos < max)
         {
             // Skip white space
-            pos = str::find_first_not_of(x_sStr, sWhiteSpace, pos, max);
+            pos = str::find_first_not_of(x_sStr, ccWhiteSpace, pos, max);
             if (t_str::npos == pos)
                 break;
 
@@ -118,7 +119,7 @@ namespace zru::parsers
 
                 // Read in switches
                 else
-                    while (pos < max && t_str::npos == sWhiteSpace.find(x_sStr[pos]))
+                    while (pos < max && !ccWhiteSpace.has(x_sStr[pos]))
                         pb[x_sStr[pos++]] = any("##") += pb["#"].size();
 
                 continue;
@@ -182,17 +183,17 @@ namespace zru::parsers
         zruCHECK_MAX(x_sStr, max);
 
         // White space
-        const t_str sWhiteSpace = tcTT(t_char, " \t\r\n");
+        static const str::char_class ccWhiteSpace(tcTT(t_char, " \t\r\n"));
         const t_str sQuotes = tcTT(t_char, "\"'");
         const t_str sEscape = tcTT(t_char, "\\");
-        const t_str sNumber = tcTT(t_char, "+-.0123456789");
-        const t_anymap mVals({{"true", true},{"false", false}});
+        static const str::char_class ccNumber(tcTT(t_char, "+-.0123456789"));
+        static const t_anymap mVals({{"true", true},{"false", false}});
 
         // The property bag we will return
         t_pb pb;
 
         // Skip white space
-        pos = str::find_first_not_of(x_sStr, sWhiteSpace, pos, max);
+        pos = str::find_first_not_of(x_sStr, ccWhiteSpace, pos, max);
         if (t_str::npos == pos || pos >= max)
             return pb;
 
@@ -219,7 +220,7 @@ namespace zru::parsers
         while (t_str::npos != pos && pos < max)
         {
             // Skip white space
-            pos = str::find_first_not_of(x_sStr, sWhiteSpace, pos, max);
+            pos = str::find_first_not_of(x_sStr, ccWhiteSpace, pos, max);
             if (t_str::npos == pos)
                 break;
 
@@ -228,8 +229,7 @@ namespace zru::parsers
             // End of array
             if (zruCHR('}') == ch || zruCHR(']') == ch)
             {
-                if (++pos >= max)
-                    break;
+                pos++;
 
                 zruSETVAL(arrayType, pb, key, val);
 
@@ -339,11 +339,11 @@ namespace zru::parsers
                 }
 
                 // Is it a number
-                else if (t_str::npos != sNumber.find(ch))
+                else if (ccNumber.has(ch))
                 {
                     // Find the end of the number
                     typename t_str::size_type end = pos;
-                    str::find_first_not_of(x_sStr, sNumber, end, max);
+                    str::find_first_not_of(x_sStr, ccNumber, end, max);
                     if (t_str::npos == end)
                     {   ZruError("Out of data in number at ", pos);
                         return pb;
@@ -355,7 +355,7 @@ namespace zru::parsers
                     }
 
                     // Read in the number
-                    t_str num = x_sStr.substr(pos, end);
+                    t_str num = x_sStr.substr(pos, end - pos);
                     bool isFloat = t_str::npos != num.find(zruCHR('.'));
                     if (isFloat)
                         val = any(num).toDouble();
@@ -379,6 +379,560 @@ namespace zru::parsers
         static t_pb json_parse(const t_str &x_sStr)
         {   return json_parse<t_str, t_pb>(x_sStr, strpos(0)); }
 
+    //---------------------------------------------------------------
+    /** Default event handler for json_sax()
+
+        Derive from this and hide the events you are interested in,
+        return false from any event to stop parsing.
+
+        @example
+
+            struct counter : zru::parsers::json_sax_handler<>
+            {
+                int n = 0;
+                bool value(const zru::t_any &) { n++; return true; }
+            };
+    */
+    template<typename t_str = zru::string>
+        class json_sax_handler
+    {
+    public:
+
+        bool start_object() { return true; }
+
+        bool end_object() { return true; }
+
+        bool start_array() { return true; }
+
+        bool end_array() { return true; }
+
+        bool key(const t_str &/*k*/) { return true; }
+
+        bool value(const zru::t_any &/*v*/) { return true; }
+    };
+
+    //---------------------------------------------------------------
+    /** json_sax() handler that builds a property bag
+
+        The bag comes out as json_parse() would build it, but null
+        is kept, as an empty value, so array indexes don't shift.
+    */
+    template<typename t_str = zru::string, typename t_pb = zru::property_bag>
+        class json_sax_builder : public json_sax_handler<t_str>
+    {
+    public:
+
+        bool start_object() { return _open(false); }
+
+        bool end_object() { m_stack.pop_back(); return true; }
+
+        bool start_array() { return _open(true); }
+
+        bool end_array() { m_stack.pop_back(); return true; }
+
+        bool key(const t_str &k) { m_key = k; return true; }
+
+        bool value(const zru::t_any &v) { _next() = v; return true; }
+
+        /// The bag built so far, complete once json_sax() returns true
+        t_pb& get() { return m_pb; }
+
+    private:
+
+        /// The slot for the next value in the innermost object / array
+        t_pb& _next()
+        {
+            t_pb &p = *m_stack.back();
+            return p.isArray() ? p[p.size()] : p[m_key];
+        }
+
+        bool _open(bool bArray)
+        {
+            t_pb &p = m_stack.size() ? _next() : m_pb;
+            if (bArray)
+                p.setArray(true);
+            m_stack.push_back(&p);
+            return true;
+        }
+
+    private:
+
+        /// The bag being built
+        t_pb                m_pb;
+
+        /// Open objects / arrays, only the innermost one grows so these don't move
+        std::vector<t_pb*>  m_stack;
+
+        /// Key for the next value in an object
+        t_str               m_key;
+    };
+
+    //---------------------------------------------------------------
+    /** Finds the end of a JSON number
+
+        @param [in] x_sStr      - String containing the number
+        @param [in] pos         - Position of the first character
+        @param [in] max         - Position in the string to stop
+
+        Follows -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? and
+        the number may not run on into more number characters.
+
+        @returns The position after the number, or pos if it isn't one
+    */
+    template<typename t_str = zru::string>
+        static typename t_str::size_type json_number( const t_str &x_sStr,
+                                                      typename t_str::size_type pos,
+                                                      typename t_str::size_type max
+                                                    )
+    {
+        typedef typename t_str::value_type t_char;
+
+        zruCHECK_MAX(x_sStr, max);
+
+        typename t_str::size_type i = pos;
+        auto is = [&](t_char ch) { return i < max && ch == x_sStr[i]; };
+        auto digits = [&]() -> bool
+        {
+            typename t_str::size_type start = i;
+            while (i < max && zruCHR('0') <= x_sStr[i] && zruCHR('9') >= x_sStr[i])
+                i++;
+            return i > start;
+        };
+
+        if (is(zruCHR('-')))
+            i++;
+
+        // No leading zeros
+        if (is(zruCHR('0')))
+            i++;
+        else if (!digits())
+            return pos;
+
+        if (is(zruCHR('.')) && (i++, !digits()))
+            return pos;
+
+        if (is(zruCHR('e')) || is(zruCHR('E')))
+        {
+            i++;
+            if (is(zruCHR('+')) || is(zruCHR('-')))
+                i++;
+            if (!digits())
+                return pos;
+        }
+
+        // Things like 1-2 or 01
+        static const str::char_class ccNumber(tcTT(t_char, "+-.0123456789eE"));
+        if (i < max && ccNumber.has(x_sStr[i]))
+            return pos;
+
+        return i;
+    }
+
+    //---------------------------------------------------------------
+    /** Parses JSON string without building a property bag
+
+        @param [in] x_sStr      - String containing json string
+        @param [in] pos         - Position in the string to start
+        @param [in] max         - Position in the string to stop
+        @param [in] h           - Event handler, see json_sax_handler
+
+        Calls the handler for each structural element as it is
+        encountered.  Nesting is tracked on a small stack rather than
+        by recursion and no tree is built, only keys, strings and
+        numbers are copied out to pass to the handler.
+
+        @returns true if a complete document was parsed
+    */
+    template<typename t_str = zru::string, typename t_handler>
+        static bool json_sax( const t_str &x_sStr,
+                              typename t_str::size_type &pos,
+                              typename t_str::size_type max,
+                              t_handler &h
+                            )
+    {
+        typedef typename t_str::value_type t_char;
+
+        zruCHECK_MAX(x_sStr, max);
+
+        // White space
+        static const str::char_class ccWhiteSpace(tcTT(t_char, " \t\r\n"));
+        static const t_anymap mVals({{"true", true},{"false", false},{"null", t_any()}});
+
+        // What we expect next
+        enum { st_key, st_colon, st_value, st_comma };
+
+        // Open objects / arrays
+        std::vector<t_char> stack;
+
+        // Skip white space
+        pos = str::find_first_not_of(x_sStr, ccWhiteSpace, pos, max);
+        if (t_str::npos == pos || pos >= max)
+            return false;
+
+        int state = st_value;
+
+        // Non-zero right after a ',', where nothing may close
+        bool bComma = false;
+
+        switch(x_sStr[pos])
+        {
+            case zruCHR('{') : state = st_key; if (!h.start_object()) return false; break;
+            case zruCHR('[') : state = st_value; if (!h.start_array()) return false; break;
+            default:
+                ZruError("Invalid array type character : ", x_sStr[pos], " at ", pos);
+                return false;
+        }
+        stack.push_back(x_sStr[pos++]);
+
+        // Process data
+        while (t_str::npos != pos && pos < max)
+        {
+            // Skip white space
+            pos = str::find_first_not_of(x_sStr, ccWhiteSpace, pos, max);
+            if (t_str::npos == pos)
+                break;
+
+            t_char ch = x_sStr[pos];
+            bool bAfterComma = bComma;
+            bComma = false;
+
+            // End of object / array, allowed anywhere but after a key or a ','
+            if ((zruCHR('}') == ch || zruCHR(']') == ch) && st_colon != state && !bAfterComma
+                && (st_value != state || zruCHR('[') == stack.back()))
+            {
+                if ((zruCHR('}') == ch) != (zruCHR('{') == stack.back()))
+                {   ZruError("Mismatched '", ch, "' at ", pos);
+                    return false;
+                }
+
+                pos++;
+                stack.pop_back();
+
+                if (!(zruCHR('}') == ch ? h.end_object() : h.end_array()))
+                    return false;
+
+                if (stack.empty())
+                    return true;
+
+                state = st_comma;
+            }
+
+            // Separator
+            else if (st_comma == state)
+            {
+                if (zruCHR(',') != ch)
+                {   ZruError("Expected ',' Invalid character '", ch, "' at ", pos);
+                    return false;
+                }
+                pos++;
+                bComma = true;
+                state = (zruCHR('{') == stack.back()) ? st_key : st_value;
+            }
+
+            // Assignment
+            else if (st_colon == state)
+            {
+                if (zruCHR(':') != ch)
+                {   ZruError("Expected ':' Invalid character '", ch, "' at ", pos);
+                    return false;
+                }
+                pos++;
+                state = st_value;
+            }
+
+            // Keys must be quoted
+            else if (st_key == state)
+            {
+                if (zruCHR('\"') != ch)
+                {   ZruError("No Key, Invalid character '", ch, "' at ", pos);
+                    return false;
+                }
+
+                t_str s = str::unquote<t_str>(x_sStr, pos, max,
+                                              zruTXT("\""), zruTXT("\""),
+                                              zruTXT("\\"), t_str(), false, true);
+                if (0 >= s.length())
+                {   ZruError("Invalid key at ", pos);
+                    return false;
+                }
+
+                if (!h.key(s))
+                    return false;
+
+                state = st_colon;
+            }
+
+            // Start object / array
+            else if (zruCHR('{') == ch || zruCHR('[') == ch)
+            {
+                if (!(zruCHR('{') == ch ? h.start_object() : h.start_array()))
+                    return false;
+
+                stack.push_back(ch);
+                pos++;
+                state = (zruCHR('{') == ch) ? st_key : st_value;
+            }
+
+            // Quoted string
+            else if (zruCHR('\"') == ch)
+            {
+                t_str s = str::unquote<t_str>(x_sStr, pos, max,
+                                              zruTXT("\""), zruTXT("\""),
+                                              zruTXT("\\"), t_str(), false, true);
+                if (!h.value(t_any(s)))
+                    return false;
+
+                state = st_comma;
+            }
+
+            // It's something else
+            else
+            {
+                // Check for bool / null value
+                typename t_str::size_type end = pos;
+                t_any v = str::map_values(x_sStr, mVals, end, max);
+
+                // Is it a number
+                if (pos == end && pos != (end = json_number(x_sStr, pos, max)))
+                {
+                    // Read in the number
+                    t_str num = x_sStr.substr(pos, end - pos);
+                    if (t_str::npos != num.find_first_of(zruTXT(".eE")))
+                        v = any(num).toDouble();
+                    else
+                        v = any(num).toLongLong();
+                }
+
+                if (pos == end)
+                {   ZruError("Invalid character '", ch, "' at ", pos);
+                    return false;
+                }
+
+                pos = end;
+
+                if (!h.value(v))
+                    return false;
+
+                state = st_comma;
+            }
+        }
+
+        ZruError("Out of data at ", pos);
+
+        return false;
+    }
+    template<typename t_str = zru::string, typename t_handler>
+        static bool json_sax(const t_str &x_sStr, t_handler &h)
+        {   return json_sax<t_str, t_handler>(x_sStr, strpos(0), t_str::npos, h); }
+
+    //---------------------------------------------------------------
+    /** Incremental JSON parser for chunked input
+
+        Accepts input in whatever pieces it arrives and calls the record
+        function with each complete top level object or array, as found
+        in newline delimited JSON.  Only the record currently being
+        received is buffered, a record larger than the maximum size is
+        dropped.
+
+        @example
+
+            zru::parsers::json_stream<> js([](zru::property_bag &pb)->bool
+            {
+                std::cout << pb["id"].val().toString() << std::endl;
+                return true;
+            });
+
+            while ((n = read(fd, buf, sizeof(buf))) > 0)
+                js.write(buf, n);
+    */
+    template<typename t_str = zru::string, typename t_pb = zru::property_bag>
+        class json_stream
+    {
+    public:
+
+        typedef typename t_str::value_type t_char;
+
+        typedef typename t_str::size_type t_size;
+
+        /// Record callback, return false to stop
+        typedef std::function< bool (t_pb &pb) > pfn_Record;
+
+    public:
+
+        /** Constructor
+            @param [in] fRecord     - Called for each complete record
+            @param [in] maxRecord   - Maximum record size, zero for no limit
+        */
+        json_stream(pfn_Record fRecord, t_size maxRecord = 0)
+            : m_fRecord(fRecord), m_max(maxRecord)
+        {   reset();
+        }
+
+        /// Discards any partial record
+        void reset()
+        {
+            m_buf.clear();
+            m_depth = 0;
+            m_bStr = false;
+            m_bEsc = false;
+            m_bDrop = false;
+            m_bJunk = false;
+        }
+
+        /// Returns the number of characters held for the current record
+        t_size pending() const { return m_buf.length(); }
+
+        /// Returns the number of records that failed to parse or were too large
+        long errors() const { return m_nErrors; }
+
+        /// Returns non-zero if a record has been started but not completed
+        bool partial() const { return 0 < m_depth; }
+
+        /** Processes the next chunk of input
+            @param [in] p   - Data
+            @param [in] n   - Number of characters in p
+
+            @returns The number of records completed, or -1 if the
+                     record function asked to stop, in which case the
+                     rest of the chunk is discarded and the stream reset.
+        */
+        long write(const t_char *p, t_size n)
+        {
+            long nRecords = 0;
+            t_size start = 0, i = 0;
+
+            while (i < n)
+            {
+                t_char ch = p[i++];
+
+                // Waiting for a record to start
+                if (!m_depth)
+                {
+                    if (zruCHR('{') == ch || zruCHR('[') == ch)
+                        start = i - 1, m_depth = 1, m_bJunk = false;
+                    else if (zruCHR(' ') == ch || zruCHR('\t') == ch || zruCHR('\r') == ch
+                             || zruCHR('\n') == ch || zruCHR(',') == ch)
+                        m_bJunk = false;
+
+                    // One error for a run of junk, not one per character
+                    else if (!m_bJunk)
+                    {   ZruError("Invalid character '", ch, "' between records");
+                        m_nErrors++;
+                        m_bJunk = true;
+                    }
+                    continue;
+                }
+
+                // Inside a quoted string
+                if (m_bStr)
+                {
+                    if (m_bEsc)
+                        m_bEsc = false;
+                    else if (zruCHR('\\') == ch)
+                        m_bEsc = true;
+                    else if (zruCHR('\"') == ch)
+                        m_bStr = false;
+                    continue;
+                }
+
+                if (zruCHR('\"') == ch)
+                    m_bStr = true;
+
+                else if (zruCHR('{') == ch || zruCHR('[') == ch)
+                    m_depth++;
+
+                else if ((zruCHR('}') == ch || zruCHR(']') == ch) && !--m_depth)
+                {
+                    // Complete record
+                    if (!_append(p + start, i - start))
+                        continue;
+
+                    // Empty records are fine
+                    json_sax_builder<t_str, t_pb> b;
+                    if (!_parse(b))
+                    {   m_nErrors++;
+                        m_buf.clear();
+                        continue;
+                    }
+                    m_buf.clear();
+
+                    nRecords++;
+                    if (m_fRecord && !m_fRecord(b.get()))
+                    {   reset();
+                        return -1;
+                    }
+                }
+            }
+
+            // Keep the partial record for next time
+            if (m_depth)
+                _append(p + start, n - start);
+
+            return nRecords;
+        }
+
+        /// Processes the next chunk of input
+        long write(const t_str &s) { return write(s.data(), s.length()); }
+
+    private:
+
+        /// Builds the buffered record in b, returns non-zero if it is complete, valid JSON
+        bool _parse(json_sax_builder<t_str, t_pb> &b)
+        {
+            t_size pos = 0;
+            return json_sax<t_str>(m_buf, pos, t_str::npos, b) && m_buf.length() == pos;
+        }
+
+        /// Adds to the current record, returns false if it is being dropped
+        bool _append(const t_char *p, t_size n)
+        {
+            if (!m_bDrop && m_max && m_buf.length() + n > m_max)
+            {   ZruError("Record exceeds ", m_max, " characters, dropping");
+                m_nErrors++;
+                m_bDrop = true;
+                m_buf.clear();
+            }
+
+            if (m_bDrop)
+            {   if (!m_depth)
+                    m_bDrop = false;
+                return false;
+            }
+
+            m_buf.append(p, n);
+            return true;
+        }
+
+    private:
+
+        /// Record callback
+        pfn_Record      m_fRecord;
+
+        /// Maximum record size
+        t_size          m_max;
+
+        /// The record being received
+        t_str           m_buf;
+
+        /// Current nesting depth, zero between records
+        long            m_depth;
+
+        /// Non-zero while inside a quoted string
+        bool            m_bStr;
+
+        /// Non-zero if the last character was an escape
+        bool            m_bEsc;
+
+        /// Non-zero while skipping an oversized record
+        bool            m_bDrop;
+
+        /// Non-zero while skipping junk between records
+        bool            m_bJunk;
+
+        /// Number of bad records
+        long            m_nErrors = 0;
+    };
+
     //---------------------------------------------------------------
     /** Encode property_bag as a JSON string
         @param [in] pb      - Property bag to dump
@@ -395,20 +949,23 @@ namespace zru::parsers
             const t_char *endofs = bPretty ? zruTXT(",\r\n") : zruTXT(",");
             const t_char *seps = bPretty ? zruTXT("\": ") : zruTXT("\":");
 
+            // toString() leaves a whole double as "1.", JSON needs a digit after the point
+            auto number = [](const typename t_pb::t_any &v)
+            {   typename t_pb::t_str s = v.toString();
+                if (s.length() && zruCHR('.') == s.back())
+                    s += zruCHR('0');
+                return s;
+            };
+
             int nCount = 0;
             typename t_pb::t_str r;
 
             // Array
             if (pb.isArray())
             {
-                long sz = pb.size();
                 r = bPretty ? zruTXT("[\r\n") : zruTXT("[");
-                for (long i = 0; i < sz && pb.isset(i); i++)
+                for (auto it = pb.begin(); it != pb.end(); it++)
                 {
-                    auto it = pb.find(i);
-                    if (pb.end() == it)
-                        break;
-
                     if (0 < nCount++)
                         r += endofs;
 
@@ -432,7 +989,7 @@ namespace zru::parsers
                                 any::at_long, any::at_ulong, any::at_longlong, any::at_ulonglong,
                                 any::at_float, any::at_double, any::at_longdouble
                             }))
-                        r += it->second.val().toString();
+                        r += number(it->second.val());
 
                     // String
                     else
@@ -482,7 +1039,7 @@ namespace zru::parsers
                                 any::at_long, any::at_ulong, any::at_longlong, any::at_ulonglong,
                                 any::at_float, any::at_double, any::at_longdouble
                             }))
-                        r += it->second.val().toString();
+                        r += number(it->second.val());
 
                     // String
                     else
@@ -530,12 +1087,12 @@ namespace zru::parsers
         zruCHECK_MAX(x_sStr, max);
 
         // White space
-        const t_str sWhiteSpace = zruTXT(" \t");
+        static const str::char_class ccWhiteSpace(zruTXT(" \t"));
         const t_str sQuotes = zruTXT("\"'");
         const t_str sEscape = zruTXT("\\");
-        const t_str sNumber = zruTXT("+-.0123456789");
+        static const str::char_class ccNumber(zruTXT("+-.0123456789"));
         const t_str sBreak = zruTXT(":=,;#{}[]/\r\n");
-        const t_anymap mVals({  {"true", true}, {"false", false},
+        static const t_anymap mVals({  {"true", true}, {"false", false},
                                 {"yes", true}, {"no", false},
                                 {"on", true}, {"off", false},
                              });
@@ -544,7 +1101,7 @@ namespace zru::parsers
         t_pb pb;
 
         // Skip white space
-        pos = str::find_first_not_of(x_sStr, sWhiteSpace, pos, max);
+        pos = str::find_first_not_of(x_sStr, ccWhiteSpace, pos, max);
         if (t_str::npos == pos || pos >= max)
             return pb;
 
@@ -569,7 +1126,7 @@ namespace zru::parsers
         while (t_str::npos != pos && pos < max)
         {
             // Skip white space
-            pos = str::find_first_not_of(x_sStr, sWhiteSpace, pos, max);
+            pos = str::find_first_not_of(x_sStr, ccWhiteSpace, pos, max);
             if (t_str::npos == pos)
                 break;
 
@@ -701,11 +1258,11 @@ namespace zru::parsers
                 }
 
                 // Is it a number
-                else if (t_str::npos != sNumber.find(ch))
+                else if (ccNumber.has(ch))
                 {
                     // Find the end of the number
                     typename t_str::size_type end = pos;
-                    str::find_first_not_of(x_sStr, sNumber, end, max);
+                    str::find_first_not_of(x_sStr, ccNumber, end, max);
                     if (t_str::npos == end)
                     {   ZruError("Out of data in number at ", pos);
                         return pb;
@@ -717,7 +1274,7 @@ namespace zru::parsers
                     }
 
                     // Read in the number
-                    t_str num = x_sStr.substr(pos, end);
+                    t_str num = x_sStr.substr(pos, end - pos);
                     if (1 == arrayType && 0 >= key.length())
                         key = num;
                     else if (t_str::npos != num.find(zruCHR('.')))
@@ -48,7 +48,11 @@ public:
 
     typedef long t_size;
 
+#if defined(ZRU_PROPERTY_BAG_FLAT)
+    typedef flat_map<t_str, property_bag> t_map;
+#else
     typedef std::map<t_str, property_bag> t_map;
+#endif
 
 public:
 
@@ -56,18 +60,153 @@ public:
     // std standard functions
     //--------------------------------------------------------------
 
-    typedef typename t_map::iterator iterator;
-    typedef typename t_map::const_iterator const_iterator;
+    typedef std::vector<property_bag> t_array;
+
+    /// Walks either the map or the array, it->first is the key, it->second the value
+    /**
+        Array elements have no stored key, so *it is a pair of references
+        to the key and value rather than the map's own pair. The key of an
+        array element comes from index_key(), so a copy of *it stays good
+        after the iterator is gone.
+    */
+    template<typename t_pb, typename t_mit>
+        class iterator_t
+        {
+        public:
+
+            typedef std::pair<const t_str&, t_pb&> value_type;
+            typedef value_type& reference;
+            typedef value_type* pointer;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::forward_iterator_tag iterator_category;
+
+            iterator_t() : m_p(0), m_i(0) {}
+
+            iterator_t(t_mit it) : m_it(it), m_p(0), m_i(0) {}
+
+            iterator_t(t_pb *p, t_size i) : m_p(p), m_i(i) {}
+
+            // Each iterator hands out its own cached value, so it isn't copied
+            iterator_t(const iterator_t &r) : m_it(r.m_it), m_p(r.m_p), m_i(r.m_i) {}
+
+            iterator_t& operator =(const iterator_t &r)
+            {
+                m_v.reset();
+                m_it = r.m_it, m_p = r.m_p, m_i = r.m_i;
+                return *this;
+            }
+
+            /// Allows iterator to const_iterator
+            template<typename t_pb2, typename t_mit2>
+                iterator_t(const iterator_t<t_pb2, t_mit2> &r) : m_it(r.m_it), m_p(r.m_p), m_i(r.m_i) {}
+
+            reference operator *() const
+            {
+                m_v.reset();
+                if (!m_p)
+                    m_v.emplace(m_it->first, m_it->second);
+                else
+                    m_v.emplace(index_key(m_i), *m_p);
+                return *m_v;
+            }
+
+            pointer operator ->() const { return &**this; }
+
+            iterator_t& operator ++()
+            {
+                if (m_p)
+                    m_p++, m_i++;
+                else
+                    m_it++;
+                return *this;
+            }
+
+            iterator_t operator ++(int) { iterator_t r(*this); ++(*this); return r; }
+
+            bool operator ==(const iterator_t &r) const { return m_p ? m_p == r.m_p : (!r.m_p && m_it == r.m_it); }
+
+            bool operator !=(const iterator_t &r) const { return !(*this == r); }
+
+        private:
+
+            template<typename, typename> friend class iterator_t;
+            friend class property_bag;
+
+            // Map position
+            t_mit                           m_it;
+
+            // Array element and index
+            t_pb                            *m_p;
+            t_size                          m_i;
 
-    iterator begin() { return m_m.begin(); }
-    const_iterator begin() const { return m_m.begin(); }
+            // The last value handed out
+            mutable std::optional<value_type> m_v;
+        };
 
-    iterator end() { return m_m.end(); }
-    const_iterator end() const { return m_m.end(); }
+    /// Returns the key of array index i, the string is never freed
+    static const t_str& index_key(t_size i);
 
-    iterator erase( iterator it ) { return m_m.erase( it ); }
+    typedef iterator_t<property_bag, typename t_map::iterator> iterator;
+    typedef iterator_t<const property_bag, typename t_map::const_iterator> const_iterator;
 
-    void clear() { m_m.clear(); m_v = t_any(); m_i = 0; m_bArray = false; }
+    iterator begin();
+    const_iterator begin() const;
+
+    iterator end();
+    const_iterator end() const;
+
+    iterator erase( iterator it );
+
+    void clear() { m_m.clear(); m_a.clear(); m_h = 0; m_v = t_any(); m_i = 0; m_bArray = false; }
+
+public:
+
+    /// A key split once so it can be used over and over
+    /**
+        Holds the key segments with their hashes and array indexes,
+        at(), lookup(), isset(), length() and erase() take it in place
+        of a separator and key.
+
+        @code
+            static const zru::property_bag::path pCount(".", "stats.rx.count");
+            pb.at(pCount) += 1;
+        @endcode
+    */
+    class path
+    {
+    public:
+
+        path() {}
+
+        path(const t_str &sep, const t_str &k) { set(sep, k); }
+
+        /// Splits k, empty segments are skipped as in at()
+        void set(const t_str &sep, const t_str &k);
+
+        /// Number of segments
+        std::size_t size() const { return m_seg.size(); }
+
+        /// Segment i
+        const t_str& operator[](std::size_t i) const { return m_seg[i]; }
+
+        /// Hash of segment i
+        std::size_t hash(std::size_t i) const { return m_hash[i]; }
+
+        /// Array index of segment i or -1 if it isn't a number
+        t_size index(std::size_t i) const { return m_idx[i]; }
+
+        /// The separator and key this was made from
+        const t_str& sep() const { return m_sep; }
+        const t_str& key() const { return m_key; }
+
+    private:
+
+        t_str                       m_sep;
+        t_str                       m_key;
+        std::vector<t_str>          m_seg;
+        std::vector<std::size_t>    m_hash;
+        std::vector<t_size>         m_idx;
+    };
 
 public:
 
@@ -77,6 +216,10 @@ public:
 
     property_bag(const property_bag &r);
 
+    property_bag(property_bag &&r) noexcept;
+
+    property_bag(t_any &&r);
+
     property_bag(std::initializer_list<std::pair<t_str, t_any> > a);
 
     // property_bag(std::initializer_list<std::pair<t_str, property_bag> > a);
@@ -87,12 +230,32 @@ public:
 
     property_bag& operator = (const property_bag &r);
 
+    property_bag& operator = (t_any &&r);
+
+    property_bag& operator = (property_bag &&r) noexcept;
+
+    void swap(property_bag &r) noexcept;
+
     property_bag& operator += (const t_any &r);
 
     property_bag& operator -= (const t_any &r);
 
+    /// Returns the child at k, inserting it if needed
+    /**
+        The reference is only good until the next insert into this bag.
+        With ZRU_PROPERTY_BAG_FLAT, and for arrays, adding a sibling may
+        move the children, so
+
+            auto &a = pb["a"];
+            pb["b"] = 1;        // a may now dangle
+
+        Look a child up again after adding to its parent.
+    */
     property_bag& operator[](const t_any &k);
 
+    /// Doesn't insert, returns an empty bag if k isn't there
+    const property_bag& operator[](const t_any &k) const;
+
     iterator find(const t_any &k);
     const_iterator find(const t_any &k) const;
 
@@ -106,7 +269,9 @@ public:
 
     int length(const t_str &sep, const t_str &k);
 
-    inline bool isset() const { return m_m.size() || !m_v.isVoid(); }
+    int length(const path &p) const;
+
+    inline bool isset() const { return m_m.size() || size() || !m_v.isVoid(); }
 
     bool isset(const any &k) const;
 
@@ -114,13 +279,20 @@ public:
 
     bool isset(const t_str &sep, const t_str &k);
 
+    bool isset(const path &p) const;
+
     bool isset(std::initializer_list< t_str > a);
 
     bool isset(const t_str &sSep, std::initializer_list< t_str > a);
 
     bool isArray() const { return m_bArray; }
 
-    void setArray(bool b) { m_bArray = b; }
+    /// Switches between array and map storage, numeric keys keep their place
+    /**
+        A map with an index more than 1024 past its size stays a map, as
+        does an array given such an index by operator[] or at().
+    */
+    void setArray(bool b);
 
     void setIdx(t_size i) { m_i = i; }
 
@@ -130,6 +302,13 @@ public:
 
     property_bag& at(const t_str &sep, const t_str &k);
 
+    /// Like at() but doesn't create anything, returns null if the key isn't there
+    const property_bag* lookup(const t_str &sep, const t_str &k) const;
+
+    property_bag& at(const path &p);
+
+    const property_bag* lookup(const path &p) const;
+
 public:
 
     typedef bool (*tf_apply)(property_bag &);
@@ -156,6 +335,8 @@ public:
 
     bool erase(const t_str &sep, const t_str &k);
 
+    bool erase(const path &p);
+
     t_size merge(const property_bag &pb, bool bOverwrite = true);
 
     t_size map_keys(const property_bag &keys, property_bag &pb, bool bOverwrite = true, bool bBidirectional = true);
@@ -167,10 +348,35 @@ public:
 
     t_size push(const t_any &v);
 
+    t_size push(property_bag &&pb);
+
     property_bag pop();
 
     property_bag pop(long n);
 
+    /// Moves up to n items onto the end of v, returns the number moved
+    t_size pop(std::vector<property_bag> &v, long n);
+
+private:
+
+    /// Returns non-zero and sets i if k is an array index
+    static bool _index(const t_any &k, t_size &i);
+
+    /// Makes room for array index i, false if it is too far past the end
+    bool _grow(t_size i);
+
+    /// Child for segment i of p, created if needed
+    property_bag& _child(const path &p, std::size_t i);
+
+    /// Child for segment i of p or null
+    const property_bag* _find(const path &p, std::size_t i) const;
+    property_bag* _find(const path &p, std::size_t i)
+    {   return const_cast<property_bag*>(static_cast<const property_bag*>(this)->_find(p, i)); }
+
+    /// Returns the live array elements
+    property_bag* _arr() { return m_a.data() + m_h; }
+    const property_bag* _arr() const { return m_a.data() + m_h; }
+
 private:
 
     // The value
@@ -185,6 +391,12 @@ private:
     // Non-zero if this is an array
     bool         m_bArray;
 
+    // Array elements, used instead of m_m when m_bArray is set
+    t_array      m_a;
+
+    // Elements before this have been popped
+    t_size       m_h;
+
 };
 
 
@@ -202,16 +414,63 @@ public:
 
     typedef std::list<t_str> t_strlist;
 
+    typedef std::shared_mutex t_rwlock;
+
+    typedef std::unique_lock<t_rwlock> t_writelock;
+
+    typedef std::shared_lock<t_rwlock> t_readlock;
+
+    /// Read only view of a subtree
+    typedef std::shared_ptr<const property_bag> t_pbview;
+
 public:
 
+    struct pb_shard;
+    struct wait_node;
+    class pb_waitable;
+
+    typedef std::shared_ptr<pb_waitable> t_pbwptr;
+
+    typedef std::list< t_pbwptr > t_wait_list;
+
+    /// Where a waitable is hooked in, so it can be unhooked without a search
+    struct wait_hook
+    {
+        pb_shard                    *s;
+        wait_node                   *n;
+        t_wait_list::iterator       it;
+    };
+
+    typedef std::vector<wait_hook> t_hooks;
+
+    /// A key segment in the waiter tree
+    /**
+        Nodes only exist while something below them is waiting, so a
+        signal stops at the first segment nobody is listening on.
+    */
+    struct wait_node
+    {
+        /// Waits on this key
+        t_wait_list                                                 waits;
+
+        /// Keys below this one
+        std::map<t_str, std::unique_ptr<wait_node>, std::less<> >   next;
+
+        /// Parent node and our key in it, null at the root
+        wait_node                                                   *parent = 0;
+        t_str                                                       key;
+    };
+
     class pb_waitable
     {
     public:
 
+        /// Used for one wait, see closed
         pb_waitable()
         {
             wait_count = -1;
             update_count = 0;
+            once = true;
         }
 
         pb_waitable(const t_str &sKey)
@@ -228,40 +487,109 @@ public:
             keys = lKeys;
         }
 
-        void notify_one()
+        /// Nobody waits on this one, f is called on the first notify instead
+        explicit pb_waitable(std::function<void()> f)
+            : on_change(std::move(f))
+        {
+            wait_count = 0;
+            update_count = 0;
+        }
+
+        /// Returns false if this one didn't take the notification
+        bool notify_one()
         {
-            update_count++;
+            if (on_change)
+                return _fire();
+            {   std::unique_lock<std::mutex> lk(lock);
+                // Already woken, or leaving, let the next one have it
+                if (closed || (0 <= wait_count && wait_count != update_count))
+                    return false;
+                update_count++;
+            }
             cond.notify_one();
+            return true;
         }
 
         void notify_all()
         {
-            update_count++;
+            if (on_change)
+            {   _fire();
+                return;
+            }
+            { std::unique_lock<std::mutex> lk(lock); update_count++; }
+            cond.notify_all();
+        }
+
+        /// Only updates from here on will end the next wait
+        void arm()
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            wait_count = update_count;
+        }
+
+        /// Wakes waiters so they look at their stop token, doesn't count as an update
+        void wake()
+        {
+            { std::unique_lock<std::mutex> lk(lock); }
             cond.notify_all();
         }
 
+        /// Waits for an update, a stopped token ends the wait as a timeout
         template<typename REP, typename PERIOD>
-            std::cv_status wait_for(std::unique_lock<std::mutex>& lock,
-                                    const std::chrono::duration<REP, PERIOD>& rel_time
-                                )
+            std::cv_status wait_for(const std::chrono::duration<REP, PERIOD>& rel_time, const stop_token &st = stop_token())
             {
+                std::unique_lock<std::mutex> lk(lock);
                 std::cv_status r = std::cv_status::no_timeout;
                 if (0 > wait_count || wait_count == update_count)
-                    r = cond.wait_for(lock, rel_time);
+                {   int64_t n = update_count;
+                    if (!cond.wait_for(lk, rel_time, [&]() { return n != update_count || st.stop_requested(); })
+                        || n == update_count)
+                        r = std::cv_status::timeout;
+                }
                 wait_count = update_count;
+                if (once)
+                    closed = true;
                 return r;
             }
 
-        int64_t get_wait_count() { return wait_count; }
+        int64_t get_wait_count() { std::unique_lock<std::mutex> lk(lock); return wait_count; }
 
-        int64_t get_update_count() { return update_count; }
+        int64_t get_update_count() { std::unique_lock<std::mutex> lk(lock); return update_count; }
 
         t_strlist& get_keys() { return keys; }
 
+        /// Where this is hooked in, only used for named waits
+        t_hooks& get_hooks() { return hooks; }
+
+        /// Non-zero once on_change has been called
+        bool has_fired() const { return fired.load(); }
+
         t_condition& get_condition() { return cond; }
 
     private:
 
+        /// Calls on_change the first time only
+        bool _fire()
+        {
+            if (fired.exchange(true))
+                return false;
+            { std::unique_lock<std::mutex> lk(lock); update_count++; }
+            on_change();
+            return true;
+        }
+
+    private:
+
+        // Called instead of waking a thread, see property_bag_ts::async_wait()
+        std::function<void()>   on_change;
+
+        // Set when on_change has been called, keys in other shards may race
+        std::atomic<bool>       fired{false};
+
+        // Set when a single use wait returns, it is still hooked until the shard lock is free
+        bool            once = false;
+        bool            closed = false;
+
         // Incremented when this value is updated
         int64_t         update_count;
 
@@ -271,24 +599,133 @@ public:
         // Condition to wait for
         t_condition     cond;
 
+        // Protects the counts, waiting doesn't hold the shard lock
+        t_lock          lock;
+
         // The key this condition is for
         t_strlist       keys;
+
+        // Where we are hooked in
+        t_hooks         hooks;
     };
 
-public:
+    /// Named queue of property bags, see get_queue()
+    /**
+        Push and pop go through a lock free ring, the lock is only
+        taken by a pop() that has to wait and by a push() that finds
+        someone waiting.
+    */
+    class pb_queue
+    {
+    public:
 
-    typedef std::shared_ptr<pb_waitable> t_pbwptr;
+        typedef mpmc_queue<property_bag> t_ring;
 
-    typedef std::list< t_pbwptr > t_wait_list;
+        explicit pb_queue(std::size_t nSize) : m_q(nSize), m_waiters(0) {}
+
+        /// Adds a value, returns false if the queue is full
+        bool push(const property_bag &pbValue)
+        {   if (!m_q.push(pbValue))
+                return false;
+            _wake();
+            return true;
+        }
 
-    typedef std::map<t_str, t_wait_list> t_wait_map;
+        /// Adds a value, returns false if the queue is full
+        bool push(property_bag &&pbValue)
+        {   if (!m_q.push(std::move(pbValue)))
+                return false;
+            _wake();
+            return true;
+        }
+
+        /// Adds a value, returns false if the queue is full
+        bool push(const property_bag::t_any &vValue)
+        {   if (!m_q.push(property_bag(vValue)))
+                return false;
+            _wake();
+            return true;
+        }
+
+        /// Pops one value, waits up to uTimeout ms for one to arrive
+        bool pop(property_bag &p, property_bag::t_size uTimeout = 0);
+
+        /// Number of items waiting
+        std::size_t size() const { return m_q.size(); }
+
+        /// Maximum number of items
+        std::size_t capacity() const { return m_q.capacity(); }
+
+    private:
+
+        /// Wakes a waiting pop()
+        void _wake();
+
+    private:
+
+        // The items
+        t_ring                  m_q;
+
+        // Number of threads waiting in pop()
+        std::atomic<long>       m_waiters;
+
+        // Only used for waiting
+        t_lock                  m_lock;
+        t_condition             m_cond;
+    };
+
+public:
 
     typedef std::map<t_str, t_pbwptr> t_waitable_map;
 
+    typedef std::shared_ptr<pb_queue> t_queueptr;
+
+    /// One independent part of the bag
+    struct pb_shard
+    {
+        /// Top level keys that hash to this shard
+        property_bag    pb;
+
+        /// Protects pb and wait, readers share it
+        t_rwlock        lock;
+
+        /// Waits on keys in this shard
+        wait_node       wait;
+
+        /// Bumped by every write, views from an older generation are stale
+        std::atomic<uint64_t> gen{0};
+
+        /// Protects views and view_gen, taken after lock, never before
+        t_rwlock        view_lock;
+
+        /// Generation the views were copied at
+        uint64_t        view_gen = 0;
+
+        /// Subtree copies handed out by view(), by separator and key
+        std::map<t_str, t_pbview> views;
+    };
+
+    typedef std::map<t_str, t_queueptr> t_queue_map;
+
 public:
 
-    /// Default constructor
-    property_bag_ts() {}
+    /// Constructor
+    /**
+        @param [in] nShards - Number of independent shards
+
+        With more than one shard the top level keys are spread across
+        shards, each with its own lock, so threads working on different
+        subtrees don't contend. Reading or sizing the root gathers all
+        shards, other operations on the root go to the first shard.
+    */
+    explicit property_bag_ts(std::size_t nShards = 1)
+    {
+        for (std::size_t i = 0; i < std::max<std::size_t>(nShards, 1); i++)
+            m_shards.emplace_back(new pb_shard());
+    }
+
+    /// Number of shards
+    std::size_t shards() const { return m_shards.size(); }
 
     /// Default destructor
     ~property_bag_ts() {}
@@ -308,6 +745,15 @@ public:
     /// Gets the specified value from the property bag
     property_bag get(const t_str &sSep, const t_str &sKey);
 
+    /// Returns a read only view of the specified value
+    /**
+        The view is a copy of just that subtree, shared by every reader
+        of the key until the next write to the shard, so repeated reads
+        don't copy or take the shard lock. The first view() of a key
+        after a write copies the subtree, once however many readers ask.
+    */
+    t_pbview view(const t_str &sSep, const t_str &sKey);
+
     /// Increments the specified key by the given amount
     bool inc(const t_str &sSep, const t_str &sKey, const property_bag::t_any &v);
 
@@ -320,9 +766,8 @@ public:
     /// Map the specified keys
     bool map_keys(const string &sSep, const string &sKey, const property_bag &keys, property_bag &pb, bool bOverwrite = true, bool bBidirectional = true);
 
-    /// Map the specified keys
-    bool map_keys(const string &sSep, const string &sKey, const property_bag &keys, bool bOverwrite = true, bool bBidirectional = true)
-    {   return map_keys(sSep, sKey, keys, m_pb, bOverwrite, bBidirectional); }
+    /// Map the specified keys, pb is the root of the key's shard
+    bool map_keys(const string &sSep, const string &sKey, const property_bag &keys, bool bOverwrite = true, bool bBidirectional = true);
 
     /// Returns non-zero if the specified key is set to a non-void value
     bool isset(const t_str &sSep, const t_str &sKey);
@@ -330,6 +775,25 @@ public:
     /// Erases the value at the specified key
     bool erase(const t_str &sSep, const t_str &sKey);
 
+public:
+
+    /// Versions of the above that take a precompiled key, see property_bag::path
+    int size(const property_bag::path &p);
+    int length(const property_bag::path &p);
+    bool set(const property_bag::path &p, const property_bag &pbValue);
+    bool set(const property_bag::path &p, const property_bag::t_any &vValue);
+    property_bag get(const property_bag::path &p);
+    t_pbview view(const property_bag::path &p);
+    bool inc(const property_bag::path &p, const property_bag::t_any &v);
+    bool dec(const property_bag::path &p, const property_bag::t_any &v);
+    bool isset(const property_bag::path &p);
+    bool erase(const property_bag::path &p);
+    property_bag::t_size push(const property_bag::path &p, const property_bag &pbValue, bool bSignalAll);
+    property_bag::t_size push(const property_bag::path &p, const property_bag::t_any &vValue, bool bSignalAll);
+    property_bag::t_size popv(std::vector<property_bag> &v, const property_bag::path &p, property_bag::t_size n, property_bag::t_size uTimeout = 0);
+    bool pop(property_bag &r, const property_bag::path &p, property_bag::t_size uTimeout);
+    bool wait(const property_bag::path &p, property_bag::t_size uTimeout);
+
 public:
 
     /// Pushes the specified value into the property_bag
@@ -338,6 +802,45 @@ public:
     /// Pushes the specified value into the property_bag
     property_bag::t_size push(const t_str &sSep, const t_str &sKey, const property_bag::t_any &vValue, bool bSignalAll);
 
+    /// Pushes a range of values under one lock with one signal, returns the number pushed
+    /**
+        Pass move iterators to move the values in.
+
+        @code
+            std::vector<zru::property_bag> v = make_items();
+            zru::pb.push_batch(".", "work", std::make_move_iterator(v.begin()),
+                               std::make_move_iterator(v.end()), false);
+        @endcode
+    */
+    template<typename IT>
+        property_bag::t_size push_batch(const t_str &sSep, const t_str &sKey, IT first, IT last, bool bSignalAll = true)
+        {
+            pb_shard &s = _shard(sSep, sKey);
+            t_writelock lk(s.lock);
+            _changed(s);
+
+            property_bag &r = s.pb.at(sSep, sKey);
+
+            property_bag::t_size n = 0;
+            for (; first != last; ++first, n++)
+                r.push(*first);
+
+            if (n)
+                _sig(s, sSep, sKey, bSignalAll);
+
+            return n;
+        }
+
+    /// Pushes a range of values under one lock with one signal, returns the number pushed
+    property_bag::t_size push_batch(const t_str &sSep, const t_str &sKey, std::vector<property_bag> &&v, bool bSignalAll = true)
+    {   return push_batch(sSep, sKey, std::make_move_iterator(v.begin()), std::make_move_iterator(v.end()), bSignalAll); }
+
+    /// Pops up to n items onto the end of v, waits up to uTimeout for something to appear
+    /**
+        Returns the number of items added to v.
+    */
+    property_bag::t_size popv(std::vector<property_bag> &v, const t_str &sSep, const t_str &sKey, property_bag::t_size n, property_bag::t_size uTimeout = 0);
+
     /// Pops the specified number of items fromm the property bag
     property_bag popn(const t_str &sSep, const t_str &sKey, property_bag::t_size n);
 
@@ -365,6 +868,26 @@ public:
     /// Swaps the specified values
     property_bag swp(const t_str &sSep, const t_str &sKey, const property_bag::t_any &vValue, property_bag::t_size uTimeout);
 
+public:
+
+    /// Returns the named queue, it is created with room for nSize items if needed
+    /**
+        Keep the returned pointer to skip the name lookup on each call.
+    */
+    t_queueptr get_queue(const t_str &sName, std::size_t nSize = 1024);
+
+    /// Removes the named queue, threads holding a pointer to it can still use it
+    bool remove_queue(const t_str &sName);
+
+    /// Pushes onto the named queue, returns false if it is full
+    bool qpush(const t_str &sName, const property_bag &pbValue);
+
+    /// Pushes onto the named queue, returns false if it is full
+    bool qpush(const t_str &sName, const property_bag::t_any &vValue);
+
+    /// Pops from the named queue, waits up to uTimeout for something to appear
+    bool qpop(property_bag &p, const t_str &sName, property_bag::t_size uTimeout);
+
 public:
 
     /// Signals that the specified key has changed
@@ -383,40 +906,99 @@ public:
     void remove_named_wait(const t_str &sName);
     void remove_all_named_waits();
 
+public:
+
+    /// Calls f once, on the next change to the key or anything below it
+    /**
+        Nothing blocks, this is what the coroutine awaitables in
+        coro.h are built on. f runs on the thread that made the change
+        with the key's shard locked, so it should only hand the work
+        off, a thread_pool::post() for instance.
+
+        @param [in] sSep    - Key separator
+        @param [in] sKey    - Key to watch
+        @param [in] f       - Function to call
+
+        @return Handle to pass to async_cancel() once f has run or is
+                no longer wanted
+    */
+    t_pbwptr async_wait(const t_str &sSep, const t_str &sKey, std::function<void()> f);
+
+    /// Calls f once, on the next change to any of the keys, see async_wait()
+    t_pbwptr async_wait_multiple(const t_str &sSep, const t_strlist &keys, std::function<void()> f);
+
+    /// Pops into p if there is something there, otherwise the same as async_wait()
+    /**
+        The check and the hook happen under one lock, so nothing pushed
+        in between is missed.
+
+        @return Null if a value was popped into p
+    */
+    t_pbwptr async_pop(property_bag &p, const t_str &sSep, const t_str &sKey, std::function<void()> f);
+
+    /// Unhooks an async wait, whether or not it has fired
+    void async_cancel(const t_pbwptr &pbw);
+
 protected:
 
-    // --- These functions don't lock, you must lock before calling them --- //
+    /// Returns the shard holding the specified key
+    pb_shard& _shard(const t_str &sSep, const t_str &sKey);
+    pb_shard& _shard(const property_bag::path &p);
 
-    /// Waits for the specified key to change
-    bool _wait(t_pbwptr pbw, t_scopelock &lk, const t_str &key, property_bag::t_size uTimeout);
-    bool _wait_multiple(t_pbwptr pbw, t_scopelock &lk, const t_strlist &keys, property_bag::t_size uTimeout);
+    /// Makes the shard views stale, call after changing the shard
+    void _changed(pb_shard &s);
 
-    /// Signals that the specified key has changed, does not lock
-    void _sig(const t_str &sKey, bool bSignalAll = true);
-    void _sig(const t_str &sSep, const t_str &sKey, bool bSignalAll = true);
+    /// Returns the view with id sId, copying what f finds in the shard if it is stale
+    t_pbview _view(pb_shard &s, const t_str &sId, const std::function<const property_bag*(const property_bag&)> &f);
 
-    /// Adds the specified key to the wait list
-    void _add_wait(const t_str &sKey, t_pbwptr pbw);
+    /// Returns non-zero if the key is empty or only separators
+    static bool _isroot(const t_str &sSep, const t_str &sKey);
 
-    /// Removes the specified key from the wait list
-    void _remove_wait(const t_str &sKey, t_pbwptr pbw);
+    // --- These functions don't lock, you must lock the shard before calling them --- //
 
-private:
+    /// Waits for the specified key to change, unlocks lk while waiting
+    bool _wait(pb_shard &s, t_pbwptr pbw, t_writelock &lk, const t_str &sSep, const t_str &sKey, property_bag::t_size uTimeout);
+    bool _wait(pb_shard &s, t_pbwptr pbw, t_writelock &lk, const property_bag::path &p, property_bag::t_size uTimeout);
+
+    /// Waits on a hook already in the wait tree, unlocks lk while waiting
+    bool _wait(pb_shard &s, t_pbwptr pbw, t_writelock &lk, const wait_hook &h, property_bag::t_size uTimeout);
+
+    /// Signals the waits on the specified key and the keys above it, does not lock
+    void _sig(pb_shard &s, const t_str &sSep, const t_str &sKey, bool bSignalAll = true);
+    void _sig(pb_shard &s, const property_bag::path &p, bool bSignalAll = true);
+
+    /// Signals the waits on one node
+    static void _sig(wait_node &n, bool bSignalAll);
 
-    /// The protected property bag
-    property_bag                m_pb;
+    /// Adds the specified key to the wait tree
+    wait_hook _add_wait(pb_shard &s, const t_str &sSep, const t_str &sKey, t_pbwptr pbw);
+    wait_hook _add_wait(pb_shard &s, const property_bag::path &p, t_pbwptr pbw);
 
-    /// Thread mutex
-    t_lock                      m_mLock;
+    /// Adds a wait below n for the key that continues with seg
+    static wait_node* _wait_child(wait_node *n, std::string_view seg);
 
-    /// Signals the thread
-    t_condition                 m_cvLock;
+    /// Removes a wait, prunes nodes nobody is waiting on
+    static void _remove_wait(const wait_hook &h);
 
-    /// Map of wait objects
-    t_wait_map                  m_wait;
+    /// Removes a named wait from every shard, locks the shards
+    void _remove_named(t_pbwptr pbw);
+
+private:
+
+    /// The shards, there is always at least one
+    std::vector< std::unique_ptr<pb_shard> >    m_shards;
 
     /// Map of waitable objects
     t_waitable_map              m_waitable;
+
+    /// Protects m_waitable
+    t_lock                      m_wLock;
+
+    /// Named queues
+    t_queue_map                 m_queues;
+
+    /// Protects m_queues
+    t_lock                      m_qLock;
 };
 
     // Global property bag
@@ -0,0 +1,277 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#if defined(ZRU_POSIX)
+#   include <pthread.h>
+#endif
+
+namespace zru
+{
+
+/// Mutex that lives in shared memory and survives its owner dying
+/**
+    A process that dies holding the lock doesn't leave it locked
+    forever, the next lock() takes it over and says so, and the caller
+    decides if what it guarded needs repair. Construct it in place in
+    the share, once, by whoever creates the share.
+*/
+class shm_mutex
+{
+public:
+
+    /// Sets up a process shared, robust mutex
+    shm_mutex();
+
+    /// Destroys the mutex, only the last user should
+    ~shm_mutex();
+
+    /// Locks, returns non-zero if the last owner died holding the lock
+    bool lock();
+
+    /// Locks if it is free
+    bool try_lock();
+
+    /// Unlocks
+    void unlock();
+
+private:
+
+    /// Not copyable, it has an address in the share
+    shm_mutex(const shm_mutex&) = delete;
+    shm_mutex& operator = (const shm_mutex&) = delete;
+
+#if defined(ZRU_POSIX)
+    pthread_mutex_t     m_mtx;
+#endif
+};
+
+
+/// Pointer that holds the distance to its target from itself
+/**
+    Valid wherever the share is mapped, as long as the pointer and its
+    target are in the same share. Copying recomputes the distance, so
+    it can be copied in and out of the share like a plain pointer.
+*/
+template<typename T>
+    class shm_ptr
+    {
+    public:
+
+        shm_ptr() : m_off(0) {}
+        shm_ptr(T *p) { set(p); }
+        shm_ptr(const shm_ptr &p) { set(p.get()); }
+        shm_ptr& operator = (const shm_ptr &p) { set(p.get()); return *this; }
+        shm_ptr& operator = (T *p) { set(p); return *this; }
+
+        /// Returns the target, null if there is none
+        T* get() const { return m_off ? (T*)((char*)this + m_off) : 0; }
+
+        /// Points at p
+        void set(T *p) { m_off = p ? (char*)p - (char*)this : 0; }
+
+        T* operator -> () const { return get(); }
+        T& operator * () const { return *get(); }
+        explicit operator bool () const { return 0 != m_off; }
+
+    private:
+
+        /// Bytes from this to the target, zero for null
+        std::intptr_t       m_off;
+    };
+
+
+/// Allocator for a shared memory share
+/**
+    Any process that opens the same name allocates from and frees to
+    the same arena. Blocks come in power of two size classes, 16 bytes
+    and up, each with its own free list, and new ones are carved from
+    the end of what was used so far. The arena never grows, alloc()
+    returns null when it is full.
+
+    The share can be mapped at a different address in each process, so
+    structures in it link with shm_ptr, and offset() / at() pass blocks
+    between processes as numbers. What goes in it must not hold plain
+    pointers or anything that allocates outside the share.
+
+    The lock is an shm_mutex and every change to the free lists and
+    the top commits with one store, so a process killed inside alloc()
+    or free() leaks one block at worst. used() is kept by a second
+    store and counted again from the lists when the lock is taken over.
+
+    @code
+        zru::shm_arena a;
+        a.open("/tables", 64 << 20);
+
+        struct node { int v; zru::shm_ptr<node> next; };
+        node *n = a.create<node>();
+        a.set_root(n);
+
+        // Another process
+        node *n = (node*)a.root();
+    @endcode
+*/
+class shm_arena
+{
+public:
+
+    /// Default constructor
+    shm_arena() : m_pHdr(0), m_pBase(0) {}
+
+    /// Default destructor
+    ~shm_arena() { close(); }
+
+    /// Opens the arena, creating it if needed
+    /**
+        @param [in] sName   - Share name, starts with '/'
+        @param [in] nSize   - Bytes in the share, must match if the
+                              arena already exists
+        @param [in] bCreate - Non-zero to create the arena if it doesn't exist
+    */
+    bool open(const t_str &sName, int64_t nSize, bool bCreate = true);
+
+    /// Unmaps the arena, the creator also removes the name
+    void close();
+
+    /// Non-zero if the arena is open
+    bool isOpen() const { return m_pHdr ? true : false; }
+
+public:
+
+    /// Allocates n bytes aligned to 16, null if the arena is full
+    void* alloc(std::size_t n);
+
+    /// Frees a block from alloc()
+    void free(void *p);
+
+    /// Allocates and constructs a T
+    template<typename T, typename... A>
+        T* create(A&&... a)
+        {   void *p = alloc(sizeof(T));
+            return p ? new (p) T(std::forward<A>(a)...) : 0;
+        }
+
+    /// Destroys and frees a T from create()
+    template<typename T>
+        void destroy(T *p)
+        {   if (p)
+            {   p->~T();
+                free(p);
+            }
+        }
+
+    /// Returns the offset of p in the arena, zero for null
+    uint64_t offset(const void *p) const { return p ? (uint64_t)((const char*)p - m_pBase) : 0; }
+
+    /// Returns the block at an offset from offset()
+    void* at(uint64_t off) const { return off ? m_pBase + off : 0; }
+
+    /// Returns the block at an offset as a T
+    template<typename T>
+        T* at(uint64_t off) const { return (T*)at(off); }
+
+    /// Returns the root block, where processes find what the arena holds
+    void* root() const;
+
+    /// Sets the root if it is still pExpected, returns non-zero if it was set
+    bool set_root(void *p, void *pExpected = 0);
+
+public:
+
+    /// Bytes blocks can be carved from
+    std::size_t capacity() const;
+
+    /// Bytes in allocated blocks, headers and rounding included
+    std::size_t used() const;
+
+    /// Times the lock was taken over from a process that died holding it
+    uint64_t recovered() const;
+
+private:
+
+    /// Shared header
+    struct header
+    {
+        /// Set last by the creator
+        std::atomic<uint32_t>               magic;
+        uint32_t                            version;
+        uint64_t                            size;
+
+        /// Offset of the root block
+        std::atomic<uint64_t>               root;
+
+        /// Guards everything below
+        alignas(64) shm_mutex               lock;
+
+        /// Offset of the first byte never handed out
+        uint64_t                            top;
+
+        /// Bytes in allocated blocks
+        uint64_t                            used;
+
+        /// Locks taken over from dead owners
+        uint64_t                            recovered;
+
+        /// First free block in each size class
+        uint64_t                            free[48];
+    };
+
+    /// Space before the first block
+    enum { eHeaderSize = (sizeof(header) + 63) & ~63 };
+
+    /// Bytes in front of each block, keeps blocks aligned to 16
+    enum { eBlockHeader = 16 };
+
+    /// Locks the header, counting takeovers and recounting used() after one
+    void _lock();
+
+private:
+
+    /// The shared memory
+    shrmem              m_mem;
+
+    /// Header in the share
+    header              *m_pHdr;
+
+    /// Start of the share, offsets count from here
+    char                *m_pBase;
+};
+
+} // end namespace
@@ -0,0 +1,212 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace zru
+{
+
+/// Hash table of string keys and scalar values in shared memory
+/**
+    Any process that opens the same name sees the same table. Values
+    are the scalar zru::any types, bool, the integers, float and
+    double. Strings, pointers and long double can't be shared this way.
+
+    Reads take no lock. Each slot has a sequence count that is odd
+    while it is being written, and a read that overlaps a write tries
+    again. Writers lock one of 64 robust stripes picked by the key, so
+    writes to different keys rarely wait on each other.
+
+    The table is open addressed with linear probing and never grows.
+    A key keeps its slot once added, erase() only clears the value, so
+    a table of churning keys must be sized for all of them.
+
+    @code
+        zru::shm_map m;
+        m.open("/settings", 4096);
+
+        // Writer
+        m.set("rate", 44100);
+
+        // Reader, in another process
+        zru::any v;
+        if (m.get("rate", v))
+            use(v.toInt());
+    @endcode
+*/
+class shm_map
+{
+public:
+
+    /// Default constructor
+    shm_map() : m_pHdr(0), m_pSlots(0), m_nMask(0), m_nSlot(0), m_nKeyMax(0) {}
+
+    /// Default destructor
+    ~shm_map() { close(); }
+
+    /// Opens the table, creating it if needed
+    /**
+        @param [in] sName       - Share name, starts with '/'
+        @param [in] nCapacity   - Number of keys, rounded up to a power of two
+        @param [in] bCreate     - Non-zero to create the table if it doesn't exist
+        @param [in] nKeyMax     - Longest key in bytes
+
+        Capacity and key length must match if the table already exists.
+    */
+    bool open(const t_str &sName, uint64_t nCapacity, bool bCreate = true, int nKeyMax = 40);
+
+    /// Unmaps the table, the creator also removes the name
+    void close();
+
+    /// Non-zero if the table is open
+    bool isOpen() const { return m_pHdr ? true : false; }
+
+    /// Number of slots
+    uint64_t capacity() const { return m_pHdr ? m_nMask + 1 : 0; }
+
+    /// Longest key in bytes
+    int key_max() const { return m_nKeyMax; }
+
+    /// Number of keys with values
+    uint64_t size() const;
+
+    /// Times a stripe lock was taken over from a process that died holding it
+    uint64_t recovered() const;
+
+public:
+
+    /// Sets a value
+    /**
+        @return false if the value isn't a scalar, the key is too long, or
+                the table is full
+    */
+    bool set(const t_str &sKey, const any &v);
+
+    /// Gets a value, returns false if the key has none
+    bool get(const t_str &sKey, any &v) const;
+
+    /// Returns a value, void if the key has none
+    any get(const t_str &sKey) const { any v; get(sKey, v); return v; }
+
+    /// Non-zero if the key has a value
+    bool isset(const t_str &sKey) const { any v; return get(sKey, v); }
+
+    /// Clears a value, returns false if the key had none
+    bool erase(const t_str &sKey);
+
+    /// Calls f(key, value) for every key with a value
+    void each(const std::function<void(const t_str&, const any&)> &f) const;
+
+private:
+
+    /// Shared header
+    struct header
+    {
+        /// Set last by the creator
+        std::atomic<uint32_t>               magic;
+        uint32_t                            version;
+        uint64_t                            capacity;
+        uint32_t                            key_max;
+
+        /// Keys with values
+        alignas(64) std::atomic<uint64_t>   count;
+
+        /// Stripe locks taken over from dead owners
+        std::atomic<uint64_t>               recovered;
+
+        /// Writers lock the stripe of their key
+        alignas(64) shm_mutex               stripe[64];
+    };
+
+    /// One key and its value
+    struct slot
+    {
+        /// Odd while being written, zero while the slot is empty
+        std::atomic<uint32_t>               seq;
+
+        /// Hash of the key, never zero once set
+        std::atomic<uint32_t>               hash;
+
+        /// any type of the value, at_void if it has none
+        std::atomic<uint32_t>               type;
+
+        /// Key length
+        uint32_t                            klen;
+
+        /// Value bits
+        std::atomic<uint64_t>               value;
+
+        /// Key bytes follow
+    };
+
+    /// Space before the first slot
+    enum { eHeaderSize = (sizeof(header) + 63) & ~63 };
+
+    /// Slot i
+    slot* _slot(uint64_t i) const { return (slot*)(m_pSlots + (i & m_nMask) * m_nSlot); }
+
+    /// Key bytes of a slot
+    static char* _key(slot *s) { return (char*)s + sizeof(slot); }
+
+    /// Finds the slot of a key, null if it isn't there
+    slot* _find(const t_str &sKey, uint32_t h) const;
+
+    /// Locks a stripe and repairs what a dead owner left half written
+    void _lock(int nStripe);
+
+private:
+
+    /// The shared memory
+    shrmem              m_mem;
+
+    /// Header in the share
+    header              *m_pHdr;
+
+    /// First slot
+    char                *m_pSlots;
+
+    /// Capacity - 1
+    uint64_t            m_nMask;
+
+    /// Bytes per slot
+    uint64_t            m_nSlot;
+
+    /// Longest key
+    int                 m_nKeyMax;
+};
+
+} // end namespace
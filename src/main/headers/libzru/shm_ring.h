@@ -0,0 +1,227 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace zru
+{
+
+/// Ring of variable length records in shared memory
+/**
+    Any number of producers, one consumer, in any processes that open
+    the same name. Records are written and read in place: reserve()
+    hands out room in the ring and commit() publishes it, peek() shows
+    the oldest record and release() drops it. A record never wraps, if
+    it doesn't fit before the end of the ring the rest of the lap is
+    skipped.
+
+    Nothing blocks unless asked to. A consumer with nothing to read and
+    a producer with no room sleep on a futex in the shared header, and
+    the other side only makes a system call when someone is sleeping.
+    Producers waiting for room are woken once half the ring is free.
+
+    @code
+        zru::shm_ring r;
+        r.open("/jobs", 1 << 20);
+
+        // Producer
+        if (void *p = r.reserve(n, 100))
+        {   fill(p, n);
+            r.commit(p);
+        }
+
+        // Consumer
+        std::size_t n;
+        if (const void *p = r.peek(n, 100))
+        {   use(p, n);
+            r.release(p);
+        }
+    @endcode
+*/
+class shm_ring
+{
+public:
+
+    /// Flags for open()
+    enum
+    {
+        /// Only one thread ever produces, reserve() can skip the compare and swap
+        eSingleProducer     = 0x01
+    };
+
+public:
+
+    /// Default constructor
+    shm_ring() : m_pHdr(0), m_pData(0), m_nMask(0), m_nFlags(0) {}
+
+    /// Default destructor
+    ~shm_ring() { close(); }
+
+    /// Opens the ring, creating it if needed
+    /**
+        @param [in] sName   - Share name, starts with '/'
+        @param [in] nSize   - Bytes for records, rounded up to a power of two
+                              and at least 4096, must match if the ring
+                              already exists
+        @param [in] bCreate - Non-zero to create the ring if it doesn't exist
+        @param [in] nFlags  - eSingleProducer, used when creating
+
+        Returns false if it can't be mapped, or an existing ring doesn't
+        look like one of ours.
+    */
+    bool open(const t_str &sName, int64_t nSize, bool bCreate = true, int nFlags = 0);
+
+    /// Unmaps the ring, the creator also removes the name
+    void close();
+
+    /// Non-zero if the ring is open
+    bool isOpen() const { return m_pHdr ? true : false; }
+
+    /// Bytes for records
+    std::size_t capacity() const { return m_pHdr ? (std::size_t)m_nMask + 1 : 0; }
+
+    /// Largest record that can be reserved, one and a skipped lap fit in half the ring
+    /**
+        Lengths are kept in 32 bits with ePad as the top bit, so records
+        stay under 2 GiB however big the ring is.
+    */
+    std::size_t max_record() const
+    {   return m_pHdr ? std::min<std::size_t>(capacity() / 4, (std::size_t)ePad) - 64 : 0; }
+
+    /// Bytes in use, including record headers and skipped space
+    std::size_t size() const;
+
+    /// Non-zero if there is nothing to read
+    bool empty() const { return !size(); }
+
+public:
+
+    /// Reserves room for a record
+    /**
+        @param [in] nBytes  - Record size
+        @param [in] lMs     - How long to wait for room
+
+        @return Where to write the record, or null if there was no room
+                in time. Pass it to commit() once written.
+    */
+    void* reserve(std::size_t nBytes, long lMs = 0);
+
+    /// Publishes a record from reserve()
+    void commit(void *p);
+
+    /// Copies a record into the ring
+    bool push(const void *p, std::size_t nBytes, long lMs = 0);
+
+    /// Returns the oldest record without removing it
+    /**
+        @param [out] nBytes - Record size
+        @param [in] lMs     - How long to wait for one
+
+        @return The record, or null if there was none in time. Only the
+                consumer may call this, and must release() the record
+                before the next peek().
+    */
+    const void* peek(std::size_t &nBytes, long lMs = 0);
+
+    /// Drops the record from peek()
+    void release(const void *p);
+
+    /// Copies out and drops the oldest record
+    bool pop(t_str &s, long lMs = 0);
+
+private:
+
+    /// Shared header, each side's hot words on its own cache line
+    struct header
+    {
+        /// Set last by the creator
+        std::atomic<uint32_t>               magic;
+        uint32_t                            version;
+        uint64_t                            size;
+        uint32_t                            flags;
+
+        /// Consumer position
+        alignas(64) std::atomic<uint64_t>   head;
+
+        /// Next free byte, producers move it
+        alignas(64) std::atomic<uint64_t>   tail;
+
+        /// Bumped to wake the consumer, and whether it sleeps
+        alignas(64) std::atomic<uint32_t>   data_seq;
+        std::atomic<uint32_t>               data_wait;
+
+        /// Bumped to wake producers, and how many sleep
+        alignas(64) std::atomic<uint32_t>   space_seq;
+        std::atomic<uint32_t>               space_wait;
+    };
+
+    /// Space before the records
+    enum { eHeaderSize = (sizeof(header) + 63) & ~63 };
+
+    /// Bytes in front of each record
+    enum { eRecHeader = 8 };
+
+    /// Marks the skipped rest of a lap
+    enum { ePad = 0x80000000 };
+
+    /// The word at the front of a record, zero until committed
+    std::atomic<uint32_t>* _word(uint64_t pos) { return (std::atomic<uint32_t>*)(m_pData + (pos & m_nMask)); }
+
+    /// Wakes the consumer if it is asleep
+    void _wake_consumer();
+
+    /// Wakes producers if any are asleep
+    void _wake_producers();
+
+private:
+
+    /// The shared memory
+    shrmem              m_mem;
+
+    /// Header in the share
+    header              *m_pHdr;
+
+    /// First record byte
+    char                *m_pData;
+
+    /// Capacity - 1
+    uint64_t            m_nMask;
+
+    /// Flags it was created with
+    int                 m_nFlags;
+};
+
+} // end namespace
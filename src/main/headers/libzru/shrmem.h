@@ -38,10 +38,73 @@ namespace zru
 class shrmem
 {
 
+public:
+
+    /// How the share is mapped, the defaults change nothing
+    /**
+        Options that only place or pin pages are hints, if one fails it
+        is logged and the share works without it. Huge pages change
+        where the share lives, so open() fails without them.
+    */
+    struct options
+    {
+        /// Back the share with huge pages from a hugetlbfs mount, the size rounds up to whole pages
+        bool            huge = false;
+
+        /// Where hugetlbfs is mounted, the share is a file in it
+        t_str           hugetlbfs = "/dev/hugepages";
+
+        /// Ask for transparent huge pages, needs shmem_enabled set to advise or always
+        bool            thp = false;
+
+        /// Fault every page in now rather than on first touch
+        bool            populate = false;
+
+        /// Keep the pages in memory, usually needs a raised RLIMIT_MEMLOCK
+        bool            lock = false;
+
+        /// NUMA node to put new pages on, -1 for the default policy
+        int             node = -1;
+
+        /// Keep the size and a generation in a header so grow() and remap() work
+        /**
+            ptr() and size() then cover only what follows the header.
+            Every process opening the share must set this.
+        */
+        bool            growable = false;
+    };
+
+    /// Flags for open_file()
+    enum
+    {
+        /// Map the file read only, it must exist and writing to the map faults
+        eReadOnly       = 0x01,
+
+        /// Create the file if it doesn't exist
+        eCreate         = 0x02
+    };
+
+    enum
+    {
+        /// Bytes in front of a growable share
+        eGrowHeader     = 64
+    };
+
+    /// Access patterns for advise()
+    enum
+    {
+        eAdviseNormal       = 0,
+        eAdviseSequential   = 1,
+        eAdviseRandom       = 2,
+        eAdviseWillNeed     = 3,
+        eAdviseDontNeed     = 4
+    };
+
 public:
 
     /// Default constructor
-    shrmem() : m_fd((void*)-1), m_pMem((void*)-1), m_sz(0), m_bExisting(false) {}
+    shrmem() : m_fd((void*)-1), m_pMem((void*)-1), m_sz(0), m_nOff(0), m_nGen(0), m_bExisting(false),
+               m_bHuge(false), m_bFile(false), m_bReadOnly(false), m_bGrow(false) {}
 
     /// Default destructor
     ~shrmem() { close(); }
@@ -49,29 +112,105 @@ public:
     /// Close shared memory
     void close();
 
-    /// Create a new shared memory region
+    /// Create a new shared memory region, or open an existing one of at least sz bytes
     bool open(const t_str &sFile, int64_t sz, bool bCreate = true);
 
+    /// Create or open a shared memory region, mapped as opt says
+    bool open(const t_str &sFile, int64_t sz, bool bCreate, const options &opt);
+
+    /// Maps a regular file, its contents outlive the process and the machine
+    /**
+        @param [in] sPath   - Path to the file
+        @param [in] sz      - Bytes to map, 0 maps the whole file. A writable
+                              file shorter than sz is extended with zeros.
+        @param [in] nFlags  - eReadOnly, eCreate
+        @param [in] opt     - Mapping options, huge is not supported for files
+
+        The file is never removed on close(), call flush() before then if
+        the data must be on disk.
+    */
+    bool open_file(const t_str &sPath, int64_t sz, int nFlags, const options &opt);
+
+    /// Maps a regular file with the default options
+    bool open_file(const t_str &sPath, int64_t sz = 0, int nFlags = eCreate);
+
+    /// Writes dirty pages back to the file
+    /**
+        @param [in] bWait   - Wait for the write to finish, or just start it
+        @param [in] off     - Offset of the first byte to write
+        @param [in] len     - Bytes to write, -1 for the rest of the map
+
+        Only useful for open_file(), a share has no file to write to.
+    */
+    bool flush(bool bWait = true, int64_t off = 0, int64_t len = -1);
+
+    /// Tells the kernel how a range will be used, one of eAdvise*
+    bool advise(int nAdvice, int64_t off = 0, int64_t len = -1);
+
+    /// Grows a growable share in place to at least sz bytes
+    /**
+        @param [in] sz  - New size, not counting the header
+
+        Extends the share and remaps it, which may move it, so pointers
+        into the share must be taken again from ptr(). Other processes
+        see the new generation and pick it up with remap(), until then
+        their old mapping stays valid. A share never shrinks.
+    */
+    bool grow(int64_t sz);
+
+    /// Maps all of a growable share if another process has grown it
+    /**
+        Cheap when nothing changed, one atomic load. Pointers into the
+        share must be taken again if this remapped it.
+    */
+    bool remap();
+
+    /// Returns non-zero if a growable share has grown since it was last mapped
+    bool isStale();
+
+    /// Returns the generation of the mapping, counts the times the share grew
+    uint64_t generation() { return m_nGen; }
+
+    /// Returns non-zero if the share is growable
+    bool isGrowable() { return m_bGrow; }
+
+    /// Returns non-zero if the share is a mapped file
+    bool isFile() { return m_bFile; }
+
+    /// Returns non-zero if the map is read only
+    bool isReadOnly() { return m_bReadOnly; }
+
     /// Returns non-zero if the share already exists
     bool isExisting() { return m_bExisting; }
 
+    /// Returns non-zero if the share is on huge pages
+    bool isHuge() { return m_bHuge; }
+
     /// Returns a pointer to the share
-    void* ptr() { return ((void*)-1 != m_pMem) ? m_pMem : 0; }
+    void* ptr() { return ((void*)-1 != m_pMem) ? (char*)m_pMem + m_nOff : 0; }
 
     /// Returns a char* to the share
-    char* str() { return (char*)(((void*)-1 != m_pMem) ? m_pMem : 0); }
+    char* str() { return ((void*)-1 != m_pMem) ? (char*)m_pMem + m_nOff : 0; }
 
     /// Returns the shares memory size
-    int64_t size() { return m_sz;}
+    int64_t size() { return m_sz - m_nOff; }
 
     /// Returns the shares file name
     t_str getFileName() { return m_sFile; }
 
+private:
+
+    /// Maps sz bytes of m_fd and applies the hints in opt
+    bool map(int64_t sz, const options &opt);
+
 private:
 
     /// Share name
     t_str               m_sFile;
 
+    /// File it lives in, differs from the name on hugetlbfs
+    t_str               m_sPath;
+
     /// File handle
     void*               m_fd;
 
@@ -81,9 +220,27 @@ private:
     /// Size of the memory buffer
     int64_t             m_sz;
 
+    /// Offset of the users memory, past the header of a growable share
+    int64_t             m_nOff;
+
+    /// Generation the mapping was made at
+    uint64_t            m_nGen;
+
     /// Sets to non zero if the share already exists
     bool                m_bExisting;
 
+    /// Non-zero if the share is on hugetlbfs
+    bool                m_bHuge;
+
+    /// Non-zero if the share is a regular file from open_file()
+    bool                m_bFile;
+
+    /// Non-zero if the map is read only
+    bool                m_bReadOnly;
+
+    /// Non-zero if the share has a grow header
+    bool                m_bGrow;
+
 };
 
 } // end namespace
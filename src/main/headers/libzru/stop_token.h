@@ -0,0 +1,186 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <functional>
+
+namespace zru
+{
+
+class stop_source;
+class stop_callback;
+
+/// Sees whether a stop has been asked for
+/**
+    Cheap to copy, all copies share the state of the stop_source they
+    came from. A default constructed token can never be stopped.
+
+    Each thread has a current token, worker_thread sets it to its own
+    while it runs. The blocking property_bag_ts calls, pop(), popv(),
+    wait(), wait_multiple(), named_wait() and the named queues, return
+    early once the current token is stopped.
+
+    @code
+        while (!zru::stop_token::current().stop_requested())
+            if (zru::pb.pop(p, ".", "jobs", 60000))
+                run(p);
+    @endcode
+*/
+class stop_token
+{
+    friend class stop_source;
+    friend class stop_callback;
+
+    /// Shared by a source and its tokens
+    struct state
+    {
+        /// Set once
+        std::atomic<bool>                       stop{false};
+
+        /// Protects the callback list, held while callbacks run
+        std::mutex                              lock;
+
+        /// Registered callbacks
+        std::list<std::function<void()>*>       cbs;
+    };
+
+    typedef std::shared_ptr<state> t_state;
+
+public:
+
+    /// Default constructor, a token that never stops
+    stop_token() {}
+
+    /// Non-zero once a stop has been requested
+    bool stop_requested() const { return m_s && m_s->stop.load(std::memory_order_acquire); }
+
+    /// Non-zero if this token came from a stop_source
+    bool stop_possible() const { return m_s ? true : false; }
+
+    /// The calling thread's current token, see stop_scope
+    static stop_token current();
+
+private:
+
+    stop_token(const t_state &s) : m_s(s) {}
+
+    /// Shared state
+    t_state             m_s;
+};
+
+/// Makes a token current for the calling thread until it goes out of scope
+class stop_scope
+{
+public:
+
+    /// Constructor
+    explicit stop_scope(const stop_token &t);
+
+    /// Puts back the token that was current before
+    ~stop_scope();
+
+    stop_scope(const stop_scope&) = delete;
+    stop_scope& operator = (const stop_scope&) = delete;
+
+private:
+
+    /// Token to put back
+    stop_token          m_prev;
+};
+
+/// Asks the tokens it hands out to stop
+class stop_source
+{
+public:
+
+    /// Default constructor
+    stop_source() : m_s(std::make_shared<stop_token::state>()) {}
+
+    /// Returns a token that sees this source
+    stop_token get_token() const { return stop_token(m_s); }
+
+    /// Non-zero once a stop has been requested
+    bool stop_requested() const { return m_s->stop.load(std::memory_order_acquire); }
+
+    /// Requests a stop and runs the callbacks, returns false if it was already requested
+    bool request_stop();
+
+private:
+
+    /// Shared state
+    stop_token::t_state     m_s;
+};
+
+/// Runs a function when a token is stopped
+/**
+    The function runs on the thread that requests the stop, or right
+    away in the constructor if the stop has already been requested.
+    Once the destructor returns the function is not running and won't
+    be called. The function must not create or destroy callbacks on
+    the same token.
+*/
+class stop_callback
+{
+public:
+
+    /// Constructor
+    /**
+        @param [in] t   - Token to watch
+        @param [in] f   - Function to call when it is stopped
+    */
+    stop_callback(const stop_token &t, std::function<void()> f);
+
+    /// Destructor
+    ~stop_callback();
+
+    stop_callback(const stop_callback&) = delete;
+    stop_callback& operator = (const stop_callback&) = delete;
+
+private:
+
+    /// State we are registered with, null if not registered
+    stop_token::t_state                                     m_s;
+
+    /// Function to call
+    std::function<void()>                                   m_f;
+
+    /// Where we are in the callback list
+    std::list<std::function<void()>*>::iterator             m_it;
+};
+
+} // end namespace
@@ -142,6 +142,145 @@ namespace zru::str
         return x_def;
     }
 
+    /// Precomputed character set for fast scanning
+    /**
+        Build once and reuse, membership is a table lookup rather than
+        a search of the set string.  Byte strings are scanned with
+        SSE2 / AVX2 when available.
+
+        @code
+            static const zru::str::char_class ccWhiteSpace(" \t\r\n");
+            zru::str::find_first_not_of(s, ccWhiteSpace, pos);
+        @endcode
+    */
+    class char_class
+    {
+    public:
+
+        /// Maximum set size handled by the vector kernels
+        enum { max_simd = 16 };
+
+        /// Empty set
+        char_class() { memset(m_t, 0, sizeof(m_t)); m_n = 0; }
+
+        /// Set of the characters in s
+        template<typename t_char>
+            explicit char_class(const t_char *s) : char_class()
+            {   while (s && *s)
+                    add(*s++);
+            }
+
+        /// Set of the characters in s
+        template<typename t_char, typename t_traits, typename t_alloc>
+            explicit char_class(const std::basic_string<t_char, t_traits, t_alloc> &s) : char_class()
+            {   for (auto ch : s)
+                    add(ch);
+            }
+
+        /// Adds a character to the set
+        template<typename t_char>
+            void add(t_char ch)
+            {
+                unsigned long c = (typename std::make_unsigned<t_char>::type)ch;
+                if (256 <= c)
+                {   if (std::wstring::npos == m_wide.find((wchar_t)c))
+                        m_wide += (wchar_t)c;
+                    return;
+                }
+                if (m_t[c])
+                    return;
+                m_t[c] = true;
+                if (max_simd > m_n)
+                    m_v[m_n] = (char)c;
+                m_n++;
+            }
+
+        /// Returns non-zero if ch is in the set
+        template<typename t_char>
+            bool has(t_char ch) const
+            {
+                unsigned long c = (typename std::make_unsigned<t_char>::type)ch;
+                if (256 > c)
+                    return m_t[c];
+                return std::wstring::npos != m_wide.find((wchar_t)c);
+            }
+
+        /** Scans bytes
+            @param[in]  p       - Bytes to scan
+            @param[in]  n       - Number of bytes
+            @param[in]  bIn     - true to stop on a member, false to stop on a non-member
+
+            @returns Offset of the first byte that stops the scan, or n
+        */
+        std::size_t scan(const char *p, std::size_t n, bool bIn) const;
+
+    private:
+
+        /// Membership table
+        bool            m_t[256];
+
+        /// Members, for the vector kernels
+        char            m_v[max_simd];
+
+        /// Number of byte members
+        int             m_n;
+
+        /// Members above 255
+        std::wstring    m_wide;
+    };
+
+    /// Finds the first character in the string that is in the set
+    /**
+        @param[in]      x_sStr          - String to search
+        @param[in]      x_cc            - Characters to find
+        @param[in,out]  pos             - Starting / Ending position in string
+        @param[in]      max             - Maximum position in string to process
+    */
+    template<typename t_str>
+        typename t_str::size_type find_first_of(const t_str &x_sStr, const char_class &x_cc,
+                                                    typename t_str::size_type &pos,
+                                                    typename t_str::size_type max = -1)
+    {
+        zruCHECK_MAX(x_sStr, max);
+
+        if (pos >= max)
+            return t_str::npos;
+
+        if (1 == sizeof(typename t_str::value_type))
+            pos += x_cc.scan((const char*)x_sStr.data() + pos, max - pos, true);
+        else
+            while (pos < max && !x_cc.has(x_sStr[pos]))
+                pos++;
+
+        return (pos < max) ? pos : t_str::npos;
+    }
+
+    /// Finds the first character in the string that is *not* in the set
+    /**
+        @param[in]      x_sStr          - String to search
+        @param[in]      x_cc            - Characters to skip
+        @param[in,out]  pos             - Starting / Ending position in string
+        @param[in]      max             - Maximum position in string to process
+    */
+    template<typename t_str>
+        typename t_str::size_type find_first_not_of(const t_str &x_sStr, const char_class &x_cc,
+                                                    typename t_str::size_type &pos,
+                                                    typename t_str::size_type max = -1)
+    {
+        zruCHECK_MAX(x_sStr, max);
+
+        if (pos >= max)
+            return t_str::npos;
+
+        if (1 == sizeof(typename t_str::value_type))
+            pos += x_cc.scan((const char*)x_sStr.data() + pos, max - pos, false);
+        else
+            while (pos < max && x_cc.has(x_sStr[pos]))
+                pos++;
+
+        return (pos < max) ? pos : t_str::npos;
+    }
+
     /// Finds the first character in the string that is in the list
     /**
         @param[in]      x_sStr          - String to search
@@ -458,17 +597,18 @@ namespace zru::str
     }
 
     template <typename t_str, typename... Args>
-        t_str join(const t_str &sSep, Args... args)
+        t_str join(const t_str &sSep, const Args&... args)
         {
             t_str r;
-            std::stringstream ss;
-            std::vector<zru::any> vec = {args...};
-            for (size_t i = 0; i < vec.size(); i++)
+            bool bFirst = true;
+            auto add = [&](const zru::any &v)
             {
-                if (0 < i)
+                if (!bFirst)
                     r += sSep;
-                r += vec[i].toString();
-            }
+                bFirst = false;
+                r += v.toString();
+            };
+            (add(args), ...);
             return r;
         }
 
@@ -32,6 +32,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+
 namespace zru
 {
 
@@ -40,5 +43,33 @@ namespace zru
     */
     void install_ctrl_c_handler(volatile int *fCount);
 
+    /** Sleeps while *p equals v
+        @param [in] p       - Word to wait on
+        @param [in] v       - Value to sleep on
+        @param [in] lMs     - Maximum time to wait in milliseconds, less than zero waits forever
+        @param [in] bShared - Non-zero if p is in memory shared between processes
+
+        Returns false on timeout. May return early, callers must check
+        the word again. Uses a futex on Linux, elsewhere it naps.
+    */
+    bool futex_wait(std::atomic<uint32_t> *p, uint32_t v, long lMs, bool bShared = false);
+
+    /** Wakes up to n threads sleeping in futex_wait() on p
+        @param [in] p       - Word to wake
+        @param [in] n       - Maximum number of threads to wake
+        @param [in] bShared - Non-zero if p is in memory shared between processes
+    */
+    void futex_wake(std::atomic<uint32_t> *p, int n, bool bShared = false);
+
+    /// Tells the cpu we are spinning
+    inline void cpu_relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
 
 } // end namespace
@@ -0,0 +1,155 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+#pragma once
+
+#include <deque>
+#include <future>
+#include <atomic>
+#include <tuple>
+#include <type_traits>
+
+namespace zru
+{
+
+/// Fixed size pool of worker threads
+/**
+    Each worker has its own task queue. A worker takes the newest task
+    from its own queue and, when that is empty, steals the oldest task
+    from another worker, so tasks that spawn tasks stay on one thread
+    while idle threads pick up the slack. Tasks submitted from outside
+    the pool are dealt round robin.
+
+    @code
+        zru::thread_pool tp(4);
+        auto f = tp.submit([](int a, int b) { return a + b; }, 1, 2);
+        int n = f.get();
+    @endcode
+*/
+class thread_pool
+{
+public:
+
+    /// Task type
+    typedef std::function< void () > t_task;
+
+public:
+
+    /// Constructor
+    /**
+        @param [in] nThreads - Number of threads, zero for one per cpu
+    */
+    explicit thread_pool(std::size_t nThreads = 0);
+
+    /// Stops the threads, tasks not yet started are dropped
+    ~thread_pool();
+
+    /// Queues a task
+    void post(t_task f);
+
+    /// Queues f(a...) and returns a future for the result
+    /**
+        f and a are copied or moved in, as std::thread does, and moved
+        into the call, so move only arguments work.
+    */
+    template<typename F, typename... A>
+        auto submit(F &&f, A&&... a) -> std::future< std::invoke_result_t<std::decay_t<F>, std::decay_t<A>...> >
+        {
+            typedef std::invoke_result_t<std::decay_t<F>, std::decay_t<A>...> t_ret;
+
+            auto t = std::make_shared< std::packaged_task<t_ret()> >(
+                        [f = std::decay_t<F>(std::forward<F>(f)), args = std::tuple<std::decay_t<A>...>(std::forward<A>(a)...)]() mutable
+                        {   return std::apply(std::move(f), std::move(args)); });
+
+            std::future<t_ret> r = t->get_future();
+
+            post([t]() { (*t)(); });
+
+            return r;
+        }
+
+    /// Number of threads
+    std::size_t size() const { return m_w.size(); }
+
+    /// Number of tasks waiting to run
+    long pending() const { return m_nPending.load(); }
+
+    /// Returns the pool the calling thread belongs to or null
+    static thread_pool* current();
+
+private:
+
+    /// One thread and its tasks
+    struct worker
+    {
+        explicit worker(worker_thread::pfn_Worker fInit, worker_thread::pfn_Worker fRun)
+            : thread(fInit, fRun, 0, false) {}
+
+        /// Tasks, the owner works from the back, thieves from the front
+        std::deque<t_task>          q;
+
+        /// Protects q
+        std::mutex                  lock;
+
+        /// The thread
+        worker_thread               thread;
+    };
+
+    /// Thread loop
+    int _run(std::size_t i);
+
+    /// Gets a task for worker i, its own first
+    bool _take(std::size_t i, t_task &t);
+
+private:
+
+    /// The workers
+    std::vector< std::unique_ptr<worker> >  m_w;
+
+    /// Next worker for tasks from outside the pool
+    std::atomic<std::size_t>                m_nNext;
+
+    /// Tasks queued and not yet taken
+    std::atomic<long>                       m_nPending;
+
+    /// Threads sleeping on m_cv
+    std::atomic<long>                       m_nIdle;
+
+    /// Non-zero when shutting down
+    std::atomic<bool>                       m_bStop;
+
+    /// Idle threads sleep here
+    std::mutex                              m_lock;
+    std::condition_variable                 m_cv;
+};
+
+} // end namespace
@@ -0,0 +1,216 @@
+/*------------------------------------------------------------------
+// Copyright (c) 2020
+// Robert Umbehant
+// libzru@wheresjames.com
+// http://www.wheresjames.com
+//
+// Redistribution and use in source and binary forms, with or
+// without modification, are permitted for commercial and
+// non-commercial purposes, provided that the following
+// conditions are met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+// * The names of the developers or contributors may not be used to
+//   endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+//   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+//   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+//   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//   NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+//   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//   OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+//   EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//----------------------------------------------------------------*/
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace zru
+{
+
+/// Runs many periodic callbacks on one thread
+/**
+    Callbacks follow the worker_thread contract, they return the
+    number of milliseconds until they should run again, or a negative
+    number to stop. Timers live in a hierarchical wheel, 256 one
+    millisecond slots and three levels of 64 coarser slots, so adding,
+    removing and expiring a timer are constant time however many
+    there are. Timers further out than about 18 hours wait in an
+    overflow list.
+
+    Callbacks run on the wheel thread, or on a thread_pool if one is
+    given. A callback never runs twice at the same time.
+
+    @code
+        zru::timer_wheel tw;
+        auto id = tw.add([]() { poll(); return 100; });
+        ...
+        tw.remove(id);
+    @endcode
+*/
+class timer_wheel
+{
+public:
+
+    /// Callback, returns ms until the next run or less than zero to stop
+    typedef std::function< int () > pfn_Timer;
+
+    /// Timer id
+    typedef uint64_t t_id;
+
+public:
+
+    /// Constructor
+    /**
+        @param [in] bStart  - Non-zero to start the wheel thread, otherwise
+                              time only moves when tick() is called
+        @param [in] pPool   - Pool to run the callbacks on, null to run them
+                              on the wheel thread. Must outlive the wheel.
+    */
+    explicit timer_wheel(bool bStart = true, thread_pool *pPool = 0);
+
+    /// Stops the thread and waits for running callbacks
+    ~timer_wheel();
+
+    /// Adds a callback to run in lMs milliseconds, returns its id
+    t_id add(pfn_Timer f, long lMs = 0);
+
+    /// Removes a timer, returns false if it wasn't found
+    /**
+        A callback that is running finishes but isn't run again.
+    */
+    bool remove(t_id id);
+
+    /// Number of timers
+    std::size_t size();
+
+    /// Moves time forward nMs and runs what comes due, returns the number run
+    /**
+        For a wheel without a thread.
+    */
+    std::size_t tick(long nMs);
+
+private:
+
+    enum
+    {
+        eBits0      = 8,
+        eBits       = 6,
+        eLevels     = 4,
+        eSlots0     = 1 << eBits0,
+        eSlots      = 1 << eBits,
+        eOverflow   = eSlots0 + (eLevels - 1) * eSlots,
+        eNil        = 0xffffffff
+    };
+
+    /// Where a timer is
+    enum { eRunning = -1, eFree = -2 };
+
+    struct timer
+    {
+        pfn_Timer       f;
+        uint64_t        due;
+        uint32_t        next;
+        uint32_t        prev;
+        uint32_t        gen;
+        int32_t         slot;
+        bool            bCancel;
+    };
+
+    /// A callback taken out to run
+    struct job
+    {
+        uint32_t        i;
+        pfn_Timer       f;
+    };
+
+    /// Returns the slot for a due time
+    int32_t _slot(uint64_t due) const;
+
+    /// Links timer i into its slot
+    void _link(uint32_t i);
+
+    /// Unlinks timer i from its slot
+    void _unlink(uint32_t i);
+
+    /// Frees timer i
+    void _free(uint32_t i);
+
+    /// Moves the timers in slot s to where they belong now
+    void _relink(int32_t s);
+
+    /// Moves the level l slot for the current time down
+    void _cascade(int l);
+
+    /// Moves time forward to now, lk is unlocked while callbacks run
+    std::size_t _advance(std::unique_lock<std::mutex> &lk, uint64_t now);
+
+    /// Runs a callback and puts it back
+    void _run(job &j);
+
+    /// Due time lMs from now, at least the next tick
+    uint64_t _due(long lMs) const;
+
+    /// Milliseconds until something may need doing
+    long _next() const;
+
+    /// Milliseconds since we started
+    uint64_t _clock() const;
+
+    /// Wheel thread
+    int _thread();
+
+private:
+
+    /// Timers, free ones are chained through next
+    std::vector<timer>          m_t;
+
+    /// First free timer
+    uint32_t                    m_free;
+
+    /// First timer in each slot
+    std::vector<uint32_t>       m_head;
+
+    /// Number of timers
+    std::size_t                 m_nCount;
+
+    /// Current time in ms
+    uint64_t                    m_now;
+
+    /// Protects everything above
+    std::mutex                  m_lock;
+
+    /// Callbacks out on the pool
+    std::atomic<long>           m_nRunning;
+
+    /// Callbacks go here if set
+    thread_pool                 *m_pPool;
+
+    /// Time zero
+    std::chrono::steady_clock::time_point   m_t0;
+
+    /// Non-zero if time comes from the clock
+    bool                        m_bClock;
+
+    /// When the thread means to wake up
+    uint64_t                    m_wakeAt;
+
+    /// Wakes the thread early
+    signal                      m_wake;
+
+    /// The wheel thread
+    worker_thread               m_thread;
+};
+
+} // end namespace
@@ -36,19 +36,23 @@
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include <atomic>
+#include <vector>
+#include <string>
 
 namespace zru
 {
 
-class signal
+/// Manual reset event on a mutex and condition variable
+class signal_cv
 {
 public:
 
     /// Default constructor
-    signal() { m_b = false; }
+    signal_cv() { m_b = false; }
 
     /// Default destructor
-    ~signal() {}
+    ~signal_cv() {}
 
     /// Release one thread
     void signal_one() { { std::unique_lock<std::mutex> lk(m_m); m_b = true; } m_cv.notify_one(); }
@@ -66,7 +70,7 @@ public:
         if (m_b)
             return true;
         if (0 < lMs)
-            m_cv.wait_for(lk, std::chrono::milliseconds(lMs));
+            m_cv.wait_for(lk, std::chrono::milliseconds(lMs), [this]() { return m_b; });
         return m_b;
     }
 
@@ -79,9 +83,71 @@ private:
     std::condition_variable     m_cv;
 
     /// Variable
-    volatile bool               m_b;
+    bool                        m_b;
+};
+
+#if defined(__linux__)
+
+/// Manual reset event on a futex
+/**
+    Signalling with nobody waiting is one atomic store. A waiter
+    spins for a while before sleeping in the kernel, the spin is cut
+    back when it doesn't pay off. Spinning is off by default on a
+    single cpu, where it only delays the thread we are waiting for.
+*/
+class signal
+{
+public:
+
+    /// Constructor
+    /**
+        @param [in] nMaxSpin - Most times to spin before sleeping, -1 for the default
+    */
+    explicit signal(int nMaxSpin = -1) : m_v(0), m_nWaiters(0), m_nSpin(0)
+    {   set_spin(nMaxSpin); }
+
+    /// Default destructor
+    ~signal() {}
+
+    /// Sets the most times to spin before sleeping, -1 for the default
+    void set_spin(int nMaxSpin) { m_nMaxSpin = 0 > nMaxSpin ? default_spin() : nMaxSpin; }
+
+    /// Default spin, zero on a single cpu
+    static int default_spin() { return 1 < std::thread::hardware_concurrency() ? 4000 : 0; }
+
+    /// Release one thread
+    void signal_one() { m_v.store(1); if (m_nWaiters.load()) futex_wake(&m_v, 1); }
+
+    /// Release all threads
+    void signal_all() { m_v.store(1); if (m_nWaiters.load()) futex_wake(&m_v, -1); }
+
+    /// Resets the signal
+    void reset() { m_v.store(0); }
+
+    /// Wait for specified time
+    bool wait_ms(long lMs);
+
+private:
+
+    /// Non-zero when signaled
+    std::atomic<uint32_t>       m_v;
+
+    /// Number of threads sleeping on m_v
+    std::atomic<int>            m_nWaiters;
+
+    /// Recent spins that paid off
+    std::atomic<int>            m_nSpin;
+
+    /// Spin limit
+    int                         m_nMaxSpin;
 };
 
+#else
+
+typedef signal_cv signal;
+
+#endif
+
 class worker_thread
 {
 public:
@@ -92,6 +158,72 @@ public:
     /// Function type
     typedef std::function< int () > pfn_Worker;
 
+    /// Scheduling policies
+    enum
+    {
+        /// Leave it alone
+        eSchedDefault   = -1,
+
+        /// Normal time sharing
+        eSchedOther     = 0,
+
+        /// Real time, runs until it blocks or something higher comes along
+        eSchedFifo      = 1,
+
+        /// Real time, round robin with others of the same priority
+        eSchedRR        = 2
+    };
+
+    /// Run time histogram buckets, bucket b counts runs under 2^b us, the last takes the rest
+    enum { eHistBuckets = 24 };
+
+    /// Run loop counters, see stats()
+    struct stats_info
+    {
+        /// Thread name from the options
+        std::string             name;
+
+        /// Times the run function returned
+        uint64_t                iterations = 0;
+
+        /// Time spent in the run function
+        uint64_t                busy_ns = 0;
+
+        /// Time spent waiting between runs
+        uint64_t                idle_ns = 0;
+
+        /// Longest single run
+        uint64_t                max_ns = 0;
+
+        /// How long the current run has taken, zero if not in the run function
+        uint64_t                running_ns = 0;
+
+        /// Run durations, see eHistBuckets
+        std::vector<uint64_t>   hist;
+    };
+
+    /// How the thread should run, the defaults change nothing
+    struct options
+    {
+        /// Cpus the thread may run on, empty for any
+        std::vector<int>    cpus;
+
+        /// One of the eSched values
+        int                 policy = eSchedDefault;
+
+        /// Real time priority for eSchedFifo and eSchedRR, 1 to 99 on Linux
+        int                 priority = 0;
+
+        /// Nice level, -20 to 19, zero leaves it alone
+        int                 nice = 0;
+
+        /// Thread name, Linux keeps the first 15 characters
+        std::string         name;
+
+        /// Keep run loop counters, costs a clock read per run
+        bool                stats = true;
+    };
+
     /// Default constructor
     worker_thread();
 
@@ -104,11 +236,28 @@ public:
     /// Construct with init, run, and end functions
     worker_thread(pfn_Worker fInit, pfn_Worker fRun, pfn_Worker fEnd, bool bStart = true);
 
+    /// Construct with single run function and thread options
+    worker_thread(pfn_Worker fRun, const options &opt, bool bStart = true);
+
+    /// Construct with init, run, and end functions and thread options
+    worker_thread(pfn_Worker fInit, pfn_Worker fRun, pfn_Worker fEnd, const options &opt, bool bStart = true);
+
 public:
 
-    /// Initialize threads
+    /// Initialize threads, nothing to do now that abort() is cooperative
     static void init();
 
+    /// Applies options to the calling thread, returns false if any failed
+    /**
+        Real time policies and negative nice levels usually need
+        CAP_SYS_NICE or a raised RLIMIT_RTPRIO. Failures are logged and
+        the thread runs on with whatever did work.
+    */
+    static bool set_options(const options &opt);
+
+    /// Options the thread starts with, set before start()
+    void set_start_options(const options &opt) { m_opt = opt; }
+
 public:
 
     /// Starts the thread
@@ -124,34 +273,44 @@ public:
     bool isRunning() { return m_pThread ? m_pThread->joinable() : false; }
 
     /// Non-zero if the thread should be running
-    bool wantRun() { return m_bRun; }
+    bool wantRun() { return m_bRun.load(); }
 
     /// Waits for the specified interval, but returns early if the threads run status changes
     bool wait(int nMs);
 
-    /// Attempt to abort thread
+    /// Asks the thread to stop without waiting for the run function to return
+    /**
+        Requests a stop on the thread's token, which ends any blocking
+        property_bag_ts call the thread is in. Run functions that loop
+        on their own should check token().stop_requested().
+    */
     bool abort();
 
-private:
+    /// The thread's stop token, also stop_token::current() on the thread
+    stop_token token() const { return m_stop.get_token(); }
 
-    /// Called only by the thread
-    void Run();
+    /// Run loop counters for this thread
+    stats_info stats() const;
 
-private:
+    /// Run loop counters for every running worker_thread
+    /**
+        One bag per thread, with the stats_info fields as keys.
+        A thread that has been in its run function for a long time
+        shows up with a large running_ns.
+    */
+    static property_bag all_stats();
 
-    class throw_abort {};
-
-#   if __linux__
-
-    static void worker_thread_sig(int sig);
+private:
 
-#   endif
+    /// Called only by the thread
+    void Run();
 
-    /// Function to inject
-    static void throw_exception() noexcept(false);
+    /// Adds to a counter only this thread writes, no locked instruction needed
+    static void _add(std::atomic<uint64_t> &a, uint64_t v)
+    {   a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed); }
 
-    /// Prevent compiler from optimizing out the try / catch blocks
-    static void init_exceptions();
+    /// Counts one run of nNs
+    void _count(uint64_t nNs);
 
 private:
 
@@ -170,8 +329,22 @@ private:
     /// End function
     pfn_Worker                  m_fEnd;
 
+    /// Applied by the thread when it starts
+    options                     m_opt;
+
+    /// Run loop counters, written only by the thread
+    std::atomic<uint64_t>       m_nIterations;
+    std::atomic<uint64_t>       m_nBusy;
+    std::atomic<uint64_t>       m_nIdle;
+    std::atomic<uint64_t>       m_nMax;
+    std::atomic<uint64_t>       m_nRunStart;
+    std::atomic<uint64_t>       m_hist[eHistBuckets];
+
     /// Non-zero if the thread should run
-    bool                        m_bRun;
+    std::atomic<bool>           m_bRun;
+
+    /// Stopped by abort(), replaced on start()
+    stop_source                 m_stop;
 
     /// Set to non-zero when the thread is quitting
     bool                        m_bQuitting;
@@ -3,9 +3,15 @@
 #include <iostream>
 #include <iomanip>
 #include <cstring>
+#include <cstdio>
 
 #include "libzru.h"
 
+#if defined(__linux__)
+#   include <unistd.h>
+#   include <sys/wait.h>
+#endif
+
 #define THREADS     16
 #define ITERATIONS  5000
 #define RXPOP       100
@@ -45,6 +51,14 @@ int Test_Any()
 
     assertTrue(zru::any(&v).toString().substr(0, 3) == "[0x");
 
+    zru::any a1("a long string that does not fit in the small string buffer"), a2(42);
+    zru::any a3(std::move(a1));
+    assertTrue(a1.isVoid() && a3.toString().length() == 58);
+    a2.swap(a3);
+    assertTrue(a3 == 42 && a2.isString());
+    a2 = zru::any();
+    assertTrue(a2.isVoid());
+
     return 0;
 }
 
@@ -59,6 +73,18 @@ int Test_Str()
 
     assertTrue(zru::str::UnescapeStr<zru::t_str>("\\r\\n", zru::strpos(0)) == "\r\n");
 
+    // Character classes, long enough to use the vector kernels
+    const zru::str::char_class ccWhite(" \t\r\n");
+    zru::t_str sPad = zru::t_str(100, ' ') + "x" + zru::t_str(50, 'y') + "\t";
+    zru::t_str::size_type pos = 0;
+    assertTrue(100 == zru::str::find_first_not_of(sPad, ccWhite, pos));
+    assertTrue(151 == zru::str::find_first_of(sPad, ccWhite, pos));
+    pos = 101;
+    assertTrue(zru::t_str::npos == zru::str::find_first_of(sPad, ccWhite, pos, 150) && 150 == pos);
+    pos = 1;
+    assertTrue(zru::t_str::npos == zru::str::find_first_not_of(sPad, ccWhite, pos, 100) && 100 == pos);
+    assertTrue(ccWhite.has(L'\t') && !ccWhite.has(L'\x263A'));
+
     // MD5
     assertTrue(zru::md5::MD5().digestString("abcdefghijklmnopqrstuvwxyz")
                     == "98ef94f1f01ac7b91918c6747fdebd96");
@@ -105,6 +131,138 @@ int Test_PropertyBag()
     pb["bbb"] += 1;
     assertTrue(pb["bbb"].val() == 3);
 
+    zru::property_bag pb2(std::move(pb));
+    assertTrue(!pb.isset() && pb2["bbb"].val() == 3);
+    pb2 = std::move(pb2["aaa"]);
+    assertTrue(pb2.val() == 1 && !pb2.size());
+
+    // Arrays keep their order past 10 and pop the oldest first
+    zru::property_bag pbA;
+    for (int i = 0; i < 12; i++)
+        pbA.push(i);
+    assertTrue(pbA.isArray() && 12 == pbA.size());
+    assertTrue(pbA[10].val() == 10 && pbA["11"].val() == 11 && !pbA.isset(12));
+    assertTrue(zru::parsers::json_encode(pbA) == "[0,1,2,3,4,5,6,7,8,9,10,11]");
+    assertTrue(pbA.pop().val() == 0 && pbA.pop().val() == 1);
+    assertTrue(10 == pbA.size() && pbA.begin()->second.val() == 2 && "0" == pbA.begin()->first);
+    assertTrue(3 == pbA.pop(3).size() && pbA[0].val() == 5);
+    pbA["x"] = 1;
+    assertTrue(!pbA.isArray() && pbA["0"].val() == 5 && 8 == pbA.size());
+    assertTrue(7 == pbA.push(99) && pbA["0"].val() == 5 && pbA["6"].val() == 11 && 9 == pbA.size());
+
+    // Gaps aren't set, an index far past the end makes a map instead of a huge array
+    zru::property_bag pbG;
+    pbG.push(1);
+    pbG[5];
+    assertTrue(pbG.isArray() && 6 == pbG.size() && !pbG.isset(3) && pbG.isset(0));
+    pbG[1000000000] = 2;
+    assertTrue(!pbG.isArray() && 7 == pbG.size() && pbG["1000000000"].val() == 2);
+    pbG.clear();
+    pbG.push(1);
+    pbG.at(".", "99999999999.x") = 3;
+    assertTrue(!pbG.isArray() && 2 == pbG.size());
+    pbG.clear();
+    pbG["4000000000"] = 1;
+    pbG.setArray(true);
+    assertTrue(!pbG.isArray() && 1 == pbG.size());
+
+    // Keys that aren't an index go after the highest one
+    pbG.clear();
+    pbG["0"] = "zero";
+    pbG["01"] = "x";
+    pbG["1"] = "one";
+    pbG.setArray(true);
+    assertTrue(pbG.isArray() && 3 == pbG.size() && pbG[1].val() == "one" && pbG[2].val() == "x");
+    pbG.clear();
+    pbG["-1"] = "x";
+    pbG["0"] = "zero";
+    pbG.setArray(true);
+    assertTrue(pbG.isArray() && 2 == pbG.size() && pbG[0].val() == "zero" && pbG[1].val() == "x");
+
+    // Range for binds a reference in both modes, a copy of *it keeps its key
+    zru::t_str sKeys;
+    for (auto &kv : pbG)
+        sKeys += kv.first + "=" + kv.second.val().toString() + " ";
+    auto kv0 = *pbG.begin();
+    auto it0 = pbG.begin();
+    auto kv1 = *++it0;
+    assertTrue("0=zero 1=x " == sKeys && "0" == kv0.first && "1" == kv1.first);
+    pbG.setArray(false);
+    sKeys.clear();
+    for (auto &kv : pbG)
+        kv.second = kv.first, sKeys += kv.first;
+    assertTrue("01" == sKeys && pbG["1"].val() == "1");
+
+    // Sharded, the root is gathered from all shards
+    zru::property_bag_ts pbs(8);
+    for (int i = 0; i < 20; i++)
+        pbs.set(".", "k" + std::to_string(i) + ".v", i);
+    pbs.inc(".", "k3.v", 10);
+    pbs.dec(".", "k4.v", 1);
+    assertTrue(8 == pbs.shards() && 20 == pbs.size(".", ""));
+    assertTrue(pbs.get(".", ".k3.v").val() == 13 && pbs.get(".", "k4.v").val() == 3);
+    assertTrue(zru::parsers::json_encode(pbs.get(".", "k19")) == "{\"v\":19}");
+    assertTrue(20 == pbs.get(".", "").size());
+
+    // Views share a copy of the subtree until the next write
+    auto v1 = pbs.view(".", "k5");
+    assertTrue(v1 == pbs.view(".", "k5") && (*v1)["v"].val() == 5 && 1 == v1->size());
+    pbs.set(".", "k5.v", 55);
+    assertTrue(pbs.view(".", "k5.v")->val() == 55 && (*v1)["v"].val() == 5 && v1 != pbs.view(".", "k5"));
+    assertTrue(!pbs.view(".", "nope.x")->isset() && !pbs.isset(".", "nope"));
+
+    // Precompiled paths, an index segment goes into the array
+    const zru::property_bag::path pK7(".", "k7.v"), pQ(".", ".q.1.x");
+    assertTrue(2 == pK7.size() && 1 == pQ.index(1) && -1 == pQ.index(0));
+    assertTrue(pbs.get(pK7).val() == 7 && pbs.isset(pK7) && pbs.inc(pK7, 1));
+    assertTrue(pbs.get(".", "k7.v").val() == 8 && pbs.view(pK7)->val() == 8);
+    pbA.clear();
+    pbA["q"].push(1);
+    pbA["q"].push(2);
+    pbA.at(pQ) = 3;
+    assertTrue(pbA["q"].isArray() && pbA.at(".", "q.1.x").val() == 3 && 1 == pbA.length(pQ));
+    assertTrue(pbA.erase(zru::property_bag::path(".", "q.0")) && 1 == pbA["q"].size());
+    assertTrue(!pbA.isset(pQ) && pbA.isset(zru::property_bag::path(".", "q.0.x")));
+    assertTrue(pbs.erase(pK7) && !pbs.isset(pK7) && !pbs.erase(pK7));
+
+    // Queues by path meet queues by key
+    const zru::property_bag::path pJ(".", "jobs.q");
+    zru::property_bag pbJ;
+    std::vector<zru::property_bag> vJ;
+    assertTrue(0 == pbs.push(pJ, 1, false) && 1 == pbs.push(pJ, 2, false) && 2 == pbs.push(".", "jobs.q", 3, false));
+    assertTrue(pbs.pop(pbJ, pJ, 0) && pbJ.val() == 1 && 2 == pbs.popv(vJ, pJ, 5) && vJ[1].val() == 3);
+    assertTrue(!pbs.pop(pbJ, pJ, 0) && !pbs.wait(pJ, 1));
+    std::thread tJ([&]()
+    {   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        pbs.push(".", "jobs.q", 4, false);
+    });
+    assertTrue(pbs.pop(pbJ, pJ, 5000) && pbJ.val() == 4);
+    tJ.join();
+
+    // Flat storage, past the small size so the index is used
+    zru::flat_map<zru::t_str, int> fm;
+    for (int i = 0; i < 100; i++)
+        fm[zru::any(i).toString()] = i;
+    assertTrue(100 == fm.size() && 42 == fm.find("42")->second);
+    assertTrue("0" == fm.begin()->first);
+    fm.erase(fm.begin());
+    assertTrue(1 == fm.erase("50") && !fm.count("50") && !fm.count("0"));
+    assertTrue(98 == fm.size() && 99 == fm.find("99")->second);
+    assertTrue("1" == fm.begin()->first);
+
+    // Erasing from the middle keeps the order, and compacts as it goes
+    for (int i = 2; i < 100; i += 2)
+        if (50 != i)
+            fm.erase(zru::any(i).toString());
+    assertTrue(50 == fm.size() && !fm.count("2") && 97 == fm.find("97")->second);
+    int nOdd = 0, nLast = -1;
+    for (auto &kv : fm)
+        if (kv.second & 1 && kv.second > nLast)
+            nOdd++, nLast = kv.second;
+    assertTrue(50 == nOdd);
+    fm["200"] = 200;
+    assertTrue(51 == fm.size() && 200 == fm.find("200")->second && 99 == fm.find("99")->second);
+
     return 0;
 }
 
@@ -151,6 +309,74 @@ int Test_Parsers()
     assertTrue(pb["c"]["e"]["true"].val() == true);
     assertTrue(pb["c"]["e"]["false"].val() == false);
 
+    // Pick values out of the stream without building a property bag
+    struct json_pick : zru::parsers::json_sax_handler<>
+    {
+        int depth = 0, values = 0;
+        zru::t_str last;
+        zru::t_any d;
+        bool start_object() { depth++; return true; }
+        bool end_object() { depth--; return true; }
+        bool key(const zru::t_str &k) { last = k; return true; }
+        bool value(const zru::t_any &v) { values++; if (last == "d") d = v; return true; }
+    } pick;
+    assertTrue(zru::parsers::json_sax(jsonExamples[1], pick));
+    assertTrue(0 == pick.depth && 5 == pick.values);
+    assertTrue(pick.d == 3.14);
+    assertFalse(zru::parsers::json_sax(zru::t_str("{\"a\":[1,2}"), pick));
+    assertFalse(zru::parsers::json_sax(zru::t_str("{\"a\":1,}"), pick));
+    assertFalse(zru::parsers::json_sax(zru::t_str("[1,]"), pick));
+    assertTrue(zru::parsers::json_sax(zru::t_str("[[],{},[1,[2]]]"), pick));
+
+    // Numbers follow the JSON grammar
+    for (auto s : { "[e]", "[+]", "[.]", "[-]", "[1-2]", "[01]", "[1.]", "[.5]", "[1e]", "[+1]", "[1e+]" })
+        assertFalse(zru::parsers::json_sax(zru::t_str(s), pick));
+    pick.values = 0;
+    assertTrue(zru::parsers::json_sax(zru::t_str("{\"d\":-0.5e+3,\"x\":[0,10,-1E2,null]}"), pick));
+
+    // What json_encode() writes reads back, whole doubles included
+    zru::property_bag pbNum;
+    pbNum["w"] = 2.0;
+    pbNum["f"] = 0.25;
+    pbNum["a"].push(1.0);
+    zru::t_str sNum = zru::parsers::json_encode(pbNum);
+    json_pick pickNum;
+    assertTrue(zru::parsers::json_sax(sNum, pickNum) && 3 == pickNum.values);
+    assertTrue(zru::parsers::json_parse(sNum)["w"].val() == 2.0 && zru::parsers::json_parse(sNum)["a"][0].val() == 1.0);
+    assertTrue(5 == pick.values && pick.d == -500.0);
+
+    // Newline delimited records arriving in small pieces
+    const zru::t_str ndjson = "{\"id\":1,\"s\":\"}{\\\"\"}\n{\"id\":2,\"a\":[1,{\"b\":2}]}\r\n{\"id\":3}\n";
+    long total = 0, records = 0;
+    zru::parsers::json_stream<> js([&](zru::property_bag &r)->bool
+    {
+        records++;
+        total += r["id"].val().toLong();
+        return true;
+    });
+    for (zru::t_str::size_type i = 0; i < ndjson.length(); i += 5)
+        js.write(ndjson.substr(i, 5));
+    assertTrue(3 == records && 6 == total);
+    assertTrue(!js.partial() && !js.pending() && !js.errors());
+
+    // Empty records are records, a broken one and a run of junk are one error each
+    records = 0;
+    js.write(zru::t_str("{}\n[]\n{\"id\":1}\n"));
+    assertTrue(3 == records && !js.errors());
+    js.write(zru::t_str("{\"id\":2,\"a\":1,}\nxyz {\"id\":3}"));
+    assertTrue(4 == records && 2 == js.errors());
+    js.write(zru::t_str("{\"id\":4,\"n\":1-2}\n{\"id\":5,\"n\":-1.5}\n"));
+    assertTrue(5 == records && 3 == js.errors());
+
+    // Records keep null and exponent values
+    std::vector<zru::property_bag> recs;
+    zru::parsers::json_stream<> js2([&](zru::property_bag &r)->bool { recs.push_back(r); return true; });
+    js2.write(zru::t_str("{\"a\":null,\"b\":1}\n{\"a\":1e3,\"b\":2}\n[1,null,{\"c\":[]}]\n"));
+    assertTrue(3 == recs.size() && !js2.errors());
+    assertTrue(recs[0].end() != recs[0].find("a") && !recs[0]["a"].isset() && 1 == recs[0]["b"].val().toInt());
+    assertTrue(1000.0 == recs[1]["a"].val().toDouble() && 2 == recs[1]["b"].val().toInt());
+    assertTrue(recs[2].isArray() && 3 == recs[2].size() && !recs[2][1].isset() && recs[2][2]["c"].isArray());
+
 
     const typename zru::string cfgExamples[] =
         {
@@ -204,6 +430,39 @@ int Test_Parsers()
 }
 
 //-------------------------------------------------------------------
+#if defined(ZRU_COROUTINES)
+
+/// Pops one value on the pool
+static zru::co_task co_test_pop(zru::thread_pool &tp, std::atomic<int> &nSum, std::atomic<int> &nLeft, zru::signal &done)
+{
+    co_await zru::co_schedule(tp);
+    zru::property_bag p;
+    if (co_await zru::co_pop(zru::pb, p, ".", "co.q", 5000))
+        nSum += p.val().toInt();
+    if (!--nLeft)
+        done.signal_all();
+}
+
+/// One wait that times out, one that sees a change
+static zru::co_task co_test_wait(std::atomic<int> &r, zru::signal &done)
+{
+    bool a = co_await zru::co_wait(zru::pb, ".", "co.none", 20);
+    bool b = co_await zru::co_wait(zru::pb, ".", "co.key", 5000);
+    r = (a ? 0 : 1) + (b ? 2 : 0);
+    done.signal_all();
+}
+
+/// A pop nobody pushes to in time
+static zru::co_task co_test_timeout(zru::thread_pool &tp, std::atomic<int> &r, zru::signal &done)
+{
+    co_await zru::co_schedule(tp);
+    zru::property_bag p;
+    r = co_await zru::co_pop(zru::pb, p, ".", "co.late.q", 50) ? 1 : 2;
+    done.signal_all();
+}
+
+#endif
+
 int Test_Threads()
 {
     //---------------------------------------------------------------
@@ -217,6 +476,122 @@ int Test_Threads()
     someThread->join();
     assertTrue(11 == value);
 
+#if defined(__linux__)
+    //---------------------------------------------------------------
+    zru::worker_thread::options opt;
+    opt.name = "zru-test-thread-name";
+    opt.cpus = { 0 };
+    opt.policy = zru::worker_thread::eSchedOther;
+    char szName[32] = { 0 };
+    int nCpu = -1;
+    zru::worker_thread::sptr optThread(
+                new zru::worker_thread([&]()->int
+                {
+                    pthread_getname_np(pthread_self(), szName, sizeof(szName));
+                    nCpu = sched_getcpu();
+                    return -1;
+                }, opt));
+    optThread->join();
+    assertTrue(zru::t_str("zru-test-thread") == szName && 0 == nCpu);
+#endif
+
+    //---------------------------------------------------------------
+    {
+        zru::worker_thread::options so;
+        so.name = "zru-stats";
+        int nRuns = 0;
+        bool bListed = false;
+        zru::signal stDone;
+        zru::worker_thread st([&]()->int
+        {
+            // Find ourselves among the live threads
+            if (2 == nRuns)
+                for (auto w : zru::worker_thread::all_stats())
+                    if (w.second["name"].val() == "zru-stats")
+                        bListed = 2 == w.second["iterations"].val().toInt() && 0 < w.second["running_ns"].val().toLongLong();
+            if (5 > ++nRuns)
+                return 1;
+            stDone.signal_all();
+            return -1;
+        }, so);
+        stDone.wait_ms(3000);
+        st.join();
+
+        auto si = st.stats();
+        uint64_t nHist = 0;
+        for (auto h : si.hist)
+            nHist += h;
+        assertTrue(bListed && 5 == si.iterations && 5 == nHist);
+        assertTrue(0 < si.idle_ns && si.max_ns <= si.busy_ns && !si.running_ns);
+    }
+
+    //---------------------------------------------------------------
+    zru::signal sig;
+    assertFalse(sig.wait_ms(0) || sig.wait_ms(5));
+    zru::worker_thread::sptr sigThread(
+                new zru::worker_thread([&sig]()->int
+                {
+                    sig.signal_all();
+                    return -1;
+                }));
+    assertTrue(sig.wait_ms(3000) && sig.wait_ms(0));
+    sigThread->join();
+    sig.reset();
+    assertFalse(sig.wait_ms(1));
+
+    //---------------------------------------------------------------
+    {
+        zru::thread_pool tp(3);
+        auto f1 = tp.submit([](int a, int b) { return a + b; }, 2, 3);
+        auto f2 = tp.submit([&tp]()
+        {
+            // Tasks can spawn tasks
+            std::vector< std::future<int> > v;
+            for (int i = 0; i < 100; i++)
+                v.push_back(tp.submit([i]() { return i; }));
+            int n = 0;
+            for (auto &f : v)
+                n += f.get();
+            return zru::thread_pool::current() == &tp ? n : -1;
+        });
+        assertTrue(3 == tp.size() && 5 == f1.get());
+        assertTrue(4950 == f2.get() && !zru::thread_pool::current());
+
+        // Move only arguments, and a bind expression is passed as is, not called
+        assertTrue(9 == tp.submit([](std::unique_ptr<int> p) { return *p; }, std::make_unique<int>(9)).get());
+        assertTrue(2 == tp.submit([](std::function<int()> g) { return g() + 1; }, std::bind([]() { return 1; })).get());
+
+        // A task throwing something that isn't a std::exception doesn't end the process
+        for (int i = 0; i < 3; i++)
+            tp.post([]() { throw 1; });
+        assertTrue(7 == tp.submit([]() { return 7; }).get());
+    }
+
+    //---------------------------------------------------------------
+    {
+        // Driven by hand, across the level boundaries
+        zru::timer_wheel tw(false);
+        int a = 0, b = 0;
+        tw.add([&a]() { a++; return 10; }, 5);
+        auto id = tw.add([&b]() { b++; return 0; }, 300);
+        tw.add([]() { return -1; }, 100000);
+        tw.tick(4);
+        assertTrue(0 == a && 1 == tw.tick(1) && 1 == a);
+        tw.tick(295);
+        assertTrue(30 == a && 1 == b && 3 == tw.size());
+        tw.tick(1);
+        assertTrue(2 == b && tw.remove(id) && !tw.remove(id));
+        tw.tick(100000);
+        assertTrue(2 == b && 1 == tw.size());
+
+        // On its own thread
+        std::atomic<int> n(0);
+        zru::signal done;
+        zru::timer_wheel tw2;
+        tw2.add([&]() { if (3 > ++n) return 5; done.signal_all(); return -1; });
+        assertTrue(done.wait_ms(3000) && 3 == n);
+    }
+
     //---------------------------------------------------------------
     value = 0;
     zru::worker_thread::sptr rxThread(
@@ -256,6 +631,51 @@ int Test_Threads()
 
     assertTrue(6 == value); // 1 + 2 + 3 = 6
 
+    //---------------------------------------------------------------
+    value = 0;
+    auto q = zru::pb.get_queue("thread.nq", 4);
+    assertTrue(4 == q->capacity() && q == zru::pb.get_queue("thread.nq"));
+    zru::worker_thread::sptr qrxThread(
+                new zru::worker_thread([&value, q]()->int
+                {
+                    int i = 0;
+                    do
+                    {
+                        zru::property_bag pb;
+                        if (!q->pop(pb, 3000))
+                            return -1;
+
+                        i = pb.val().toInt();
+                        value += i;
+
+                    } while (3 > i);
+
+                    return -1;
+                }));
+
+    for (int i = 0; i <= 3; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        zru::pb.qpush("thread.nq", i);
+    }
+    qrxThread->join();
+
+    assertTrue(6 == value);
+    for (int i = 0; i < 4; i++)
+        q->push(i);
+    assertFalse(q->push(4));
+    zru::property_bag pbQ;
+    assertTrue(zru::pb.qpop(pbQ, "thread.nq", 0) && pbQ.val() == 0);
+    assertTrue(zru::pb.remove_queue("thread.nq") && 3 == q->size());
+
+    // Batches keep their order
+    std::vector<zru::any> vIn = { 1, 2, 3, 4, 5 };
+    std::vector<zru::property_bag> vOut;
+    assertTrue(5 == zru::pb.push_batch(".", "thread.batch", vIn.begin(), vIn.end()));
+    assertTrue(3 == zru::pb.popv(vOut, ".", "thread.batch", 3) && vOut[2].val() == 3);
+    assertTrue(2 == zru::pb.popv(vOut, ".", "thread.batch", 3, 10) && vOut[4].val() == 5);
+    assertTrue(0 == zru::pb.popv(vOut, ".", "thread.batch", 3, 10) && 5 == vOut.size());
+
 
     //---------------------------------------------------------------
     value = 0;
@@ -281,6 +701,165 @@ int Test_Threads()
 
     zru::pb.remove_named_wait("thread-rx");
 
+    // Waits see changes below their key, not beside it
+    zru::pb.add_named_wait("thread-tree", ".", "tree.a");
+    zru::pb.set(".", "tree.a.b.c", 1);
+    zru::pb.set(".", "tree.ab", 1);
+    zru::pb.set(".", "tree", 1);
+    zru::pb.set(".", ".tree.a", 2);
+    assertTrue(2 == zru::pb.get_named_update_count("thread-tree"));
+    zru::pb.remove_named_wait("thread-tree");
+    zru::pb.set(".", "tree.a", 3);
+    assertTrue(0 == zru::pb.get_named_update_count("thread-tree"));
+
+    //---------------------------------------------------------------
+    {
+        zru::stop_source ss;
+        int n = 0;
+        zru::stop_callback cb(ss.get_token(), [&n]() { n++; });
+        assertTrue(ss.request_stop() && !ss.request_stop() && 1 == n);
+        zru::stop_callback cb2(ss.get_token(), [&n]() { n++; });
+        assertTrue(2 == n && ss.get_token().stop_requested() && !zru::stop_token().stop_possible());
+    }
+
+    //---------------------------------------------------------------
+    {
+        // Aborting a thread ends whatever it is blocked on
+        auto sq = zru::pb.get_queue("thread.stopq");
+        zru::pb.add_named_wait("thread-stop", ".", "thread.stop.key");
+        std::atomic<int> nBlocked(0), nWoke(0);
+        std::vector<zru::worker_thread::sptr> v;
+        for (int i = 0; i < 4; i++)
+            v.emplace_back(new zru::worker_thread([&, i]()->int
+            {
+                zru::property_bag p;
+                nBlocked++;
+                bool b = 0 == i ? zru::pb.pop(p, ".", "thread.stop.q", 60000)
+                       : 1 == i ? sq->pop(p, 60000)
+                       : 2 == i ? zru::pb.named_wait("thread-stop", 60000)
+                       : zru::pb.wait(".", "thread.stop.key", 60000);
+                if (!b && zru::stop_token::current().stop_requested())
+                    nWoke++;
+                return -1;
+            }));
+
+        while (4 > nBlocked)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        auto t = std::chrono::steady_clock::now();
+        for (auto &w : v)
+            w->abort();
+        for (auto &w : v)
+            w->join();
+        assertTrue(4 == nWoke && std::chrono::steady_clock::now() - t < std::chrono::seconds(5));
+
+        zru::pb.remove_named_wait("thread-stop");
+        zru::pb.remove_queue("thread.stopq");
+    }
+
+    //---------------------------------------------------------------
+    {
+        // Signal-one pushes reach every blocked pop, none sit out the timeout
+        const int nWaiters = 200;
+        std::atomic<int> nBlocked(0), nPopped(0);
+        std::vector<zru::worker_thread::sptr> v;
+        for (int i = 0; i < nWaiters; i++)
+            v.emplace_back(new zru::worker_thread([&]()->int
+            {
+                zru::property_bag p;
+                nBlocked++;
+                if (zru::pb.pop(p, ".", "thread.many.q", 60000))
+                    nPopped++;
+                return -1;
+            }));
+
+        while (nWaiters > nBlocked)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        auto t = std::chrono::steady_clock::now();
+        for (int i = 0; i < nWaiters; i++)
+            zru::pb.push(".", "thread.many.q", i, false);
+        while (nWaiters > nPopped && std::chrono::steady_clock::now() - t < std::chrono::seconds(10))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        assertTrue(nWaiters == nPopped);
+
+        for (auto &w : v)
+            w->join();
+    }
+
+    //---------------------------------------------------------------
+    {
+        // Callbacks instead of blocked threads
+        int nChanged = 0, nPushed = 0;
+        auto w = zru::pb.async_wait(".", "async.key", [&nChanged]() { nChanged++; });
+        zru::pb.set(".", "async.key.sub", 1);
+        zru::pb.set(".", "async.key", 2);
+        zru::pb.async_cancel(w);
+        zru::property_bag p;
+        auto pw = zru::pb.async_pop(p, ".", "async.q", [&nPushed]() { nPushed++; });
+        zru::pb.push(".", "async.q", 5, false);
+        assertTrue(1 == nChanged && pw && 1 == nPushed);
+        zru::pb.async_cancel(pw);
+        assertTrue(!zru::pb.async_pop(p, ".", "async.q", []() {}) && p.val() == 5);
+    }
+
+#if defined(ZRU_COROUTINES)
+    //---------------------------------------------------------------
+    {
+        // A thousand waiters on two threads
+        zru::thread_pool tp(2);
+        std::atomic<int> nSum(0), nLeft(1000);
+        // The waker may still be inside signal_all() when wait_ms() returns
+        static zru::signal done;
+        for (int i = 0; i < 1000; i++)
+            co_test_pop(tp, nSum, nLeft, done);
+        for (int i = 0; i < 1000; i++)
+            zru::pb.push(".", "co.q", 1, false);
+        assertTrue(done.wait_ms(10000) && 1000 == nSum);
+
+        std::atomic<int> r(0);
+        static zru::signal wdone;
+        co_test_wait(r, wdone);
+        for (int i = 0; i < 500 && !wdone.wait_ms(10); i++)
+            zru::pb.set(".", "co.key", i);
+        assertTrue(wdone.wait_ms(0) && 3 == r);
+    }
+
+    //---------------------------------------------------------------
+    {
+        // A timed out pop doesn't take a signal-one push from a blocked thread
+        zru::thread_pool tp(1);
+        std::atomic<int> r(0), nPopped(0);
+        static zru::signal done, busy;
+        co_test_timeout(tp, r, done);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        // Keep the pool busy so the coroutine can't come back and unhook itself
+        tp.post([]() { busy.wait_ms(10000); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        zru::worker_thread::sptr popThread(
+                    new zru::worker_thread([&nPopped]()->int
+                    {
+                        zru::property_bag p;
+                        if (zru::pb.pop(p, ".", "co.late.q", 5000))
+                            nPopped++;
+                        return -1;
+                    }));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        auto t = std::chrono::steady_clock::now();
+        zru::pb.push(".", "co.late.q", 1, false);
+        popThread->join();
+        assertTrue(1 == nPopped && std::chrono::steady_clock::now() - t < std::chrono::seconds(2));
+
+        busy.signal_all();
+        assertTrue(done.wait_ms(10000) && 2 == r);
+    }
+#endif
+
     // //---------------------------------------------------------------
     // value = 0;
     // zru::worker_thread::sptr waitThread2(
@@ -319,6 +898,186 @@ int Test_Shrmem()
     strcpy(m1.str(), "Hello");
     assertTrue(zru::t_str(m2.str()) == "Hello");
 
+    // Placement hints still give a working share
+    zru::shrmem::options so;
+    so.populate = true;
+    so.lock = true;
+    so.node = 0;
+    zru::shrmem m3;
+    assertTrue(m3.open("/myshare-opt", 1 << 20, true, so) && !m3.isHuge() && !*m3.str());
+    so.huge = true;
+    so.hugetlbfs = "/no-such-hugetlbfs";
+    assertFalse(zru::shrmem().open("/myshare-huge", 1 << 20, true, so));
+
+    // Mapped files keep their data after close
+    const zru::t_str sMap = "/tmp/zru-test-map.bin";
+    std::remove(sMap.c_str());
+    assertFalse(zru::shrmem().open_file(sMap, 0, zru::shrmem::eReadOnly));
+    {   zru::shrmem f;
+        assertTrue(f.open_file(sMap, 8192) && f.isFile() && !f.isExisting() && 8192 == f.size());
+        strcpy(f.str() + 4096, "Mapped");
+        assertTrue(f.flush() && f.advise(zru::shrmem::eAdviseSequential));
+    }
+    {   zru::shrmem f;
+        so = zru::shrmem::options();
+        so.populate = true;
+        assertTrue(f.open_file(sMap, 0, zru::shrmem::eReadOnly, so) && f.isReadOnly() && f.isExisting());
+        assertTrue(8192 == f.size() && zru::t_str("Mapped") == f.str() + 4096);
+        assertFalse(zru::shrmem().open_file(sMap, 16384, zru::shrmem::eReadOnly));
+    }
+    assertTrue(!std::remove(sMap.c_str()));
+
+    // Growing remaps in place, other processes follow with remap()
+    so = zru::shrmem::options();
+    so.growable = true;
+    zru::shrmem g1, g2;
+    assertTrue(g1.open("/zru-test-grow", 4096, true, so) && g2.open("/zru-test-grow", 4096, false, so));
+    assertTrue(g1.isGrowable() && 4096 == g1.size() && 0 == g1.generation() && !g2.isStale());
+    strcpy(g1.str(), "Grow");
+    assertTrue(g1.grow(1 << 20) && (1 << 20) == g1.size() && 1 == g1.generation());
+    g1.str()[(1 << 20) - 1] = 'x';
+    assertTrue(g2.isStale() && 4096 == g2.size() && g2.remap() && !g2.isStale());
+    assertTrue((1 << 20) == g2.size() && 'x' == g2.str()[(1 << 20) - 1] && zru::t_str("Grow") == g2.str());
+    assertTrue(g2.grow(4096) && (1 << 20) == g2.size() && 1 == g2.generation());
+
+    //---------------------------------------------------------------
+    zru::shm_ring r1, r2;
+    assertTrue(r1.open("/zru-test-ring", 4096) && r2.open("/zru-test-ring", 4096, false));
+    assertFalse(zru::shm_ring().open("/zru-test-ring", 8192, false));
+
+    std::size_t n = 0;
+    assertTrue(!r2.peek(n) && r1.push("Hello", 5));
+    const void *p = r2.peek(n);
+    assertTrue(p && 5 == n && !memcmp(p, "Hello", 5));
+    r2.release(p);
+    assertTrue(r1.empty() && !r1.reserve(r1.max_record() + 1));
+
+    // Three producers with their own mappings, varied sizes, many laps
+    const long nPer = 20000;
+    std::vector<std::thread> th;
+    for (int t = 0; t < 3; t++)
+        th.emplace_back([t, nPer]()
+        {
+            zru::shm_ring r;
+            if (r.open("/zru-test-ring", 4096, false))
+                for (long i = 0; i < nPer; i++)
+                {   zru::t_str s(1 + (i * 7 + t) % 300, 'a' + t);
+                    if (!r.push(s.data(), s.size(), 5000))
+                        return;
+                }
+        });
+
+    long nGot[3] = { 0, 0, 0 };
+    bool bOrdered = true;
+    zru::t_str s;
+    for (long i = 0; i < 3 * nPer && r2.pop(s, 5000); i++)
+    {   int t = s[0] - 'a';
+        if (0 > t || 2 < t || s.size() != (std::size_t)(1 + (nGot[t] * 7 + t) % 300)
+            || zru::t_str::npos != s.find_first_not_of(s[0]))
+            bOrdered = false;
+        else
+            nGot[t]++;
+    }
+    for (auto &x : th)
+        x.join();
+    assertTrue(bOrdered && nPer == nGot[0] && nPer == nGot[1] && nPer == nGot[2] && r1.empty());
+
+#if defined(__linux__)
+    // From another process
+    pid_t pid = fork();
+    if (!pid)
+    {   zru::shm_ring r;
+        if (r.open("/zru-test-ring", 4096, false))
+            for (int i = 1; i <= 1000; i++)
+                r.push(&i, sizeof(i), 5000);
+        _exit(0);
+    }
+
+    long nSum = 0;
+    for (int i = 0; i < 1000 && (p = r2.peek(n, 5000)); i++)
+    {   nSum += *(const int*)p;
+        r2.release(p);
+    }
+    waitpid(pid, 0, 0);
+    assertTrue(500500 == nSum);
+#endif
+
+    //---------------------------------------------------------------
+    struct node { int v; zru::shm_ptr<node> next; };
+
+    zru::shm_arena a1, a2;
+    assertTrue(a1.open("/zru-test-arena", 1 << 16) && a2.open("/zru-test-arena", 1 << 16, false));
+    assertFalse(zru::shm_arena().open("/zru-test-arena", 1 << 17, false));
+
+    // A list built in one mapping walks in the other
+    node *pHead = 0;
+    for (int i = 1; i <= 10; i++)
+    {   node *x = a1.create<node>();
+        assertTrue(x && !((std::intptr_t)x & 15));
+        x->v = i;
+        x->next = pHead;
+        pHead = x;
+    }
+    assertTrue(a1.set_root(pHead) && !a1.set_root(0) && a2.root() != pHead);
+    int nList = 0;
+    for (node *x = (node*)a2.root(); x; x = x->next.get())
+        nList += x->v;
+    assertTrue(55 == nList && a2.at<node>(a1.offset(pHead))->v == 10);
+
+    // Freed blocks come back, a full arena says so
+    void *pBlock = a1.alloc(100);
+    std::size_t nUsed = a2.used();
+    a2.free(a2.at(a1.offset(pBlock)));
+    assertTrue(a1.used() < nUsed && a1.alloc(100) == pBlock && !a1.alloc(1 << 16));
+
+#if defined(__linux__)
+    // A lock held by a process that died is taken over
+    zru::shm_mutex *pMtx = a1.create<zru::shm_mutex>();
+    pid = fork();
+    if (!pid)
+    {   pMtx->lock();
+        _exit(0);
+    }
+    waitpid(pid, 0, 0);
+    assertTrue(pMtx->lock());
+    pMtx->unlock();
+    assertTrue(pMtx->try_lock());
+    pMtx->unlock();
+#endif
+
+    //---------------------------------------------------------------
+    zru::shm_map k1, k2;
+    assertTrue(k1.open("/zru-test-map", 100) && k2.open("/zru-test-map", 100, false) && 128 == k2.capacity());
+    assertFalse(zru::shm_map().open("/zru-test-map", 100, false, 20));
+
+    assertTrue(k1.set("rate", 44100) && k1.set("gain", 0.5) && k1.set("on", true) && k1.set("big", 1ull << 40));
+    assertFalse(k1.set("name", "a string") || k1.set(zru::t_str(41, 'k'), 1) || k1.set("", 1));
+    assertTrue(k2.get("rate").isInt() && 44100 == k2.get("rate").toInt() && 0.5 == k2.get("gain").toDouble());
+    assertTrue(k2.get("on").toBool() && (1ull << 40) == k2.get("big").toULongLong() && 4 == k2.size());
+    assertTrue(k2.erase("gain") && !k2.isset("gain") && !k2.erase("gain") && 3 == k1.size() && k1.set("gain", 1.5f));
+
+    long nEach = 0;
+    k2.each([&](const zru::t_str &k, const zru::any &v) { nEach += k1.get(k).toString() == v.toString(); });
+    assertTrue(4 == nEach);
+
+    // A read never mixes the type of one write with the value of another
+    long nTorn = 0;
+    std::thread tw([&]()
+    {   for (int i = 0; i < 100000; i++)
+            i & 1 ? k1.set("mix", i + 0.5) : k1.set("mix", i);
+    });
+    for (int i = 0; i < 100000; i++)
+    {   zru::any v = k2.get("mix");
+        if (v.isDouble() ? 0.5 != v.toDouble() - v.toLongLong() : !v.isVoid() && (!v.isInt() || 0 > v.toInt()))
+            nTorn++;
+    }
+    tw.join();
+    assertTrue(!nTorn && 99999 == k2.get("mix").toLongLong());
+
+    for (int i = 0; k1.set(zru::any(i).toString(), i); i++)
+        ;
+    assertTrue(128 == k1.size() && 122 == k2.get("122").toInt() && !k2.isset("123"));
+
     return 0;
 }
 